@@ -0,0 +1,18 @@
+#!/bin/bash
+# run yet with 1, 4 and 16 SO_REUSEPORT acceptors and storm it with new rtmp connections.
+# usage: ./bench/conn_storm.sh [bin dir] [total conn num]
+
+BIN_DIR=${1:-./output/bin}
+TOTAL=${2:-20000}
+RTMP_PORT=19935
+HTTP_FLV_PORT=18090
+
+for N in 1 4 16; do
+  $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 $N 1 > /dev/null 2>&1 &
+  YET_PID=$!
+  sleep 1
+  echo -n "acceptors:$N "
+  $BIN_DIR/yet_bench_conn_storm 127.0.0.1 $RTMP_PORT $TOTAL
+  kill $YET_PID
+  wait $YET_PID 2>/dev/null || true
+done
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# regenerates the fixed corpora of yet_bench_micro. output is deterministic, the files are checked in,
+# rerun only when a corpus has to change on purpose, since numbers are only comparable on the same corpora.
+# usage: python3 bench/corpus/gen_corpus.py [out dir]
+import hashlib, hmac, os, random, struct, sys
+
+out_dir = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+rnd = random.Random(20190127)
+
+def write(name, data):
+    with open(os.path.join(out_dir, name), 'wb') as f:
+        f.write(data)
+
+def amf_str(s):
+    b = s.encode()
+    return b'\x02' + struct.pack('>H', len(b)) + b
+
+def amf_num(n):
+    return b'\x00' + struct.pack('>d', n)
+
+def amf_bool(v):
+    return b'\x01' + (b'\x01' if v else b'\x00')
+
+def amf_obj(kvs):
+    out = b'\x03'
+    for k, v in kvs:
+        out += struct.pack('>H', len(k)) + k.encode()
+        if isinstance(v, bool):
+            out += amf_bool(v)
+        elif isinstance(v, str):
+            out += amf_str(v)
+        else:
+            out += amf_num(v)
+    return out + b'\x00\x00\x09'
+
+def connect(kvs):
+    return amf_str('connect') + amf_num(1) + amf_obj(kvs)
+
+# connect command payloads with the fields real clients send
+write('connect_obs.bin', connect([
+    ('app', 'live'), ('type', 'nonprivate'), ('flashVer', 'FMLE/3.0 (compatible; FMSc/1.0)'),
+    ('swfUrl', 'rtmp://127.0.0.1:1935/live'), ('tcUrl', 'rtmp://127.0.0.1:1935/live')]))
+write('connect_ffmpeg.bin', connect([
+    ('app', 'live'), ('flashVer', 'LNX 9,0,124,2'), ('tcUrl', 'rtmp://127.0.0.1:1935/live'), ('fpad', False),
+    ('capabilities', 15), ('audioCodecs', 4071), ('videoCodecs', 252), ('videoFunction', 1)]))
+write('connect_flash.bin', connect([
+    ('app', 'live'), ('flashVer', 'WIN 32,0,0,465'), ('swfUrl', 'http://127.0.0.1/player/player.swf'),
+    ('tcUrl', 'rtmp://127.0.0.1:1935/live'), ('fpad', False), ('capabilities', 239), ('audioCodecs', 3575),
+    ('videoCodecs', 252), ('videoFunction', 1), ('pageUrl', 'http://127.0.0.1/player/index.html'),
+    ('objectEncoding', 0)]))
+
+# C0+C1 of plain handshake, version field zero, as rtmpdump and obs send
+c1 = struct.pack('>I', 0) + b'\x00' * 4 + bytes(rnd.getrandbits(8) for _ in range(1528))
+write('c0c1_simple.bin', b'\x03' + c1)
+
+# C0+C1 of digest handshake, digest in the first half, as ffmpeg sends. server tries the other half first
+client_key = b'Genuine Adobe Flash Player 001'
+c1 = bytearray(struct.pack('>I', 0) + bytes([0x80, 0x00, 0x07, 0x02]) + bytes(rnd.getrandbits(8) for _ in range(1528)))
+offs = (sum(c1[8:12]) % 728) + 12
+digest = hmac.new(client_key, bytes(c1[:offs] + c1[offs+32:]), hashlib.sha256).digest()
+c1[offs:offs+32] = digest
+write('c0c1_complex.bin', b'\x03' + bytes(c1))
+
+# flv body of 2 seconds, metadata, seq headers, 25fps video with a key frame per second, 43 aac frames per second
+def tag(tag_type, ts, data):
+    header = bytes([tag_type]) + struct.pack('>I', len(data))[1:] + struct.pack('>I', ts)[1:] + bytes([ts >> 24 & 0xff]) + b'\x00\x00\x00'
+    return header + data + struct.pack('>I', 11 + len(data))
+
+def nalu(key, size):
+    return struct.pack('>I', size) + bytes([0x65 if key else 0x41]) + bytes(rnd.getrandbits(8) for _ in range(size - 1))
+
+body = tag(18, 0, amf_str('onMetaData') + b'\x08\x00\x00\x00\x02' + b'\x00\x05width' + amf_num(1280)[0:9] +
+           b'\x00\x06height' + amf_num(720)[0:9] + b'\x00\x00\x09')
+body += tag(9, 0, b'\x17\x00\x00\x00\x00' + b'\x01\x64\x00\x1f\xff\xe1\x00\x19' + bytes(25) + b'\x01\x00\x04' + bytes(4))
+body += tag(8, 0, b'\xaf\x00\x12\x10')
+events = []
+for i in range(50):
+    key = i % 25 == 0
+    events.append((i * 40, 9, b'\x17\x01\x00\x00\x00' + nalu(True, rnd.randint(30000, 40000)) if key
+                   else b'\x27\x01\x00\x00\x00' + nalu(False, rnd.randint(1500, 6000))))
+for i in range(86):
+    events.append((i * 1024 * 1000 // 44100, 8, b'\xaf\x01' + bytes(rnd.getrandbits(8) for _ in range(rnd.randint(180, 260)))))
+for ts, tag_type, data in sorted(events, key=lambda e: (e[0], e[1])):
+    body += tag(tag_type, ts, data)
+write('flv_body.bin', body)
@@ -0,0 +1,20 @@
+#!/bin/bash
+# run yet and measure end-to-end fan-out of 1 and 10 streams to rtmp and http flv subscribers.
+# usage: ./bench/e2e.sh [bin dir] [io thread num] [rtmp subs per stream] [http flv subs per stream] [measure sec]
+
+BIN_DIR=${1:-./output/bin}
+THREAD_NUM=${2:-1}
+RTMP_SUB_NUM=${3:-50}
+HTTP_FLV_SUB_NUM=${4:-50}
+MEASURE_SEC=${5:-10}
+RTMP_PORT=19937
+HTTP_FLV_PORT=18092
+
+for STREAM_NUM in 1 10; do
+  $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 $THREAD_NUM 0 /dev/null > /dev/null 2>&1 &
+  YET_PID=$!
+  sleep 1
+  $BIN_DIR/yet_bench 127.0.0.1 $RTMP_PORT $HTTP_FLV_PORT $YET_PID $STREAM_NUM $RTMP_SUB_NUM $HTTP_FLV_SUB_NUM $MEASURE_SEC
+  kill $YET_PID
+  wait $YET_PID 2>/dev/null || true
+done
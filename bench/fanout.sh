@@ -0,0 +1,22 @@
+#!/bin/bash
+# run yet and fan one rtmp publisher out to 10, 100 and 500 rtmp subscribers.
+# yet is run with the yet_bench_syscall_count shim, so send syscalls of yet can be counted.
+# usage: ./bench/fanout.sh [bin dir] [lib dir] [measure sec]
+
+BIN_DIR=${1:-./output/bin}
+LIB_DIR=${2:-./output/lib}
+MEASURE_SEC=${3:-10}
+RTMP_PORT=19936
+HTTP_FLV_PORT=18091
+export YET_SYSCALL_COUNT_FILE=$(mktemp)
+
+for N in 10 100 500; do
+  LD_PRELOAD=$LIB_DIR/libyet_bench_syscall_count.so $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 > /dev/null 2>&1 &
+  YET_PID=$!
+  sleep 1
+  $BIN_DIR/yet_bench_fanout 127.0.0.1 $RTMP_PORT $YET_PID $N $MEASURE_SEC
+  kill $YET_PID
+  wait $YET_PID 2>/dev/null || true
+done
+
+rm -f $YET_SYSCALL_COUNT_FILE
@@ -0,0 +1,18 @@
+#!/bin/bash
+# run yet and publish one 50Mbps stream (250KB video frames at 25fps) without subscribers,
+# with peer chunk size 128 and 4096, to measure cpu of rtmp ingest per published Mbps.
+# usage: ./bench/ingest.sh [bin dir] [measure sec]
+
+BIN_DIR=${1:-./output/bin}
+MEASURE_SEC=${2:-10}
+RTMP_PORT=19936
+HTTP_FLV_PORT=18091
+
+for CHUNK_SIZE in 128 4096; do
+  $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 > /dev/null 2>&1 &
+  YET_PID=$!
+  sleep 1
+  $BIN_DIR/yet_bench_fanout 127.0.0.1 $RTMP_PORT $YET_PID 0 $MEASURE_SEC 250000 $CHUNK_SIZE
+  kill $YET_PID
+  wait $YET_PID 2>/dev/null || true
+done
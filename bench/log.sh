@@ -0,0 +1,30 @@
+#!/bin/bash
+# storm yet with new rtmp connections while its log goes to a slow stdout reader, sync log vs async log.
+# usage: ./bench/log.sh [bin dir] [total conn num]
+
+BIN_DIR=${1:-./output/bin}
+TOTAL=${2:-20000}
+RTMP_PORT=19935
+HTTP_FLV_PORT=18090
+
+# drain stdout at about 3MB/s, like a terminal or a log collector falling behind
+slow_reader() {
+  python3 -c '
+import sys, time
+while sys.stdin.buffer.read1(65536):
+    time.sleep(0.02)
+'
+}
+
+for MODE in sync async; do
+  if [ $MODE = sync ]; then
+    $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 1 1 2>&1 | slow_reader &
+  else
+    $BIN_DIR/yet $RTMP_PORT $HTTP_FLV_PORT 127.0.0.1:80 3600 1 1 - 2>&1 | slow_reader &
+  fi
+  sleep 1
+  echo -n "log:$MODE "
+  $BIN_DIR/yet_bench_conn_storm 127.0.0.1 $RTMP_PORT $TOTAL
+  pkill -x yet
+  wait 2>/dev/null || true
+done
@@ -0,0 +1,10 @@
+#!/bin/bash
+# run microbenchmarks on the corpora checked in bench/corpus.
+# usage: ./bench/micro.sh [bin dir] [case name filter] [min ms per case]
+
+BIN_DIR=${1:-./output/bin}
+FILTER=${2:-}
+MIN_MS=${3:-300}
+CORPUS_DIR=$(dirname $0)/corpus
+
+$BIN_DIR/yet_bench_micro $CORPUS_DIR "$FILTER" $MIN_MS
@@ -0,0 +1,598 @@
+/**
+ * @file   yet_bench.cc
+ * @author pengrl
+ *
+ * end-to-end fan-out load against a running yet over loopback.
+ * each stream has one synthetic rtmp publisher, which sends audio and video in real time with the
+ * send time embedded in every frame, and is fanned out to N rtmp and M http flv subscribers.
+ * subscribers demux the stream and take per-frame latency from the embedded time.
+ * reports throughput, frame loss, p50/p99 latency of each protocol, and cpu and rss of the yet process.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <asio.hpp>
+#include "yet_common/yet_log.h"
+#include "yet_rtmp/yet_rtmp.hpp"
+#include "yet_rtmp/yet_rtmp_pack_op.h"
+#include "yet_rtmp/yet_rtmp_chunk_op.h"
+#include "yet_rtmp/yet_rtmp_chunk_demuxer.h"
+
+namespace {
+
+using namespace yet;
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint8_t> Bytes;
+
+static constexpr std::size_t C0C1_LEN         = 1537;
+static constexpr std::size_t S0S1S2_LEN       = 3073;
+static constexpr int         TICK_MS          = 20;  // one audio frame per tick, one video frame per two ticks
+static constexpr int         GOP_FRAME_NUM    = 50;
+static constexpr std::size_t AUDIO_LEN        = 200;
+static constexpr uint32_t    PUB_CHUNK_SIZE   = 4096;
+static constexpr std::size_t READ_LEN         = 65536;
+// send time sits after the 5 bytes video tag header and one nalu header, or after the 2 bytes audio tag header
+static constexpr std::size_t VIDEO_TIME_POS   = 10;
+static constexpr std::size_t AUDIO_TIME_POS   = 2;
+
+/// frames and latencies are only counted in the measure window, threads of clients just read it
+static std::atomic<bool> measuring{false};
+
+uint64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+void put_be(uint8_t *out, uint64_t v, int n) {
+  for (int i = 0; i < n; i++) { out[i] = static_cast<uint8_t>(v >> ((n - 1 - i) * 8)); }
+}
+
+uint64_t get_be(const uint8_t *p, int n) {
+  uint64_t v = 0;
+  for (int i = 0; i < n; i++) { v = (v << 8) | p[i]; }
+  return v;
+}
+
+struct ClientStat {
+  uint64_t              frame_num = 0;
+  uint64_t              bytes = 0;
+  std::vector<uint32_t> latencies_us;
+};
+
+/// rtmp handshake of client side: plain C0+C1, then C2 echoes S1
+class RtmpClient : public std::enable_shared_from_this<RtmpClient> {
+  public:
+    RtmpClient(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, const std::string &live_name)
+      : socket_(io_ctx), ep_(ep), live_name_(live_name), handshake_buf_(S0S1S2_LEN)
+    {}
+    virtual ~RtmpClient() {}
+
+    void start() {
+      socket_.async_connect(ep_, std::bind(&RtmpClient::connect_cb, shared_from_this(), _1));
+    }
+
+    virtual void stop() {
+      asio::error_code ignored;
+      socket_.close(ignored);
+    }
+
+    const ClientStat &stat() const { return stat_; }
+
+  protected:
+    /// commands written right after C2, without waiting for any response
+    virtual void append_commands(Bytes &out) = 0;
+    virtual void on_ready() = 0;
+    virtual void on_read(std::size_t len) = 0;
+    virtual const char *role() const = 0;
+
+    void append_connect(Bytes &out) {
+      append(out, RtmpPackOp::encode_rtmp_msg_chunk_size_reserve(),
+             [](uint8_t *p) { RtmpPackOp::encode_chunk_size(p, PUB_CHUNK_SIZE); });
+
+      std::string tc_url = "rtmp://" + ep_.address().to_string() + "/live";
+      int len = RtmpPackOp::encode_rtmp_msg_connect_reserve("live", "", tc_url.c_str());
+      append(out, len, [len, &tc_url](uint8_t *p) { RtmpPackOp::encode_connect(p, len, "live", "", tc_url.c_str()); });
+
+      append(out, RtmpPackOp::encode_rtmp_msg_create_stream_reserve(),
+             [](uint8_t *p) { RtmpPackOp::encode_create_stream(p); });
+    }
+
+    static void append(Bytes &out, int len, std::function<void(uint8_t *)> encode) {
+      std::size_t pos = out.size();
+      out.resize(pos + len);
+      encode(&out[pos]);
+    }
+
+    void do_read(uint8_t *pos, std::size_t len) {
+      socket_.async_read_some(asio::buffer(pos, len), std::bind(&RtmpClient::read_cb, shared_from_this(), _1, _2));
+    }
+
+    void fail(const char *stage, const asio::error_code &ec) {
+      if (ec == asio::error::operation_aborted || !socket_.is_open()) { return; }
+
+      fprintf(stderr, "%s %s %s failed. ec:%s\n", role(), live_name_.c_str(), stage, ec.message().c_str());
+      stop();
+    }
+
+  private:
+    void connect_cb(const asio::error_code &ec) {
+      if (ec) { return fail("connect", ec); }
+
+      socket_.set_option(asio::ip::tcp::no_delay(true));
+      write_buf_.assign(C0C1_LEN, 0);
+      write_buf_[0] = RTMP_VERSION;
+      for (std::size_t i = 9; i < C0C1_LEN; i++) { write_buf_[i] = static_cast<uint8_t>(rand()); }
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_c0c1_cb, shared_from_this(), _1));
+    }
+
+    void write_c0c1_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write c0c1", ec); }
+
+      asio::async_read(socket_, asio::buffer(handshake_buf_), std::bind(&RtmpClient::read_s0s1s2_cb, shared_from_this(), _1));
+    }
+
+    void read_s0s1s2_cb(const asio::error_code &ec) {
+      if (ec) { return fail("read s0s1s2", ec); }
+
+      write_buf_.assign(handshake_buf_.begin() + 1, handshake_buf_.begin() + 1 + 1536);
+      append_commands(write_buf_);
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_commands_cb, shared_from_this(), _1));
+    }
+
+    void write_commands_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write commands", ec); }
+
+      on_ready();
+    }
+
+    void read_cb(const asio::error_code &ec, std::size_t len) {
+      if (ec) { return fail("read", ec); }
+
+      on_read(len);
+    }
+
+  protected:
+    asio::ip::tcp::socket   socket_;
+    asio::ip::tcp::endpoint ep_;
+    std::string             live_name_;
+    Bytes                   handshake_buf_;
+    Bytes                   write_buf_;
+    ClientStat              stat_;
+};
+
+class RtmpPublisher : public RtmpClient {
+  public:
+    RtmpPublisher(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, const std::string &live_name, std::size_t video_len)
+      : RtmpClient(io_ctx, ep, live_name), timer_(io_ctx), video_len_(video_len), read_buf_(READ_LEN)
+    {}
+
+    virtual void stop() {
+      asio::error_code ignored;
+      timer_.cancel(ignored);
+      RtmpClient::stop();
+    }
+
+  private:
+    virtual const char *role() const { return "pub"; }
+
+    virtual void append_commands(Bytes &out) {
+      append_connect(out);
+      int len = RtmpPackOp::encode_rtmp_msg_publish_reserve("live", live_name_.c_str());
+      append(out, len, [this, len](uint8_t *p) { RtmpPackOp::encode_publish(p, len, "live", live_name_.c_str(), RTMP_MSID); });
+    }
+
+    virtual void on_ready() {
+      // responses are drained only
+      do_read(read_buf_.data(), read_buf_.size());
+
+      Bytes avc_header = {0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1f, 0xff};
+      Bytes aac_header = {0xaf, 0x00, 0x12, 0x10};
+      write_buf_.clear();
+      append_msg(avc_header, RTMP_MSG_TYPE_ID_VIDEO, 0);
+      append_msg(aac_header, RTMP_MSG_TYPE_ID_AUDIO, 0);
+      begin_ = Clock::now();
+      do_write();
+    }
+
+    virtual void on_read(std::size_t) {
+      do_read(read_buf_.data(), read_buf_.size());
+    }
+
+    void append_msg(const Bytes &payload, uint32_t type_id, uint32_t timestamp) {
+      bool is_audio = type_id == RTMP_MSG_TYPE_ID_AUDIO;
+      RtmpHeader h;
+      h.csid = is_audio ? RTMP_CSID_AUDIO : RTMP_CSID_VIDEO;
+      h.timestamp = timestamp;
+      h.msg_len = static_cast<uint32_t>(payload.size());
+      h.msg_type_id = type_id;
+      h.msg_stream_id = RTMP_MSID;
+      RtmpHeader &prev = is_audio ? prev_audio_ : prev_video_;
+      bool &has_prev = is_audio ? has_prev_audio_ : has_prev_video_;
+
+      BufferPtr chunks = RtmpChunkOp::msg2chunks(payload.data(), h, has_prev ? &prev : nullptr, PUB_CHUNK_SIZE);
+      write_buf_.insert(write_buf_.end(), chunks->read_pos(), chunks->read_pos() + chunks->readable_size());
+      prev = h;
+      has_prev = true;
+    }
+
+    void do_write() {
+      if (measuring) { stat_.bytes += write_buf_.size(); }
+      asio::async_write(socket_, asio::buffer(write_buf_),
+                        std::bind(&RtmpPublisher::write_cb, std::static_pointer_cast<RtmpPublisher>(shared_from_this()), _1));
+    }
+
+    void write_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write av", ec); }
+
+      tick_++;
+      timer_.expires_at(begin_ + std::chrono::milliseconds(tick_ * TICK_MS));
+      timer_.async_wait(std::bind(&RtmpPublisher::tick_cb, std::static_pointer_cast<RtmpPublisher>(shared_from_this()), _1));
+    }
+
+    void tick_cb(const asio::error_code &ec) {
+      if (ec) { return; }
+
+      uint32_t timestamp = static_cast<uint32_t>(tick_ * TICK_MS);
+      write_buf_.clear();
+
+      Bytes audio(AUDIO_LEN, 0);
+      audio[0] = 0xaf;
+      audio[1] = 0x01;
+      put_be(&audio[AUDIO_TIME_POS], now_us(), 8);
+      append_msg(audio, RTMP_MSG_TYPE_ID_AUDIO, timestamp);
+      int frame_num = 1;
+
+      if (tick_ % 2 == 0) {
+        // one nalu, idr for key frame, reference p slice for the rest
+        bool is_key = (tick_ / 2) % GOP_FRAME_NUM == 1;
+        Bytes video(std::max(video_len_, VIDEO_TIME_POS + 8), 0);
+        video[0] = is_key ? 0x17 : 0x27;
+        video[1] = 0x01;
+        put_be(&video[5], video.size() - 9, 4);
+        video[9] = is_key ? 0x65 : 0x41;
+        put_be(&video[VIDEO_TIME_POS], now_us(), 8);
+        append_msg(video, RTMP_MSG_TYPE_ID_VIDEO, timestamp);
+        frame_num++;
+      }
+
+      if (measuring) { stat_.frame_num += frame_num; }
+      do_write();
+    }
+
+  private:
+    asio::steady_timer timer_;
+    std::size_t        video_len_;
+    Bytes              read_buf_;
+    RtmpHeader         prev_audio_;
+    RtmpHeader         prev_video_;
+    bool               has_prev_audio_ = false;
+    bool               has_prev_video_ = false;
+    Clock::time_point  begin_;
+    int64_t            tick_ = 0;
+};
+
+/// latency of an audio/video tag data, the same as rtmp msg payload
+void on_av(ClientStat &stat, bool is_audio, const uint8_t *data, std::size_t len) {
+  if (!measuring) { return; }
+
+  std::size_t pos = is_audio ? AUDIO_TIME_POS : VIDEO_TIME_POS;
+  // seq headers carry no time
+  if (len < pos + 8 || data[1] == 0x00) { return; }
+
+  stat.frame_num++;
+  uint64_t sent_us = get_be(data + pos, 8);
+  uint64_t recv_us = now_us();
+  stat.latencies_us.push_back(recv_us > sent_us ? static_cast<uint32_t>(recv_us - sent_us) : 0);
+}
+
+class RtmpPlayer : public RtmpClient {
+  public:
+    RtmpPlayer(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, const std::string &live_name)
+      : RtmpClient(io_ctx, ep, live_name)
+      , demuxer_(std::bind(&RtmpPlayer::msg_cb, this, _1, _2))
+    {}
+
+  private:
+    virtual const char *role() const { return "rtmp sub"; }
+
+    virtual void append_commands(Bytes &out) {
+      append_connect(out);
+      int len = RtmpPackOp::encode_rtmp_msg_play_reserve(live_name_.c_str());
+      append(out, len, [this, len](uint8_t *p) { RtmpPackOp::encode_play(p, len, live_name_.c_str(), RTMP_MSID); });
+    }
+
+    virtual void on_ready() {
+      do_read(demuxer_.prepare_read(READ_LEN), READ_LEN);
+    }
+
+    virtual void on_read(std::size_t len) {
+      if (measuring) { stat_.bytes += len; }
+      demuxer_.feed(len);
+      do_read(demuxer_.prepare_read(READ_LEN), READ_LEN);
+    }
+
+    bool msg_cb(const RtmpHeader &h, uint8_t *msg) {
+      if (h.msg_type_id == RTMP_MSG_TYPE_ID_SET_CHUNK_SIZE && h.msg_len >= 4) {
+        demuxer_.set_peer_chunk_size(get_be(msg, 4) & 0x7FFFFFFF);
+      } else if (h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO || h.msg_type_id == RTMP_MSG_TYPE_ID_VIDEO) {
+        on_av(stat_, h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO, msg, h.msg_len);
+      }
+      return true;
+    }
+
+  private:
+    RtmpChunkDemuxer demuxer_;
+};
+
+class HttpFlvPlayer : public std::enable_shared_from_this<HttpFlvPlayer> {
+  public:
+    HttpFlvPlayer(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, const std::string &live_name)
+      : socket_(io_ctx), ep_(ep), live_name_(live_name)
+    {}
+
+    void start() {
+      socket_.async_connect(ep_, std::bind(&HttpFlvPlayer::connect_cb, shared_from_this(), _1));
+    }
+
+    void stop() {
+      asio::error_code ignored;
+      socket_.close(ignored);
+    }
+
+    const ClientStat &stat() const { return stat_; }
+
+  private:
+    void connect_cb(const asio::error_code &ec) {
+      if (ec) { return fail("connect", ec); }
+
+      request_ = "GET /live/" + live_name_ + ".flv HTTP/1.1\r\nHost: " + ep_.address().to_string() + "\r\n\r\n";
+      asio::async_write(socket_, asio::buffer(request_), std::bind(&HttpFlvPlayer::write_request_cb, shared_from_this(), _1));
+    }
+
+    void write_request_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write request", ec); }
+
+      do_read();
+    }
+
+    void do_read() {
+      std::size_t pos = buf_.size();
+      buf_.resize(pos + READ_LEN);
+      socket_.async_read_some(asio::buffer(&buf_[pos], READ_LEN), std::bind(&HttpFlvPlayer::read_cb, shared_from_this(), _1, _2));
+    }
+
+    void read_cb(const asio::error_code &ec, std::size_t len) {
+      if (ec) { return fail("read", ec); }
+
+      buf_.resize(buf_.size() - READ_LEN + len);
+      if (measuring) { stat_.bytes += len; }
+      if (!parse()) {
+        fprintf(stderr, "http flv sub %s invalid stream.\n", live_name_.c_str());
+        stop();
+        return;
+      }
+      do_read();
+    }
+
+    /// @return false if stream is invalid
+    bool parse() {
+      std::size_t pos = 0;
+      if (!header_done_) {
+        static const char CRLFCRLF[] = "\r\n\r\n";
+        auto iter = std::search(buf_.begin(), buf_.end(), CRLFCRLF, CRLFCRLF + 4);
+        if (iter == buf_.end() || buf_.end() - iter < 4 + 13) { return true; }
+
+        pos = iter - buf_.begin() + 4;
+        if (memcmp(&buf_[pos], "FLV", 3) != 0) { return false; }
+
+        pos += 13;
+        header_done_ = true;
+      }
+
+      // tag header 11, data, prev tag size 4
+      while (buf_.size() - pos >= 11) {
+        const uint8_t *tag = &buf_[pos];
+        std::size_t data_len = get_be(tag + 1, 3);
+        if (buf_.size() - pos < 11 + data_len + 4) { break; }
+
+        if (tag[0] == 8 || tag[0] == 9) { on_av(stat_, tag[0] == 8, tag + 11, data_len); }
+        else if (tag[0] != 18) { return false; }
+        pos += 11 + data_len + 4;
+      }
+      buf_.erase(buf_.begin(), buf_.begin() + pos);
+      return true;
+    }
+
+    void fail(const char *stage, const asio::error_code &ec) {
+      if (ec == asio::error::operation_aborted || !socket_.is_open()) { return; }
+
+      fprintf(stderr, "http flv sub %s %s failed. ec:%s\n", live_name_.c_str(), stage, ec.message().c_str());
+      stop();
+    }
+
+  private:
+    asio::ip::tcp::socket   socket_;
+    asio::ip::tcp::endpoint ep_;
+    std::string             live_name_;
+    std::string             request_;
+    Bytes                   buf_;
+    bool                    header_done_ = false;
+    ClientStat              stat_;
+};
+
+struct ProcSample {
+  uint64_t cpu_ticks = 0;
+  uint64_t rss_kb = 0;
+  uint64_t hwm_kb = 0;
+};
+
+bool sample_proc(int pid, ProcSample &sample) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  std::getline(stat, line);
+  std::size_t pos = line.rfind(')');
+  if (pos == std::string::npos) { return false; }
+
+  // fields after comm start from 3rd, utime and stime are 14th and 15th
+  std::istringstream iss(line.substr(pos + 2));
+  std::string field;
+  uint64_t utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && iss >> field; i++) {
+    if (i == 14) { utime = strtoull(field.c_str(), nullptr, 10); }
+    if (i == 15) { stime = strtoull(field.c_str(), nullptr, 10); }
+  }
+  sample.cpu_ticks = utime + stime;
+
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) { sample.rss_kb = strtoull(line.c_str() + 6, nullptr, 10); }
+    if (line.compare(0, 6, "VmHWM:") == 0) { sample.hwm_kb = strtoull(line.c_str() + 6, nullptr, 10); }
+  }
+  return true;
+}
+
+double self_cpu_sec() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+void report_subs(const char *proto, const std::vector<const ClientStat *> &stats, uint64_t expected_frame_num,
+                 double elapsed_sec)
+{
+  if (stats.empty()) { return; }
+
+  uint64_t frame_num = 0;
+  uint64_t bytes = 0;
+  std::vector<uint32_t> latencies;
+  for (auto stat : stats) {
+    frame_num += stat->frame_num;
+    bytes += stat->bytes;
+    latencies.insert(latencies.end(), stat->latencies_us.begin(), stat->latencies_us.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile_ms = [&latencies](double p) {
+    return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(latencies.size() * p))] / 1000.0;
+  };
+
+  printf("%-8s subs:%zu recv:%.1fMbps frames/s:%.0f loss:%.2f%% latency p50:%.2fms p99:%.2fms max:%.2fms\n",
+         proto, stats.size(), bytes * 8 / elapsed_sec / 1000000, frame_num / elapsed_sec,
+         expected_frame_num ? 100.0 * (1.0 - std::min(1.0, static_cast<double>(frame_num) / expected_frame_num)) : 0.0,
+         percentile_ms(0.5), percentile_ms(0.99), percentile_ms(1.0));
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    fprintf(stderr, "Usage: %s <ip> <rtmp port> <http flv port> <yet pid, 0 if unknown> [stream num=1] "
+                    "[rtmp subs per stream=10] [http flv subs per stream=10] [measure sec=10] [video frame bytes=8000] "
+                    "[threads=1]\n", argv[0]);
+    return -1;
+  }
+  asio::ip::address ip = asio::ip::address_v4::from_string(argv[1]);
+  asio::ip::tcp::endpoint rtmp_ep(ip, static_cast<uint16_t>(atoi(argv[2])));
+  asio::ip::tcp::endpoint http_flv_ep(ip, static_cast<uint16_t>(atoi(argv[3])));
+  int pid = atoi(argv[4]);
+  int stream_num = (argc > 5) ? atoi(argv[5]) : 1;
+  int rtmp_sub_num = (argc > 6) ? atoi(argv[6]) : 10;
+  int http_flv_sub_num = (argc > 7) ? atoi(argv[7]) : 10;
+  int measure_sec = (argc > 8) ? atoi(argv[8]) : 10;
+  std::size_t video_len = (argc > 9) ? static_cast<std::size_t>(atoi(argv[9])) : 8000;
+  int thread_num = (argc > 10) ? std::max(atoi(argv[10]), 1) : 1;
+  static constexpr int WARMUP_SEC = 2;
+
+  Log::set_level(spdlog::level::warn);
+
+  std::vector<std::unique_ptr<asio::io_context>> io_ctxs;
+  for (int i = 0; i < thread_num; i++) { io_ctxs.emplace_back(new asio::io_context(1)); }
+  std::size_t next_io_ctx = 0;
+  auto pick_io_ctx = [&io_ctxs, &next_io_ctx]() -> asio::io_context & { return *io_ctxs[next_io_ctx++ % io_ctxs.size()]; };
+
+  // subs first, so that they wait for the first key frame instead of a replay of gop cache
+  std::vector<std::shared_ptr<RtmpPublisher>> pubs;
+  std::vector<std::shared_ptr<RtmpPlayer>> rtmp_subs;
+  std::vector<std::shared_ptr<HttpFlvPlayer>> http_flv_subs;
+  for (int i = 0; i < stream_num; i++) {
+    std::string live_name = "bench" + std::to_string(i);
+    for (int j = 0; j < rtmp_sub_num; j++) {
+      rtmp_subs.push_back(std::make_shared<RtmpPlayer>(pick_io_ctx(), rtmp_ep, live_name));
+      rtmp_subs.back()->start();
+    }
+    for (int j = 0; j < http_flv_sub_num; j++) {
+      http_flv_subs.push_back(std::make_shared<HttpFlvPlayer>(pick_io_ctx(), http_flv_ep, live_name));
+      http_flv_subs.back()->start();
+    }
+  }
+  for (int i = 0; i < stream_num; i++) {
+    pubs.push_back(std::make_shared<RtmpPublisher>(pick_io_ctx(), rtmp_ep, "bench" + std::to_string(i), video_len));
+    pubs.back()->start();
+  }
+
+  std::vector<std::thread> threads;
+  for (auto &io_ctx : io_ctxs) {
+    asio::io_context *p = io_ctx.get();
+    threads.emplace_back([p] {
+      auto work = asio::make_work_guard(*p);
+      p->run();
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(WARMUP_SEC));
+  ProcSample begin_sample;
+  if (pid && !sample_proc(pid, begin_sample)) { fprintf(stderr, "Read /proc/%d failed.\n", pid); }
+  double begin_self_cpu = self_cpu_sec();
+  Clock::time_point begin_time = Clock::now();
+  measuring = true;
+
+  std::this_thread::sleep_for(std::chrono::seconds(measure_sec));
+  measuring = false;
+  Clock::time_point end_time = Clock::now();
+  double end_self_cpu = self_cpu_sec();
+  ProcSample end_sample;
+  if (pid) { sample_proc(pid, end_sample); }
+
+  for (auto &io_ctx : io_ctxs) { io_ctx->stop(); }
+  for (auto &thd : threads) { thd.join(); }
+
+  double elapsed_sec = std::chrono::duration_cast<std::chrono::microseconds>(end_time - begin_time).count() / 1000000.0;
+  uint64_t pub_frame_num = 0;
+  uint64_t pub_bytes = 0;
+  for (auto &pub : pubs) {
+    pub_frame_num += pub->stat().frame_num;
+    pub_bytes += pub->stat().bytes;
+  }
+  printf("streams:%d elapsed:%.3fs pub:%.1fMbps frames/s:%.0f bench cpu:%.1f%%\n",
+         stream_num, elapsed_sec, pub_bytes * 8 / elapsed_sec / 1000000, pub_frame_num / elapsed_sec,
+         (end_self_cpu - begin_self_cpu) / elapsed_sec * 100);
+
+  std::vector<const ClientStat *> stats;
+  for (auto &sub : rtmp_subs) { stats.push_back(&sub->stat()); }
+  report_subs("rtmp", stats, pub_frame_num * rtmp_sub_num, elapsed_sec);
+  stats.clear();
+  for (auto &sub : http_flv_subs) { stats.push_back(&sub->stat()); }
+  report_subs("http-flv", stats, pub_frame_num * http_flv_sub_num, elapsed_sec);
+
+  if (pid) {
+    double cpu_sec = static_cast<double>(end_sample.cpu_ticks - begin_sample.cpu_ticks) / sysconf(_SC_CLK_TCK);
+    printf("yet cpu:%.1f%% rss:%lluKB peak rss:%lluKB\n", cpu_sec / elapsed_sec * 100,
+           static_cast<unsigned long long>(end_sample.rss_kb), static_cast<unsigned long long>(end_sample.hwm_kb));
+  }
+  return 0;
+}
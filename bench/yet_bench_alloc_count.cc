@@ -0,0 +1,98 @@
+/**
+ * @file   yet_bench_alloc_count.cc
+ * @author pengrl
+ *
+ * LD_PRELOAD shim which counts heap allocations of the process.
+ * operator new of the statically linked libstdc++ ends in malloc of libc, so it's counted too.
+ * the count is written to the file named by env YET_ALLOC_COUNT_FILE every 100ms.
+ *
+ * usage: YET_ALLOC_COUNT_FILE=/tmp/yet.alloc LD_PRELOAD=./libyet_bench_alloc_count.so ./yet ...
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+
+// dlsym allocates itself, so forward to the glibc entries instead of looking up the next symbol
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+
+std::atomic<unsigned long long> alloc_num(0);
+
+void count() { alloc_num.fetch_add(1, std::memory_order_relaxed); }
+
+void *flush_loop(void *arg) {
+  const char *filename = static_cast<const char *>(arg);
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) { return nullptr; }
+
+  char buf[32];
+  for (;;) {
+    int len = snprintf(buf, sizeof buf, "%20llu\n", alloc_num.load(std::memory_order_relaxed));
+    if (pwrite(fd, buf, len, 0) != len) { break; }
+    usleep(100 * 1000);
+  }
+  close(fd);
+  return nullptr;
+}
+
+__attribute__((constructor)) void init() {
+  const char *filename = getenv("YET_ALLOC_COUNT_FILE");
+  if (!filename) { return; }
+
+  pthread_t thd;
+  if (pthread_create(&thd, nullptr, flush_loop, const_cast<char *>(filename)) == 0) {
+    pthread_detach(thd);
+  }
+}
+
+}
+
+extern "C" {
+
+void *malloc(size_t size) {
+  count();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+  count();
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *p, size_t size) {
+  count();
+  return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  count();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+  count();
+  *p = __libc_memalign(alignment, size);
+  return *p ? 0 : ENOMEM;
+}
+
+}
@@ -0,0 +1,143 @@
+/**
+ * @file   yet_bench_conn_storm.cc
+ * @author pengrl
+ *
+ * connection storm against a running yet rtmp port.
+ * every connection sends C0+C1 and waits for the first byte of S0, then closes.
+ * reports accepts per second and time to first byte.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <asio.hpp>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr std::size_t C0C1_LEN = 1537;
+
+struct Stat {
+  std::mutex            m;
+  std::vector<int64_t>  ttfb_us;
+  std::atomic<int>      failed{0};
+};
+
+class Conn : public std::enable_shared_from_this<Conn> {
+  public:
+    Conn(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, std::atomic<int> &left, Stat &stat)
+      : socket_(io_ctx), ep_(ep), left_(left), stat_(stat)
+    {
+      memset(c0c1_, 0, C0C1_LEN);
+      c0c1_[0] = 0x03;
+    }
+
+    void start() {
+      if (left_.fetch_sub(1) <= 0) { return; }
+
+      begin_ = Clock::now();
+      socket_.async_connect(ep_, std::bind(&Conn::connect_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+  private:
+    void connect_cb(const asio::error_code &ec) {
+      if (ec) { return fail(); }
+
+      asio::async_write(socket_, asio::buffer(c0c1_, C0C1_LEN),
+                        std::bind(&Conn::write_c0c1_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void write_c0c1_cb(const asio::error_code &ec) {
+      if (ec) { return fail(); }
+
+      asio::async_read(socket_, asio::buffer(s0_, 1), std::bind(&Conn::read_s0_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void read_s0_cb(const asio::error_code &ec) {
+      if (ec) { return fail(); }
+
+      int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin_).count();
+      {
+        std::lock_guard<std::mutex> guard(stat_.m);
+        stat_.ttfb_us.push_back(us);
+      }
+      next();
+    }
+
+    void fail() {
+      stat_.failed++;
+      next();
+    }
+
+    void next() {
+      asio::error_code ignored;
+      socket_.close(ignored);
+      auto conn = std::make_shared<Conn>(socket_.get_executor().context(), ep_, left_, stat_);
+      conn->start();
+    }
+
+  private:
+    asio::ip::tcp::socket   socket_;
+    asio::ip::tcp::endpoint ep_;
+    std::atomic<int>        &left_;
+    Stat                    &stat_;
+    Clock::time_point       begin_;
+    uint8_t                 c0c1_[C0C1_LEN];
+    uint8_t                 s0_[1];
+};
+
+int64_t percentile(const std::vector<int64_t> &sorted, double p) {
+  if (sorted.empty()) { return 0; }
+  std::size_t idx = std::min(sorted.size()-1, static_cast<std::size_t>(sorted.size() * p));
+  return sorted[idx];
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s <rtmp ip> <rtmp port> <total conn num> [concurrency=256] [client thread num=4]\n", argv[0]);
+    return -1;
+  }
+  asio::ip::tcp::endpoint ep(asio::ip::address_v4::from_string(argv[1]), static_cast<uint16_t>(atoi(argv[2])));
+  int total = atoi(argv[3]);
+  int concurrency = (argc > 4) ? atoi(argv[4]) : 256;
+  int thread_num = (argc > 5) ? atoi(argv[5]) : 4;
+
+  Stat stat;
+  std::atomic<int> left(total);
+  std::vector<std::unique_ptr<asio::io_context>> io_ctxs;
+  for (int i = 0; i < thread_num; i++) {
+    io_ctxs.emplace_back(new asio::io_context(1));
+  }
+  for (int i = 0; i < concurrency; i++) {
+    std::make_shared<Conn>(*io_ctxs[i % thread_num], ep, left, stat)->start();
+  }
+
+  auto begin = Clock::now();
+  std::vector<std::thread> threads;
+  for (auto &io_ctx : io_ctxs) {
+    asio::io_context *p = io_ctx.get();
+    threads.emplace_back([p] { p->run(); });
+  }
+  for (auto &thd : threads) { thd.join(); }
+  double elapsed_sec = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count() / 1000000.0;
+
+  std::sort(stat.ttfb_us.begin(), stat.ttfb_us.end());
+  std::size_t succ = stat.ttfb_us.size();
+  printf("conns:%d succ:%zu failed:%d elapsed:%.3fs accepts/s:%.0f ttfb(us) p50:%lld p90:%lld p99:%lld max:%lld\n",
+         total, succ, stat.failed.load(), elapsed_sec, succ / elapsed_sec,
+         (long long)percentile(stat.ttfb_us, 0.5), (long long)percentile(stat.ttfb_us, 0.9),
+         (long long)percentile(stat.ttfb_us, 0.99), (long long)(succ ? stat.ttfb_us.back() : 0));
+  return 0;
+}
@@ -0,0 +1,360 @@
+/**
+ * @file   yet_bench_fanout.cc
+ * @author pengrl
+ *
+ * fan-out load against a running yet.
+ * one synthetic rtmp publisher sends audio and video in real time, N rtmp players read and drop the stream.
+ * samples /proc/<yet pid>/stat over the measure window and reports cpu per subscriber of the yet process.
+ * if yet runs with the yet_bench_syscall_count shim, reads the same env YET_SYSCALL_COUNT_FILE
+ * and reports send syscalls per second too.
+ * likewise with the yet_bench_alloc_count shim and env YET_ALLOC_COUNT_FILE, reports heap allocations
+ * per forwarded frame, i.e. per frame published times subscriber num.
+ * with sub num 0 and big video frames it measures ingest alone, as cpu per published Mbps.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <asio.hpp>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint8_t> Bytes;
+
+static constexpr std::size_t C0C1_LEN      = 1537;
+static constexpr std::size_t S0S1S2_LEN    = 3073;
+static constexpr int         TICK_MS       = 20;  // one audio frame per tick, one video frame per two ticks
+static constexpr int         GOP_FRAME_NUM = 50;
+static constexpr std::size_t AUDIO_LEN     = 200;
+
+void put_be(Bytes &out, uint64_t v, int n) {
+  for (int i = n - 1; i >= 0; i--) { out.push_back(static_cast<uint8_t>(v >> (i * 8))); }
+}
+
+void amf_str(Bytes &out, const std::string &s) {
+  out.push_back(0x02);
+  put_be(out, s.size(), 2);
+  out.insert(out.end(), s.begin(), s.end());
+}
+
+void amf_num(Bytes &out, double d) {
+  uint64_t v;
+  memcpy(&v, &d, 8);
+  out.push_back(0x00);
+  put_be(out, v, 8);
+}
+
+void amf_null(Bytes &out) { out.push_back(0x05); }
+
+void amf_obj(Bytes &out, const std::vector<std::pair<std::string, std::string>> &kvs) {
+  out.push_back(0x03);
+  for (auto &kv : kvs) {
+    put_be(out, kv.first.size(), 2);
+    out.insert(out.end(), kv.first.begin(), kv.first.end());
+    amf_str(out, kv.second);
+  }
+  put_be(out, 9, 3);
+}
+
+/// fmt0 for first chunk and fmt3 for the rest
+void append_chunks(Bytes &out, int csid, uint32_t ts, uint8_t type_id, uint32_t msid, const Bytes &payload, uint32_t chunk_size) {
+  for (std::size_t i = 0; i < payload.size() || i == 0; i += chunk_size) {
+    if (i == 0) {
+      out.push_back(static_cast<uint8_t>(csid));
+      put_be(out, ts, 3);
+      put_be(out, payload.size(), 3);
+      out.push_back(type_id);
+      for (int j = 0; j < 4; j++) { out.push_back(static_cast<uint8_t>(msid >> (j * 8))); }
+    } else {
+      out.push_back(static_cast<uint8_t>(0xc0 | csid));
+    }
+    std::size_t n = std::min<std::size_t>(chunk_size, payload.size() - i);
+    out.insert(out.end(), payload.begin() + i, payload.begin() + i + n);
+    if (payload.empty()) { break; }
+  }
+}
+
+class RtmpClient : public std::enable_shared_from_this<RtmpClient> {
+  public:
+    RtmpClient(asio::io_context &io_ctx, const asio::ip::tcp::endpoint &ep, const std::string &live_name,
+               bool is_publisher, std::size_t video_len, uint32_t chunk_size)
+      : socket_(io_ctx), timer_(io_ctx), ep_(ep), live_name_(live_name), is_publisher_(is_publisher)
+      , video_len_(video_len), chunk_size_(chunk_size), read_buf_(S0S1S2_LEN)
+    {}
+
+    void start() {
+      socket_.async_connect(ep_, std::bind(&RtmpClient::connect_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void stop() {
+      asio::error_code ignored;
+      timer_.cancel(ignored);
+      socket_.close(ignored);
+    }
+
+    uint64_t read_bytes() const { return read_bytes_; }
+    uint64_t frame_num() const { return frame_num_; }
+    uint64_t write_bytes() const { return write_bytes_; }
+
+  private:
+    void connect_cb(const asio::error_code &ec) {
+      if (ec) { return fail("connect", ec); }
+
+      socket_.set_option(asio::ip::tcp::no_delay(true));
+      write_buf_.assign(C0C1_LEN, 0);
+      write_buf_[0] = 0x03;
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_c0c1_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void write_c0c1_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write c0c1", ec); }
+
+      asio::async_read(socket_, asio::buffer(read_buf_), std::bind(&RtmpClient::read_s0s1s2_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void read_s0s1s2_cb(const asio::error_code &ec) {
+      if (ec) { return fail("read s0s1s2", ec); }
+
+      // C2 echoes S1, then pipeline all commands
+      write_buf_.assign(read_buf_.begin() + 1, read_buf_.begin() + 1 + 1536);
+
+      Bytes payload;
+      put_be(payload, chunk_size_, 4);
+      append_chunks(write_buf_, 2, 0, 1, 0, payload, 128);
+
+      payload.clear();
+      amf_str(payload, "connect");
+      amf_num(payload, 1);
+      amf_obj(payload, {{"app", "live"}, {"tcUrl", "rtmp://127.0.0.1/live"}});
+      append_chunks(write_buf_, 3, 0, 20, 0, payload, chunk_size_);
+
+      payload.clear();
+      amf_str(payload, "createStream");
+      amf_num(payload, 2);
+      amf_null(payload);
+      append_chunks(write_buf_, 3, 0, 20, 0, payload, chunk_size_);
+
+      payload.clear();
+      amf_str(payload, is_publisher_ ? "publish" : "play");
+      amf_num(payload, 3);
+      amf_null(payload);
+      amf_str(payload, live_name_);
+      if (is_publisher_) { amf_str(payload, "live"); }
+      append_chunks(write_buf_, 5, 0, 20, 1, payload, chunk_size_);
+
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_cmds_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void write_cmds_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write cmds", ec); }
+
+      read_buf_.resize(65536);
+      do_read();
+
+      if (is_publisher_) {
+        begin_ = Clock::now();
+        write_seq_headers();
+      }
+    }
+
+    void do_read() {
+      socket_.async_read_some(asio::buffer(read_buf_),
+                              std::bind(&RtmpClient::read_cb, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void read_cb(const asio::error_code &ec, std::size_t len) {
+      if (ec) { return fail("read", ec); }
+
+      read_bytes_ += len;
+      do_read();
+    }
+
+    void write_seq_headers() {
+      write_buf_.clear();
+      Bytes payload = {0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1f, 0xff};
+      append_chunks(write_buf_, 7, 0, 9, 1, payload, chunk_size_);
+      payload = {0xaf, 0x00, 0x12, 0x10};
+      append_chunks(write_buf_, 6, 0, 8, 1, payload, chunk_size_);
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_av_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void write_av_cb(const asio::error_code &ec) {
+      if (ec) { return fail("write av", ec); }
+
+      tick_++;
+      timer_.expires_at(begin_ + std::chrono::milliseconds(tick_ * TICK_MS));
+      timer_.async_wait(std::bind(&RtmpClient::tick_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void tick_cb(const asio::error_code &ec) {
+      if (ec) { return; }
+
+      uint32_t ts = static_cast<uint32_t>(tick_ * TICK_MS);
+      write_buf_.clear();
+      Bytes payload(AUDIO_LEN, 0);
+      payload[0] = 0xaf;
+      payload[1] = 0x01;
+      append_chunks(write_buf_, 6, ts, 8, 1, payload, chunk_size_);
+      frame_num_++;
+      if (tick_ % 2 == 0) {
+        bool is_key = (tick_ / 2) % GOP_FRAME_NUM == 1;
+        payload.assign(video_len_, 0);
+        payload[0] = is_key ? 0x17 : 0x27;
+        payload[1] = 0x01;
+        append_chunks(write_buf_, 7, ts, 9, 1, payload, chunk_size_);
+        frame_num_++;
+      }
+      write_bytes_ += write_buf_.size();
+      asio::async_write(socket_, asio::buffer(write_buf_), std::bind(&RtmpClient::write_av_cb, shared_from_this(), std::placeholders::_1));
+    }
+
+    void fail(const char *stage, const asio::error_code &ec) {
+      if (ec == asio::error::operation_aborted || !socket_.is_open()) { return; }
+
+      fprintf(stderr, "%s %s failed. ec:%s\n", is_publisher_ ? "pub" : "sub", stage, ec.message().c_str());
+      stop();
+    }
+
+  private:
+    asio::ip::tcp::socket   socket_;
+    asio::steady_timer      timer_;
+    asio::ip::tcp::endpoint ep_;
+    std::string             live_name_;
+    bool                    is_publisher_;
+    std::size_t             video_len_;
+    uint32_t                chunk_size_;
+    Bytes                   read_buf_;
+    Bytes                   write_buf_;
+    uint64_t                read_bytes_ = 0;
+    uint64_t                frame_num_ = 0;
+    uint64_t                write_bytes_ = 0;
+    Clock::time_point       begin_;
+    int64_t                 tick_ = 0;
+};
+
+struct ProcSample {
+  uint64_t send_num = 0;
+  uint64_t alloc_num = 0;
+  uint64_t cpu_ticks = 0;
+};
+
+bool sample_proc(int pid, ProcSample &sample) {
+  if (const char *filename = getenv("YET_SYSCALL_COUNT_FILE")) {
+    std::ifstream count(filename);
+    count >> sample.send_num;
+  }
+  if (const char *filename = getenv("YET_ALLOC_COUNT_FILE")) {
+    std::ifstream count(filename);
+    count >> sample.alloc_num;
+  }
+
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  std::getline(stat, line);
+  std::size_t pos = line.rfind(')');
+  if (pos == std::string::npos) { return false; }
+
+  // fields after comm start from 3rd, utime and stime are 14th and 15th
+  std::istringstream iss(line.substr(pos + 2));
+  std::string field;
+  uint64_t utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && iss >> field; i++) {
+    if (i == 14) { utime = strtoull(field.c_str(), nullptr, 10); }
+    if (i == 15) { stime = strtoull(field.c_str(), nullptr, 10); }
+  }
+  sample.cpu_ticks = utime + stime;
+  return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s <rtmp ip> <rtmp port> <yet pid> [sub num=100] [measure sec=10] [video frame bytes=8000] [pub chunk size=4096]\n", argv[0]);
+    return -1;
+  }
+  asio::ip::tcp::endpoint ep(asio::ip::address_v4::from_string(argv[1]), static_cast<uint16_t>(atoi(argv[2])));
+  int pid = atoi(argv[3]);
+  int sub_num = (argc > 4) ? atoi(argv[4]) : 100;
+  int measure_sec = (argc > 5) ? atoi(argv[5]) : 10;
+  std::size_t video_len = (argc > 6) ? static_cast<std::size_t>(atoi(argv[6])) : 8000;
+  uint32_t chunk_size = (argc > 7) ? static_cast<uint32_t>(atoi(argv[7])) : 4096;
+  static constexpr int WARMUP_SEC = 2;
+
+  ProcSample begin_sample;
+  if (!sample_proc(pid, begin_sample)) {
+    fprintf(stderr, "Read /proc/%d failed.\n", pid);
+    return -1;
+  }
+
+  asio::io_context io_ctx(1);
+  std::vector<std::shared_ptr<RtmpClient>> clients;
+  auto pub = std::make_shared<RtmpClient>(io_ctx, ep, "fanout", true, video_len, chunk_size);
+  clients.push_back(pub);
+  pub->start();
+  for (int i = 0; i < sub_num; i++) {
+    auto sub = std::make_shared<RtmpClient>(io_ctx, ep, "fanout", false, video_len, chunk_size);
+    clients.push_back(sub);
+    sub->start();
+  }
+
+  uint64_t begin_read_bytes = 0;
+  uint64_t begin_frame_num = 0;
+  uint64_t begin_write_bytes = 0;
+  Clock::time_point begin_time;
+  ProcSample end_sample;
+  uint64_t end_read_bytes = 0;
+  uint64_t end_frame_num = 0;
+  uint64_t end_write_bytes = 0;
+  Clock::time_point end_time;
+
+  asio::steady_timer timer(io_ctx);
+  timer.expires_after(std::chrono::seconds(WARMUP_SEC));
+  timer.async_wait([&](const asio::error_code &) {
+    sample_proc(pid, begin_sample);
+    begin_time = Clock::now();
+    for (auto &c : clients) { begin_read_bytes += c->read_bytes(); }
+    begin_frame_num = pub->frame_num();
+    begin_write_bytes = pub->write_bytes();
+
+    timer.expires_after(std::chrono::seconds(measure_sec));
+    timer.async_wait([&](const asio::error_code &) {
+      sample_proc(pid, end_sample);
+      end_time = Clock::now();
+      for (auto &c : clients) { end_read_bytes += c->read_bytes(); }
+      end_frame_num = pub->frame_num();
+      end_write_bytes = pub->write_bytes();
+      for (auto &c : clients) { c->stop(); }
+    });
+  });
+  io_ctx.run();
+
+  double elapsed_sec = std::chrono::duration_cast<std::chrono::microseconds>(end_time - begin_time).count() / 1000000.0;
+  double send_per_sec = (end_sample.send_num - begin_sample.send_num) / elapsed_sec;
+  double cpu_sec = static_cast<double>(end_sample.cpu_ticks - begin_sample.cpu_ticks) / sysconf(_SC_CLK_TCK);
+  double recv_mbps = (end_read_bytes - begin_read_bytes) * 8 / elapsed_sec / 1000000;
+  double pub_mbps = (end_write_bytes - begin_write_bytes) * 8 / elapsed_sec / 1000000;
+  printf("subs:%d elapsed:%.3fs recv:%.1fMbps send syscalls/s:%.0f per sub:%.1f cpu:%.1f%% per sub:%.3f%%\n",
+         sub_num, elapsed_sec, recv_mbps, send_per_sec, send_per_sec / sub_num,
+         cpu_sec / elapsed_sec * 100, cpu_sec / elapsed_sec * 100 / sub_num);
+  printf("pub:%.1fMbps chunk size:%u cpu per pub Mbps:%.3f%%\n",
+         pub_mbps, chunk_size, pub_mbps > 0 ? cpu_sec / elapsed_sec * 100 / pub_mbps : 0.0);
+  if (getenv("YET_ALLOC_COUNT_FILE")) {
+    uint64_t forwarded = (end_frame_num - begin_frame_num) * sub_num;
+    uint64_t allocs = end_sample.alloc_num - begin_sample.alloc_num;
+    printf("forwarded frames:%llu allocs:%llu per forwarded frame:%.3f\n",
+           static_cast<unsigned long long>(forwarded), static_cast<unsigned long long>(allocs),
+           forwarded ? static_cast<double>(allocs) / forwarded : 0.0);
+  }
+  return 0;
+}
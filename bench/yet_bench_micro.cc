@@ -0,0 +1,449 @@
+/**
+ * @file   yet_bench_micro.cc
+ * @author pengrl
+ *
+ * microbenchmarks of the per-byte and per-connection hot paths, on the fixed corpora of bench/corpus:
+ * chunking of RtmpChunkOp, connect object decoding of AmfReader, RtmpHandshake, Sha256, chef::buffer,
+ * and flv tag scanning of the http flv pull.
+ * each case runs in a loop until it takes at least the min time, and reports ns/op, op/s, payload bytes/op,
+ * MB/s of payload, and heap allocations and allocated bytes per op, counted by operator new of this binary.
+ * runs in one thread, so op/s of handshake cases is handshakes per second per core.
+ * sha256 and handshake cases run once per sha256 engine the cpu supports, each engine is checked against the
+ * known answers of FIPS 180-2 and RFC 4231, and against the handshake digests of the corpora, before it is timed.
+ *
+ * usage: yet_bench_micro [corpus dir=./bench/corpus] [case name filter] [min ms per case=300]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+#include "yet_common/yet_common.hpp"
+#include "yet_common/yet_log.h"
+#include "yet_common/yet_sha256.h"
+#include "yet_rtmp/yet_hmac_sha256_adapter.hpp"
+#include "yet_http_flv/yet_http_flv_tag_scanner.h"
+#include "yet_rtmp/yet_rtmp.hpp"
+#include "yet_rtmp/yet_rtmp_amf_op.h"
+#include "yet_rtmp/yet_rtmp_chunk_op.h"
+#include "yet_rtmp/yet_rtmp_handshake.h"
+
+namespace {
+
+using namespace yet;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint8_t> Bytes;
+
+// single threaded, plain counters are enough
+uint64_t alloc_num = 0;
+uint64_t alloc_bytes = 0;
+
+template <typename T>
+void do_not_optimize(const T &v) {
+  asm volatile("" : : "r"(&v) : "memory");
+}
+
+struct Case {
+  Case(const std::string &n, std::size_t b, const std::function<void()> &f,
+       const std::function<void()> &s=nullptr)
+    : name(n), bytes(b), fn(f), setup(s) {}
+
+  std::string           name;
+  std::size_t           bytes; // payload processed per op
+  std::function<void()> fn;
+  std::function<void()> setup; // before the timed loop, optional
+};
+
+void run(const Case &c, int min_ms) {
+  if (c.setup) { c.setup(); }
+  c.fn(); // warm up pools and caches
+
+  uint64_t iters = 1;
+  for (;;) {
+    uint64_t alloc_num_begin = alloc_num;
+    uint64_t alloc_bytes_begin = alloc_bytes;
+    Clock::time_point begin = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) { c.fn(); }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+
+    if (ns >= min_ms * 1e6 || iters >= (1ULL << 40)) {
+      double ns_per_op = ns / iters;
+      printf("%-44s %12llu %12.1f ns/op %12.0f op/s %10zu B/op %10.1f MB/s %8.2f allocs/op %10.1f alloc B/op\n",
+             c.name.c_str(), (unsigned long long)iters, ns_per_op, 1e9 / ns_per_op, c.bytes,
+             c.bytes ? c.bytes * 1e3 / ns_per_op : 0.0,
+             double(alloc_num - alloc_num_begin) / iters, double(alloc_bytes - alloc_bytes_begin) / iters);
+      return;
+    }
+
+    // aim at the min time directly, at most 10x per round
+    uint64_t next = ns > 0 ? uint64_t(iters * min_ms * 1.2e6 / ns) : iters * 10;
+    iters = std::max(iters + 1, std::min(next, iters * 10));
+  }
+}
+
+Bytes load(const std::string &dir, const std::string &name) {
+  std::string filename = dir + "/" + name;
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    fprintf(stderr, "Open corpus failed. %s\n", filename.c_str());
+    exit(1);
+  }
+  return Bytes(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+void check(bool ok, const std::string &what) {
+  if (!ok) {
+    fprintf(stderr, "Corpus check failed. %s\n", what.c_str());
+    exit(1);
+  }
+}
+
+void add_chunk_cases(std::vector<Case> &cases) {
+  static const std::size_t MSG_LENS[] = { 200, 4096, 65536, 1048576 };
+  static const std::size_t CHUNK_SIZES[] = { 128, 4096, 60000 };
+
+  for (std::size_t msg_len : MSG_LENS) {
+    for (std::size_t chunk_size : CHUNK_SIZES) {
+      auto msg = std::make_shared<Bytes>(msg_len, 0x41);
+      RtmpHeader h;
+      h.csid = RTMP_CSID_VIDEO;
+      h.timestamp = 40;
+      h.msg_len = msg_len;
+      h.msg_type_id = RTMP_MSG_TYPE_ID_VIDEO;
+      h.msg_stream_id = RTMP_MSID;
+
+      cases.push_back(Case{"chunk/msg2chunks/" + std::to_string(msg_len) + "/" + std::to_string(chunk_size), msg_len,
+                           [msg, h, chunk_size] {
+                             BufferPtr chunks = RtmpChunkOp::msg2chunks(msg->data(), h, nullptr, chunk_size);
+                             do_not_optimize(chunks);
+                           }});
+    }
+  }
+}
+
+void add_amf_cases(std::vector<Case> &cases, const std::string &dir) {
+  static const char *NAMES[] = { "obs", "ffmpeg", "flash" };
+
+  for (const char *name : NAMES) {
+    auto payload = std::make_shared<Bytes>(load(dir, std::string("connect_") + name + ".bin"));
+
+    // skip the command name and transaction id, as the session does before decoding the object
+    char *command;
+    int command_len;
+    double transaction_id;
+    std::size_t used_len;
+    std::size_t offset = 0;
+    check(AmfOp::decode_string_with_type(payload->data(), payload->size(), &command, &command_len, &used_len) != nullptr,
+          name);
+    offset += used_len;
+    check(AmfOp::decode_number_with_type(payload->data() + offset, payload->size() - offset, &transaction_id, &used_len) != nullptr,
+          name);
+    offset += used_len;
+
+    AmfReader reader;
+    int obj = reader.decode(payload->data() + offset, payload->size() - offset, nullptr);
+    check(obj != -1 && reader.get(obj, "tcUrl") != nullptr, name);
+
+    // decode and look up what connect handling reads
+    std::size_t len = payload->size() - offset;
+    cases.push_back(Case{std::string("amf/decode_connect/") + name, len,
+                         [payload, offset, len] {
+                           AmfReader r;
+                           int o = r.decode(payload->data() + offset, len, nullptr);
+                           const AmfValue *app = r.get(o, "app");
+                           const AmfValue *tc_url = r.get(o, "tcUrl");
+                           do_not_optimize(app);
+                           do_not_optimize(tc_url);
+                         }});
+  }
+}
+
+std::vector<Sha256::Engine> supported_sha256_engines() {
+  std::vector<Sha256::Engine> engines;
+  for (int e = 0; e < Sha256::ENGINE_NUM; e++) {
+    if (Sha256::engine_supported(static_cast<Sha256::Engine>(e))) { engines.push_back(static_cast<Sha256::Engine>(e)); }
+  }
+  return engines;
+}
+
+std::string to_hex(const uint8_t *p, std::size_t len) {
+  static const char HEX[] = "0123456789abcdef";
+  std::string hex;
+  for (std::size_t i = 0; i < len; i++) {
+    hex += HEX[p[i] >> 4];
+    hex += HEX[p[i] & 0x0F];
+  }
+  return hex;
+}
+
+/// fed in pieces of <piece_len>, so block boundaries fall inside updates as well
+std::string sha256_hex(const std::string &data, std::size_t piece_len) {
+  Sha256 h;
+  for (std::size_t pos = 0; pos < data.length(); pos += piece_len) {
+    h.update((const uint8_t *)data.data() + pos, std::min(piece_len, data.length() - pos));
+  }
+  uint8_t digest[Sha256::DIGEST_LEN];
+  h.final(digest);
+  return to_hex(digest, Sha256::DIGEST_LEN);
+}
+
+std::string hmac_sha256_hex(const std::string &key, const std::string &data) {
+  HMACSHA256 h;
+  h.init((const uint8_t *)key.data(), key.length());
+  h.update((const uint8_t *)data.data(), data.length());
+  uint8_t digest[Sha256::DIGEST_LEN];
+  h.final(digest);
+  return to_hex(digest, Sha256::DIGEST_LEN);
+}
+
+/// FIPS 180-2 appendix B and RFC 4231 test case 1 and 2, with the current engine
+void check_sha256_known_answers(const std::string &what) {
+  static const std::string TWO_BLOCK = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  check(sha256_hex("abc", 3) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", what + "/abc");
+  check(sha256_hex(TWO_BLOCK, TWO_BLOCK.length()) ==
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", what + "/two block");
+  check(sha256_hex(std::string(1000000, 'a'), 1000) ==
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", what + "/million a");
+  check(hmac_sha256_hex(std::string(20, '\x0b'), "Hi There") ==
+        "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", what + "/hmac 1");
+  check(hmac_sha256_hex("Jefe", "what do ya want for nothing?") ==
+        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", what + "/hmac 2");
+}
+
+void add_sha256_cases(std::vector<Case> &cases) {
+  static const std::size_t LENS[] = { 64, 1536 };
+
+  for (Sha256::Engine e : supported_sha256_engines()) {
+    check(Sha256::set_engine(e), Sha256::engine_name(e));
+    check_sha256_known_answers(std::string("sha256/") + Sha256::engine_name(e));
+
+    for (std::size_t len : LENS) {
+      auto data = std::make_shared<Bytes>(len, 0x41);
+      cases.push_back(Case{std::string("sha256/") + Sha256::engine_name(e) + "/" + std::to_string(len), len,
+                           [data] {
+                             uint8_t digest[Sha256::DIGEST_LEN];
+                             Sha256 h;
+                             h.update(data->data(), data->size());
+                             h.final(digest);
+                             do_not_optimize(digest);
+                           },
+                           [e] { Sha256::set_engine(e); }});
+    }
+  }
+}
+
+// fixed keys of the handshake digests, see yet_rtmp_handshake.cc
+const uint8_t HANDSHAKE_KEY_TAIL[] = {
+  0xF0, 0xEE, 0xC2, 0x4A, 0x80, 0x68, 0xBE, 0xE8, 0x2E, 0x00, 0xD0, 0xD1,
+  0x02, 0x9E, 0x7E, 0x57, 0x6E, 0xEC, 0x5D, 0x2D, 0x29, 0x80, 0x6F, 0xAB,
+  0x93, 0xB8, 0xE6, 0x36, 0xCF, 0xEB, 0x31, 0xAE
+};
+const std::string HANDSHAKE_CLIENT_PART_KEY = "Genuine Adobe Flash Player 001";
+const std::string HANDSHAKE_SERVER_PART_KEY = "Genuine Adobe Flash Media Server 001";
+const std::size_t HANDSHAKE_DIGEST_LEN = 32;
+
+/// hmac of <buf> with the digest at <offs> left out
+void handshake_digest(const std::string &key, const uint8_t *buf, std::size_t len, std::size_t offs, uint8_t *digest) {
+  HMACSHA256 h;
+  h.init((const uint8_t *)key.data(), key.length());
+  h.update(buf, offs);
+  h.update(buf + offs + HANDSHAKE_DIGEST_LEN, len - offs - HANDSHAKE_DIGEST_LEN);
+  h.final(digest);
+}
+
+/// offset of the digest in c1 or s1 keyed with <key>, with the digest either before or after the key part
+/// @return -1 if none
+int find_handshake_digest(const std::string &key, const uint8_t *c1) {
+  static const std::size_t BASES[] = { 8, 764+8 };
+  for (std::size_t base : BASES) {
+    std::size_t offs = (c1[base] + c1[base+1] + c1[base+2] + c1[base+3]) % 728 + base + 4;
+    uint8_t digest[HANDSHAKE_DIGEST_LEN];
+    handshake_digest(key, c1, RTMP_C2_LEN, offs, digest);
+    if (memcmp(digest, c1 + offs, HANDSHAKE_DIGEST_LEN) == 0) { return static_cast<int>(offs); }
+  }
+  return -1;
+}
+
+/// s0s1 and s2 the server made for <c0c1>, recomputed here from the handshake scheme, with the current engine
+void check_handshake_answer(const Bytes &c0c1, const uint8_t *s0s1, const uint8_t *s2, const std::string &what) {
+  const uint8_t *c1 = c0c1.data() + 1;
+  const uint8_t *s1 = s0s1 + 1;
+  check(s0s1[0] == RTMP_VERSION, what + "/s0");
+
+  bool c1_old = c1[4] == 0 && c1[5] == 0 && c1[6] == 0 && c1[7] == 0;
+  int c1_offs = c1_old ? -1 : find_handshake_digest(HANDSHAKE_CLIENT_PART_KEY, c1);
+  if (c1_offs == -1) {
+    // old style, s2 echoes c1 after the two timestamps
+    check(memcmp(s2 + 8, c1 + 8, RTMP_S2_LEN - 8) == 0, what + "/s2 echo");
+    return;
+  }
+
+  check(find_handshake_digest(HANDSHAKE_SERVER_PART_KEY, s1) != -1, what + "/s1 digest");
+
+  // s2 is keyed with the digest of c1 hashed with the full server key
+  std::string server_full_key = HANDSHAKE_SERVER_PART_KEY;
+  server_full_key.append((const char *)HANDSHAKE_KEY_TAIL, sizeof(HANDSHAKE_KEY_TAIL));
+  uint8_t s2_key[HANDSHAKE_DIGEST_LEN];
+  HMACSHA256 h;
+  h.init((const uint8_t *)server_full_key.data(), server_full_key.length());
+  h.update(c1 + c1_offs, HANDSHAKE_DIGEST_LEN);
+  h.final(s2_key);
+
+  std::size_t s2_offs = RTMP_S2_LEN - HANDSHAKE_DIGEST_LEN;
+  uint8_t digest[HANDSHAKE_DIGEST_LEN];
+  handshake_digest(std::string((const char *)s2_key, HANDSHAKE_DIGEST_LEN), s2, RTMP_S2_LEN, s2_offs, digest);
+  check(memcmp(digest, s2 + s2_offs, HANDSHAKE_DIGEST_LEN) == 0, what + "/s2 digest");
+}
+
+void add_handshake_cases(std::vector<Case> &cases, const std::string &dir) {
+  static const char *NAMES[] = { "simple", "complex" };
+
+  for (Sha256::Engine e : supported_sha256_engines()) {
+    check(Sha256::set_engine(e), Sha256::engine_name(e));
+    for (const char *name : NAMES) {
+      auto c0c1 = std::make_shared<Bytes>(load(dir, std::string("c0c1_") + name + ".bin"));
+      check(c0c1->size() == RTMP_C0C1_LEN, name);
+      {
+        std::string what = std::string("handshake/") + name + "/" + Sha256::engine_name(e);
+        RtmpHandshake hs;
+        check(hs.handle_c0c1(c0c1->data(), c0c1->size()), what);
+        uint8_t *s0s1 = hs.create_s0s1();
+        uint8_t *s2 = hs.create_s2();
+        check_handshake_answer(*c0c1, s0s1, s2, what);
+      }
+
+      cases.push_back(Case{std::string("handshake/c0c1_s0s1_s2/") + name + "/" + Sha256::engine_name(e), c0c1->size(),
+                           [c0c1] {
+                             RtmpHandshake hs;
+                             hs.handle_c0c1(c0c1->data(), c0c1->size());
+                             uint8_t *s0s1 = hs.create_s0s1();
+                             uint8_t *s2 = hs.create_s2();
+                             do_not_optimize(s0s1);
+                             do_not_optimize(s2);
+                           },
+                           [e] { Sha256::set_engine(e); }});
+    }
+  }
+}
+
+void add_buffer_cases(std::vector<Case> &cases) {
+  static constexpr std::size_t APPEND_LEN = 1400;
+
+  auto data = std::make_shared<Bytes>(APPEND_LEN, 0x41);
+  auto buf = std::make_shared<Buffer>();
+  cases.push_back(Case{"buffer/append_erase/1400", APPEND_LEN,
+                       [data, buf] {
+                         buf->append(data->data(), data->size());
+                         buf->erase(data->size());
+                       }});
+
+  // grows a buffer to 1MB by 1400B appends, then drops it, as a fresh read buffer of a big frame does
+  cases.push_back(Case{"buffer/append_grow/1400x749", APPEND_LEN * 749,
+                       [data] {
+                         Buffer b(4096, 1048576);
+                         for (int i = 0; i < 749; i++) { b.append(data->data(), data->size()); }
+                         do_not_optimize(b);
+                       }});
+
+  std::string request = "GET /live/test110.flv HTTP/1.1\r\n"
+                        "Host: 127.0.0.1:8080\r\n"
+                        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+                        "Chrome/72.0.3626.109 Safari/537.36\r\n"
+                        "Accept: */*\r\n"
+                        "Accept-Encoding: identity;q=1, *;q=0\r\n"
+                        "Accept-Language: en-US,en;q=0.9\r\n"
+                        "Origin: http://127.0.0.1\r\n"
+                        "Range: bytes=0-\r\n"
+                        "Connection: keep-alive\r\n"
+                        "\r\n";
+  auto req_buf = std::make_shared<Buffer>();
+  req_buf->append((const uint8_t *)request.data(), request.length());
+  check(req_buf->find((const uint8_t *)"\r\n\r\n", 4) != nullptr, "request");
+  cases.push_back(Case{"buffer/find/crlfcrlf", request.length(),
+                       [req_buf] {
+                         uint8_t *p = req_buf->find((const uint8_t *)"\r\n\r\n", 4);
+                         do_not_optimize(p);
+                       }});
+  cases.push_back(Case{"buffer/find_crlf", request.find("\r\n"),
+                       [req_buf] {
+                         uint8_t *p = req_buf->find_crlf();
+                         do_not_optimize(p);
+                       }});
+}
+
+void add_flv_cases(std::vector<Case> &cases, const std::string &dir) {
+  static constexpr std::size_t READ_LENS[] = { 4096, 16384 };
+
+  auto body = std::make_shared<Bytes>(load(dir, "flv_body.bin"));
+  auto tis = std::make_shared<std::vector<FlvTagInfo>>();
+
+  for (std::size_t read_len : READ_LENS) {
+    // feeds as the pull does, unscanned tail goes to the head of next read
+    auto scan_all = [body, tis, read_len]() -> std::size_t {
+      FlvTagScanner scanner;
+      std::size_t tag_num = 0;
+      std::size_t pos = 0;
+      while (pos < body->size()) {
+        std::size_t len = std::min(read_len, body->size() - pos);
+        std::size_t rs = scanner.scan(body->data() + pos, len, *tis);
+        tag_num += tis->size();
+        if (rs == len) { break; }
+        pos += len - rs;
+      }
+      return tag_num;
+    };
+    check(scan_all() > 100, "flv_body");
+
+    cases.push_back(Case{"flv/tag_scan/" + std::to_string(read_len), body->size(),
+                         [scan_all] {
+                           std::size_t tag_num = scan_all();
+                           do_not_optimize(tag_num);
+                         }});
+  }
+}
+
+}
+
+void *operator new(std::size_t size) {
+  alloc_num++;
+  alloc_bytes += size;
+  void *p = malloc(size ? size : 1);
+  if (!p) { throw std::bad_alloc(); }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+int main(int argc, char **argv) {
+  std::string dir = argc > 1 ? argv[1] : "./bench/corpus";
+  std::string filter = argc > 2 ? argv[2] : "";
+  int min_ms = argc > 3 ? atoi(argv[3]) : 300;
+
+  // per-op debug logs would be measured as well
+  Log::set_level(spdlog::level::warn);
+
+  std::vector<Case> cases;
+  add_chunk_cases(cases);
+  add_amf_cases(cases, dir);
+  add_sha256_cases(cases);
+  add_handshake_cases(cases, dir);
+  add_buffer_cases(cases);
+  add_flv_cases(cases, dir);
+
+  for (auto &c : cases) {
+    if (c.name.find(filter) == std::string::npos) { continue; }
+    run(c, min_ms);
+  }
+  return 0;
+}
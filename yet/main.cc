@@ -2,6 +2,7 @@
 #include "yet.hpp"
 #include "yet_server.h"
 #include "yet_config.h"
+#include "yet_common/yet_sha256.h"
 
 std::shared_ptr<yet::Server> srv;
 
@@ -19,29 +20,49 @@ std::shared_ptr<yet::Server> srv;
 int main(int argc, char **argv) {
   yet::Config::instance();
 
-  if (argc != 5) {
-    YET_LOG_ERROR("Usage: {} <rtmp port> <http flv port> <http flv pull host> <run duration sec>", argv[0]);
+  if (argc < 5 || argc > 9) {
+    YET_LOG_ERROR("Usage: {} <rtmp port> <http flv port> <pull host, rtmp://host[:port] to pull over rtmp> <run duration sec> [io thread num] [reuse port 0|1] [async log file, - for stdout] [rtmp push rules, pattern=host[:port][/app],...]", argv[0]);
     return -1;
   }
   uint16_t rtmp_port;
   uint16_t http_flv_port;
   rtmp_port = atoi(argv[1]);
   http_flv_port = atoi(argv[2]);
-  yet::Config::instance()->set_http_flv_pull_host(argv[3]);
+  std::string pull_host = argv[3];
+  static const std::string RTMP_SCHEME = "rtmp://";
+  if (pull_host.compare(0, RTMP_SCHEME.size(), RTMP_SCHEME) == 0) {
+    yet::Config::instance()->set_rtmp_pull_host(pull_host.substr(RTMP_SCHEME.size()));
+  } else {
+    yet::Config::instance()->set_http_flv_pull_host(pull_host);
+  }
   int run_duration_sec = atoi(argv[4]);
+  int io_thread_num = (argc >= 6) ? atoi(argv[5]) : 1;
+  bool reuse_port = (argc >= 7) ? (atoi(argv[6]) != 0) : false;
+  if (argc >= 8) {
+    std::string log_file = argv[7];
+    yet::Log::init(true, log_file == "-" ? std::string() : log_file);
+  }
+  if (argc >= 9 && !yet::Config::instance()->set_rtmp_push_rules_by_spec(argv[8])) {
+    YET_LOG_ERROR("Invalid rtmp push rules. {}", argv[8]);
+    // flushes the async log, or the only hint of the bad argument is lost
+    yet::Config::dispose();
+    yet::Log::dispose();
+    return -1;
+  }
 
   YET_LOG_DEBUG("debug log.");
   YET_LOG_INFO("info log.");
   YET_LOG_WARN("warn log.");
   YET_LOG_ERROR("error log.");
   YET_LOG_ASSERT(false, "assert log.");
+  YET_LOG_INFO("Sha256 engine:{}", yet::Sha256::engine_name(yet::Sha256::engine()));
 
 //#if defined(__linux__) || defined(__MACH__)
 //  signal(SIGINT, sig_handler);
 //  signal(SIGUSR1, sig_handler);
 //#endif
 
-  srv = std::make_shared<yet::Server>("0.0.0.0", rtmp_port, "0.0.0.0", http_flv_port);
+  srv = std::make_shared<yet::Server>("0.0.0.0", rtmp_port, "0.0.0.0", http_flv_port, io_thread_num, reuse_port);
   std::thread thd([&] {
     sleep(run_duration_sec);
     srv->dispose();
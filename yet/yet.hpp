@@ -16,14 +16,19 @@
 namespace yet {
 
 static constexpr std::size_t BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ   = 16384;
-static constexpr std::size_t BUF_SHRINK_LEN_HTTP_FLV_PULL_EACH_READ = 2147483647;
 static constexpr std::size_t BUF_INIT_LEN_RTMP_EACH_READ            = 16384;
 static constexpr std::size_t BUF_SHRINK_LEN_RTMP_EACH_READ          = 2147483647;
+// @NOTICE read buffer of rtmp chunk demuxer, several reads fit in before bytes left are moved to the front
+static constexpr std::size_t BUF_INIT_LEN_RTMP_READ                 = 65536;
+static constexpr std::size_t BUF_SHRINK_LEN_RTMP_READ               = 2147483647;
 // @NOTICE len of rtmp-write only for non-av data
 static constexpr std::size_t BUF_INIT_LEN_RTMP_WRITE                = 4096;
 static constexpr std::size_t BUF_SHRINK_LEN_RTMP_WRITE              = 2147483647;
 static constexpr std::size_t BUF_INIT_LEN_RTMP_COMPLETE_MESSAGE     = 16384;
 static constexpr std::size_t BUF_SHRINK_LEN_RTMP_COMPLETE_MESSAGE   = 2147483647;
+// cap of one vectored write of rtmp and http flv subs
+static constexpr std::size_t SEND_BATCH_MAX_BUF_NUM                 = 64;
+static constexpr std::size_t SEND_BATCH_MAX_BYTES                   = 262144;
 
 }
 
@@ -36,15 +41,19 @@ class HttpFlvServer;
 class Group;
 class HttpFlvSub;
 class HttpFlvPull;
+class RtmpClient;
 class RtmpSession;
-struct RtmpStream;
+class AvPacket;
+class Fanout;
+struct GroupStat;
 typedef std::shared_ptr<Server> ServerPtr;
 typedef std::shared_ptr<RtmpServer> RtmpServerPtr;
 typedef std::shared_ptr<HttpFlvServer> HttpFlvServerPtr;
 typedef std::shared_ptr<Group> GroupPtr;
 typedef std::shared_ptr<HttpFlvSub> HttpFlvSubPtr;
 typedef std::shared_ptr<HttpFlvPull> HttpFlvPullPtr;
+typedef std::shared_ptr<RtmpClient> RtmpClientPtr;
 typedef std::shared_ptr<RtmpSession> RtmpSessionPtr;
-typedef std::shared_ptr<RtmpStream> RtmpStreamPtr;
+typedef std::shared_ptr<AvPacket> AvPacketPtr;
 
 }
@@ -0,0 +1,65 @@
+#include "yet_av_packet.h"
+#include <cstring>
+#include "yet_common/yet_av_op.hpp"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_rtmp/yet_rtmp_amf_op.h"
+#include "yet_rtmp/yet_rtmp_chunk_op.h"
+
+namespace yet {
+
+AvPacketPtr AvPacket::create(const RtmpHeader &header, const uint8_t *msg, const RtmpHeader *prev) {
+  return std::allocate_shared<AvPacket>(BufferPoolAllocator<AvPacket>(), header, msg, prev);
+}
+
+AvPacket::AvPacket(const RtmpHeader &header, const uint8_t *msg, const RtmpHeader *prev)
+  : header_(header)
+  , prev_(prev ? *prev : RtmpHeader())
+  , has_prev_(prev != nullptr)
+{
+  std::size_t len = header_.msg_len;
+  if (is_audio()) {
+    is_seq_header_ = AvOp::is_aac_seq_header(msg, len);
+  } else if (is_video()) {
+    is_seq_header_ = AvOp::is_avc_seq_header(msg, len);
+    is_key_frame_ = AvOp::is_video_key_frame(msg, len);
+    is_non_ref_frame_ = AvOp::is_video_non_ref_frame(msg, len);
+  }
+
+  flv_tag_ = BufferPool::acquire(FLV_TAG_HEADER_LEN + len + FLV_PREV_TAG_SIZE_LEN);
+  uint8_t *p = flv_tag_->write_pos();
+  *p++ = static_cast<uint8_t>(header_.msg_type_id);
+  p = AmfOp::encode_int24(p, len);
+  p = AmfOp::encode_int24(p, header_.timestamp & 0xFFFFFF);
+  *p++ = static_cast<uint8_t>(header_.timestamp >> 24);
+  p = AmfOp::encode_int24(p, 0);
+  memcpy(p, msg, len);
+  p += len;
+  AmfOp::encode_int32(p, FLV_TAG_HEADER_LEN + len);
+  flv_tag_->seek_write_pos(FLV_TAG_HEADER_LEN + len + FLV_PREV_TAG_SIZE_LEN);
+}
+
+FlvTagInfo AvPacket::flv_tag_info() const {
+  FlvTagInfo ti;
+  ti.tag_type = static_cast<FlvTagType>(header_.msg_type_id);
+  ti.tag_pos = flv_tag_->read_pos();
+  ti.tag_whole_size = flv_tag_->readable_size();
+  return ti;
+}
+
+BufferPtr AvPacket::rtmp_abs_chunks() {
+  if (!rtmp_abs_chunks_) {
+    rtmp_abs_chunks_ = RtmpChunkOp::msg2chunks(payload(), header_, nullptr, RTMP_LOCAL_CHUNK_SIZE);
+  }
+  return rtmp_abs_chunks_;
+}
+
+BufferPtr AvPacket::rtmp_delta_chunks() {
+  if (!has_prev_) { return rtmp_abs_chunks(); }
+
+  if (!rtmp_delta_chunks_) {
+    rtmp_delta_chunks_ = RtmpChunkOp::msg2chunks(payload(), header_, &prev_, RTMP_LOCAL_CHUNK_SIZE);
+  }
+  return rtmp_delta_chunks_;
+}
+
+}
@@ -0,0 +1,73 @@
+/**
+ * @file   yet_av_packet.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include "yet.hpp"
+#include "yet_rtmp/yet_rtmp.hpp"
+#include "yet_http_flv/yet_http_flv_buffer_t.hpp"
+
+namespace yet {
+
+/// one audio/video/metadata message of a stream, shared by all subs of the group.
+///
+/// payload is copied once at ingest, laid out as a whole flv tag with PreviousTagSize,
+/// wire forms of rtmp are serialized from it on first use and memoized,
+/// so each form is built at most once whatever the number and type of subs.
+/// all forms are immutable after built, a packet frozen by <freeze> may be read by any io thread.
+class AvPacket {
+  public:
+    /// @param header header of the msg, timestamp is absolute
+    /// @param msg    payload of <header.msg_len> bytes
+    /// @param prev   header of previous msg of the same csid which delta chunks refer to, nullptr if none
+    static AvPacketPtr create(const RtmpHeader &header, const uint8_t *msg, const RtmpHeader *prev);
+
+    AvPacket(const RtmpHeader &header, const uint8_t *msg, const RtmpHeader *prev);
+
+  public:
+    const RtmpHeader &header() const { return header_; }
+    const uint8_t *payload() const { return flv_tag_->read_pos() + FLV_TAG_HEADER_LEN; }
+    std::size_t payload_len() const { return header_.msg_len; }
+
+    bool is_audio() const { return header_.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO; }
+    bool is_video() const { return header_.msg_type_id == RTMP_MSG_TYPE_ID_VIDEO; }
+    bool is_metadata() const { return header_.msg_type_id == RTMP_MSG_TYPE_ID_DATA_MESSAGE_AMF0; }
+    bool is_seq_header() const { return is_seq_header_; }
+    bool is_key_frame() const { return is_key_frame_; }
+    bool is_non_ref_frame() const { return is_non_ref_frame_; }
+
+    /// rtmp chunks led by fmt 0, for a sub which has not got the previous msg of the same csid
+    BufferPtr rtmp_abs_chunks();
+
+    /// rtmp chunks led by fmt 1 or 2, relative to <prev> of ctor, same as abs chunks if there is no <prev>
+    BufferPtr rtmp_delta_chunks();
+
+    /// flv tag followed by its PreviousTagSize
+    BufferPtr flv_tag() const { return flv_tag_; }
+
+    /// info of the only tag in <flv_tag>
+    FlvTagInfo flv_tag_info() const;
+
+    /// builds all wire forms now, so the memos are never written again and the packet can be shared across io threads
+    void freeze() { rtmp_abs_chunks(); rtmp_delta_chunks(); }
+
+  private:
+    AvPacket(const AvPacket &) = delete;
+    AvPacket &operator=(const AvPacket &) = delete;
+
+  private:
+    RtmpHeader header_;
+    RtmpHeader prev_;
+    bool       has_prev_;
+    bool       is_seq_header_ = false;
+    bool       is_key_frame_ = false;
+    bool       is_non_ref_frame_ = false;
+    BufferPtr  flv_tag_;
+    BufferPtr  rtmp_abs_chunks_;
+    BufferPtr  rtmp_delta_chunks_;
+};
+
+}
@@ -0,0 +1,38 @@
+/**
+ * @file   yet_acceptor.hpp
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <asio.hpp>
+#include "yet_common/yet_log.h"
+
+namespace yet {
+
+#if defined(SO_REUSEPORT)
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePort;
+#endif
+
+/// open, bind and listen <acceptor>, throw asio::system_error if failed.
+/// with <reuse_port>, several acceptors can listen on the same port and the kernel spreads accepts among them.
+inline void open_acceptor(asio::ip::tcp::acceptor &acceptor, const std::string &listen_ip, uint16_t listen_port,
+                          bool reuse_port)
+{
+  asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::from_string(listen_ip), listen_port);
+  acceptor.open(endpoint.protocol());
+  acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  if (reuse_port) {
+#if defined(SO_REUSEPORT)
+    acceptor.set_option(ReusePort(true));
+#else
+    YET_LOG_WARN("SO_REUSEPORT not supported, ignore it.");
+#endif
+  }
+  acceptor.bind(endpoint);
+  acceptor.listen();
+}
+
+}
@@ -0,0 +1,56 @@
+/**
+ * @file   yet_av_op.hpp
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace yet {
+
+/// @NOTICE <p> point to payload of rtmp audio/video message, which is the same as data of flv audio/video tag
+class AvOp {
+  public:
+    static bool is_avc_seq_header(const uint8_t *p, std::size_t len) {
+      return len > 1 && p[0] == 0x17 && p[1] == 0x00;
+    }
+
+    static bool is_aac_seq_header(const uint8_t *p, std::size_t len) {
+      return len > 1 && (p[0] >> 4) == 0xa && p[1] == 0x00;
+    }
+
+    static bool is_video_key_frame(const uint8_t *p, std::size_t len) {
+      return len > 1 && (p[0] >> 4) == 0x1 && !is_avc_seq_header(p, len);
+    }
+
+    /// true if no other frame refers to this one, so it can be dropped without breaking decoding.
+    /// disposable inter frame by flv frame type, or avc inter frame whose first slice nalu has nal_ref_idc 0.
+    /// @NOTICE assume nalu length size of avcc is 4
+    static bool is_video_non_ref_frame(const uint8_t *p, std::size_t len) {
+      if (len < 2) { return false; }
+      if ((p[0] >> 4) == 0x3) { return true; }
+      if (p[0] != 0x27 || p[1] != 0x01) { return false; }
+
+      for (std::size_t pos = 5; pos + 5 <= len; ) {
+        std::size_t nalu_len = (std::size_t(p[pos]) << 24) | (p[pos+1] << 16) | (p[pos+2] << 8) | p[pos+3];
+        if (nalu_len == 0) { return false; }
+
+        uint8_t nalu_type = p[pos+4] & 0x1f;
+        if (nalu_type >= 1 && nalu_type <= 5) {
+          return (p[pos+4] & 0x60) == 0;
+        }
+        pos += 4 + nalu_len;
+      }
+      return false;
+    }
+
+  private:
+    AvOp() = delete;
+    AvOp(const AvOp &) = delete;
+    const AvOp &operator=(const AvOp &) = delete;
+};
+
+}
@@ -0,0 +1,130 @@
+#include "yet_buffer_pool.h"
+#include <vector>
+
+namespace yet {
+
+namespace {
+
+const std::size_t BUFFER_CLASS_SIZES[] = { 1024, 4096, 16384, 65536, 262144, 1048576 };
+const std::size_t BUFFER_CLASS_NUM = sizeof(BUFFER_CLASS_SIZES) / sizeof(BUFFER_CLASS_SIZES[0]);
+const std::size_t BUFFER_CLASS_MAX_FREE_BYTES = 8 * 1024 * 1024;
+
+const std::size_t BLOCK_CLASS_SIZES[] = { 64, 128, 256, 512, 1024 };
+const std::size_t BLOCK_CLASS_NUM = sizeof(BLOCK_CLASS_SIZES) / sizeof(BLOCK_CLASS_SIZES[0]);
+const std::size_t BLOCK_CLASS_MAX_FREE_NUM = 4096;
+
+/// @return index of the smallest class which fits <len>, -1 if too large
+int class_index(const std::size_t *sizes, std::size_t num, std::size_t len) {
+  for (std::size_t i = 0; i < num; i++) {
+    if (len <= sizes[i]) { return static_cast<int>(i); }
+  }
+  return -1;
+}
+
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+struct ThreadPool {
+  std::vector<Buffer *> buffers[BUFFER_CLASS_NUM];
+  FreeBlock            *blocks[BLOCK_CLASS_NUM] = {};
+  std::size_t           block_num[BLOCK_CLASS_NUM] = {};
+  BufferPoolStat        stat;
+
+  ~ThreadPool();
+};
+
+/// memory may still be released after the pool of the thread is destroyed, by objects destroyed later at
+/// thread exit. this flag has no destructor, so it's always safe to check, and those go to the heap then
+thread_local bool pool_destroyed = false;
+thread_local ThreadPool pool;
+
+ThreadPool::~ThreadPool() {
+  pool_destroyed = true;
+  for (auto &free_list : buffers) {
+    for (auto buf : free_list) { delete buf; }
+  }
+  for (auto head : blocks) {
+    while (head) {
+      FreeBlock *next = head->next;
+      ::operator delete(head);
+      head = next;
+    }
+  }
+}
+
+struct Recycler {
+  void operator()(Buffer *buf) const {
+    int index = pool_destroyed ? -1 : class_index(BUFFER_CLASS_SIZES, BUFFER_CLASS_NUM, buf->capacity());
+
+    // grown buffer is not pooled, otherwise the pool would keep the extra memory
+    if (index == -1 || buf->capacity() != BUFFER_CLASS_SIZES[index] ||
+        pool.buffers[index].size() * BUFFER_CLASS_SIZES[index] >= BUFFER_CLASS_MAX_FREE_BYTES
+    ) {
+      delete buf;
+      return;
+    }
+
+    buf->clear();
+    pool.buffers[index].push_back(buf);
+  }
+};
+
+}
+
+BufferPtr BufferPool::acquire(std::size_t len) {
+  int index = pool_destroyed ? -1 : class_index(BUFFER_CLASS_SIZES, BUFFER_CLASS_NUM, len);
+  if (index == -1) { return std::make_shared<Buffer>(len, len); }
+
+  Buffer *buf;
+  auto &free_list = pool.buffers[index];
+  if (!free_list.empty()) {
+    pool.stat.buffer_hit++;
+    buf = free_list.back();
+    free_list.pop_back();
+  } else {
+    pool.stat.buffer_miss++;
+    buf = new Buffer(BUFFER_CLASS_SIZES[index], BUFFER_CLASS_SIZES[index]);
+  }
+  return BufferPtr(buf, Recycler(), BufferPoolAllocator<Buffer>());
+}
+
+BufferPtr BufferPool::acquire(const uint8_t *data, std::size_t len) {
+  BufferPtr buf = acquire(len);
+  buf->append(data, len);
+  return buf;
+}
+
+void *BufferPool::alloc_block(std::size_t size) {
+  int index = pool_destroyed ? -1 : class_index(BLOCK_CLASS_SIZES, BLOCK_CLASS_NUM, size);
+  if (index == -1) { return ::operator new(size); }
+
+  FreeBlock *block = pool.blocks[index];
+  if (block) {
+    pool.stat.block_hit++;
+    pool.blocks[index] = block->next;
+    pool.block_num[index]--;
+    return block;
+  }
+  pool.stat.block_miss++;
+  return ::operator new(BLOCK_CLASS_SIZES[index]);
+}
+
+void BufferPool::free_block(void *p, std::size_t size) {
+  int index = pool_destroyed ? -1 : class_index(BLOCK_CLASS_SIZES, BLOCK_CLASS_NUM, size);
+  if (index == -1 || pool.block_num[index] >= BLOCK_CLASS_MAX_FREE_NUM) {
+    ::operator delete(p);
+    return;
+  }
+
+  FreeBlock *block = static_cast<FreeBlock *>(p);
+  block->next = pool.blocks[index];
+  pool.blocks[index] = block;
+  pool.block_num[index]++;
+}
+
+BufferPoolStat BufferPool::stat() {
+  return pool_destroyed ? BufferPoolStat() : pool.stat;
+}
+
+}
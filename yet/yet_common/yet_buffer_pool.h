@@ -0,0 +1,93 @@
+/**
+ * @file   yet_buffer_pool.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include "yet_common/yet_common.hpp"
+
+namespace yet {
+
+struct BufferPoolStat {
+  uint64_t buffer_hit  = 0;
+  uint64_t buffer_miss = 0;
+  uint64_t block_hit   = 0;
+  uint64_t block_miss  = 0;
+};
+
+/// pool of Buffers in size classes, and of small memory blocks for shared_ptr control blocks and asio handlers.
+///
+/// each thread owns its pool, no lock at all. a buffer goes back to the pool of the thread which drops
+/// its last reference (normally the io thread of the group), memory is moved between threads freely that way.
+/// free lists are capped, so a burst does not pin memory forever.
+class BufferPool {
+  public:
+    /// @return empty buffer with capacity at least <len>
+    static BufferPtr acquire(std::size_t len);
+
+    /// @return buffer with a copy of <data>
+    static BufferPtr acquire(const uint8_t *data, std::size_t len);
+
+    static void *alloc_block(std::size_t size);
+    static void free_block(void *p, std::size_t size);
+
+    /// stat of pool of current thread
+    static BufferPoolStat stat();
+
+  private:
+    BufferPool() = delete;
+    BufferPool(const BufferPool &) = delete;
+    const BufferPool &operator=(const BufferPool &) = delete;
+};
+
+/// allocator for control blocks of pooled BufferPtr
+template <typename T>
+class BufferPoolAllocator {
+  public:
+    typedef T value_type;
+
+    BufferPoolAllocator() {}
+    template <typename U> BufferPoolAllocator(const BufferPoolAllocator<U> &) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(BufferPool::alloc_block(n * sizeof(T))); }
+    void deallocate(T *p, std::size_t n) { BufferPool::free_block(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const BufferPoolAllocator<T> &, const BufferPoolAllocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const BufferPoolAllocator<T> &, const BufferPoolAllocator<U> &) { return false; }
+
+/// wrap an asio completion handler, so memory of the async operation comes from BufferPool
+template <typename Handler>
+class PooledHandler {
+  public:
+    explicit PooledHandler(Handler handler) : handler_(std::move(handler)) {}
+
+    template <typename ...Args>
+    void operator()(Args &&...args) { handler_(std::forward<Args>(args)...); }
+
+    friend void *asio_handler_allocate(std::size_t size, PooledHandler *) {
+      return BufferPool::alloc_block(size);
+    }
+
+    friend void asio_handler_deallocate(void *p, std::size_t size, PooledHandler *) {
+      BufferPool::free_block(p, size);
+    }
+
+  private:
+    Handler handler_;
+};
+
+template <typename Handler>
+inline PooledHandler<Handler> make_pooled_handler(Handler handler) {
+  return PooledHandler<Handler>(std::move(handler));
+}
+
+}
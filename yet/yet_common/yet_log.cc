@@ -1,20 +1,210 @@
 #include "yet_log.h"
+#include <stdio.h>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/details/pattern_formatter.h>
 
 namespace yet {
 
+namespace {
+
+static constexpr std::size_t LOG_RING_SLOT_NUM      = 4096; // power of 2
+static constexpr std::size_t LOG_RING_SLOT_TEXT_LEN = 480;  // longer msg is truncated
+static constexpr int         LOG_FLUSH_INTERVAL_MS  = 10;
+
+struct LogSlot {
+  spdlog::log_clock::time_point time;
+  std::size_t                   thread_id;
+  spdlog::level::level_enum     level;
+  std::size_t                   len;
+  char                          text[LOG_RING_SLOT_TEXT_LEN];
+};
+
+/// single producer which is the thread owns it, single consumer which is the flush thread
+class LogRing {
+  public:
+    LogRing() : slots_(LOG_RING_SLOT_NUM) {}
+
+    bool push(spdlog::level::level_enum level, const char *text, std::size_t len) {
+      std::size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_.load(std::memory_order_acquire) == LOG_RING_SLOT_NUM) { return false; }
+
+      LogSlot &slot = slots_[tail & (LOG_RING_SLOT_NUM - 1)];
+      slot.time = spdlog::details::os::now();
+      slot.thread_id = spdlog::details::os::thread_id();
+      slot.level = level;
+      slot.len = std::min(len, LOG_RING_SLOT_TEXT_LEN);
+      memcpy(slot.text, text, slot.len);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// @return num of slots popped
+    template <typename Fn>
+    std::size_t pop_all(Fn fn) {
+      std::size_t head = head_.load(std::memory_order_relaxed);
+      std::size_t tail = tail_.load(std::memory_order_acquire);
+      for (std::size_t i = head; i != tail; i++) { fn(slots_[i & (LOG_RING_SLOT_NUM - 1)]); }
+      head_.store(tail, std::memory_order_release);
+      return tail - head;
+    }
+
+  private:
+    std::vector<LogSlot>     slots_;
+    std::atomic<std::size_t> head_{0};
+    std::atomic<std::size_t> tail_{0};
+};
+
+static std::atomic<uint64_t> async_logger_generation{0};
+
+class AsyncLogger {
+  public:
+    AsyncLogger(FILE *fp, bool own_fp)
+      : generation_(++async_logger_generation)
+      , fp_(fp)
+      , own_fp_(own_fp)
+      , formatter_("%+")
+      , thread_([this] { run(); })
+    {}
+
+    ~AsyncLogger() {
+      stop_ = true;
+      thread_.join();
+      drain();
+      if (own_fp_) { fclose(fp_); }
+    }
+
+    void push(spdlog::level::level_enum level, const char *text, std::size_t len) {
+      // ring of a disposed logger is not drained any more
+      static thread_local std::shared_ptr<LogRing> ring;
+      static thread_local uint64_t ring_generation = 0;
+      if (ring_generation != generation_) {
+        ring = std::make_shared<LogRing>();
+        ring_generation = generation_;
+        std::lock_guard<std::mutex> guard(rings_mutex_);
+        rings_.push_back(ring);
+      }
+
+      if (!ring->push(level, text, len)) { dropped_num_++; }
+    }
+
+  private:
+    void run() {
+      while (!stop_) {
+        if (drain() == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS)); }
+      }
+    }
+
+    /// write out msgs of all rings with one write
+    std::size_t drain() {
+      std::size_t num = 0;
+      {
+        std::lock_guard<std::mutex> guard(rings_mutex_);
+        for (auto &ring : rings_) {
+          num += ring->pop_all([this](const LogSlot &slot) { format(slot.level, slot.time, slot.thread_id, slot.text, slot.len); });
+        }
+      }
+
+      uint64_t dropped_num = dropped_num_.load(std::memory_order_relaxed);
+      if (dropped_num != reported_dropped_num_) {
+        std::string text = fmt::format("Log ring full, dropped num:{}", dropped_num - reported_dropped_num_);
+        format(spdlog::level::warn, spdlog::details::os::now(), spdlog::details::os::thread_id(), text.data(), text.length());
+        reported_dropped_num_ = dropped_num;
+      }
+
+      if (out_.size()) {
+        fwrite(out_.data(), 1, out_.size(), fp_);
+        fflush(fp_);
+        out_.clear();
+      }
+      return num;
+    }
+
+    void format(spdlog::level::level_enum level, spdlog::log_clock::time_point time, std::size_t thread_id,
+                const char *text, std::size_t len)
+    {
+      spdlog::details::log_msg msg(&name_, level);
+      msg.time = time;
+      msg.thread_id = thread_id;
+      msg.raw.append(text, text + len);
+      formatter_.format(msg, out_);
+    }
+
+  private:
+    const uint64_t                        generation_;
+    FILE                                  *fp_;
+    const bool                            own_fp_;
+    const std::string                     name_ = "yet";
+    spdlog::pattern_formatter             formatter_;
+    fmt::memory_buffer                    out_;
+    std::mutex                            rings_mutex_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::atomic<uint64_t>                 dropped_num_{0};
+    uint64_t                              reported_dropped_num_ = 0;
+    std::atomic<bool>                     stop_{false};
+    std::thread                           thread_; // last member, starts after others are ready
+};
+
+static AsyncLogger *async_logger = nullptr;
+
+}
+
 std::shared_ptr<spdlog::logger> Log::core_;
+spdlog::level::level_enum Log::level_ = spdlog::level::trace;
+
+void Log::init(bool async, const std::string &filename) {
+  dispose();
 
-std::shared_ptr<spdlog::logger> Log::instance() {
+  if (async) {
+    FILE *fp = filename.empty() ? stdout : fopen(filename.c_str(), "a");
+    if (fp) {
+      async_logger = new AsyncLogger(fp, fp != stdout);
+      return;
+    }
+    YET_LOG_ERROR("Open log file failed, log to stdout. {}", filename);
+    async_logger = new AsyncLogger(stdout, false);
+    return;
+  }
+
+  if (!filename.empty()) {
+    core_ = spdlog::basic_logger_mt("yet", filename);
+    core_->set_level(spdlog::level::trace);
+  }
+}
+
+void Log::log(spdlog::level::level_enum level, fmt::memory_buffer &msg, const char *func, int line) {
+  fmt::format_to(msg, " - {}()#{}", func, line);
+
+  if (async_logger) {
+    async_logger->push(level, msg.data(), msg.size());
+    return;
+  }
+
+  instance()->log(level, "{}", fmt::string_view(msg.data(), msg.size()));
+}
+
+const std::shared_ptr<spdlog::logger> &Log::instance() {
   // let caller ensure no double init issues.
   if (!core_) {
-    core_ = spdlog::stdout_color_st("yet");
+    core_ = spdlog::stdout_color_mt("yet");
     core_->set_level(spdlog::level::trace);
   }
   return core_;
 }
 
 void Log::dispose() {
+  if (async_logger) {
+    delete async_logger;
+    async_logger = nullptr;
+  }
   if (core_) {
+    spdlog::drop(core_->name());
     core_.reset();
   }
 }
@@ -7,22 +7,45 @@
 
 #pragma once
 
+#include <string>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
-#define YET_LOG_DEBUG(...)        if (yet::Log::instance()->should_log(spdlog::level::debug)) { yet::Log::instance()->debug("{} - {}()#{}", fmt::format(__VA_ARGS__), __FUNCTION__, __LINE__); }
-#define YET_LOG_INFO(...)         if (yet::Log::instance()->should_log(spdlog::level::info)) { yet::Log::instance()->info("{} - {}()#{}", fmt::format(__VA_ARGS__), __FUNCTION__, __LINE__); }
-#define YET_LOG_WARN(...)         if (yet::Log::instance()->should_log(spdlog::level::warn)) { yet::Log::instance()->warn("{} - {}()#{}", fmt::format(__VA_ARGS__), __FUNCTION__, __LINE__); }
-#define YET_LOG_ERROR(...)        if (yet::Log::instance()->should_log(spdlog::level::err)) { yet::Log::instance()->error("{} - {}()#{}", fmt::format(__VA_ARGS__), __FUNCTION__, __LINE__); }
-#define YET_LOG_ASSERT(cond, ...) if (!(cond) && yet::Log::instance()->should_log(spdlog::level::err)) { yet::Log::instance()->error("CHEFASSERTME {} - {}()#{}", fmt::format(__VA_ARGS__), __FUNCTION__, __LINE__); }
+/// log sites below this level are compiled out, same value as spdlog::level, 1 debug, 2 info, 3 warn, 4 error
+#ifndef YET_LOG_ACTIVE_LEVEL
+#define YET_LOG_ACTIVE_LEVEL 1
+#endif
+
+#define YET_LOG_DEBUG(...)        if (YET_LOG_ACTIVE_LEVEL <= 1 && yet::Log::should_log(spdlog::level::debug)) { fmt::memory_buffer yet_log_buf_; fmt::format_to(yet_log_buf_, __VA_ARGS__); yet::Log::log(spdlog::level::debug, yet_log_buf_, __FUNCTION__, __LINE__); }
+#define YET_LOG_INFO(...)         if (YET_LOG_ACTIVE_LEVEL <= 2 && yet::Log::should_log(spdlog::level::info)) { fmt::memory_buffer yet_log_buf_; fmt::format_to(yet_log_buf_, __VA_ARGS__); yet::Log::log(spdlog::level::info, yet_log_buf_, __FUNCTION__, __LINE__); }
+#define YET_LOG_WARN(...)         if (YET_LOG_ACTIVE_LEVEL <= 3 && yet::Log::should_log(spdlog::level::warn)) { fmt::memory_buffer yet_log_buf_; fmt::format_to(yet_log_buf_, __VA_ARGS__); yet::Log::log(spdlog::level::warn, yet_log_buf_, __FUNCTION__, __LINE__); }
+#define YET_LOG_ERROR(...)        if (YET_LOG_ACTIVE_LEVEL <= 4 && yet::Log::should_log(spdlog::level::err)) { fmt::memory_buffer yet_log_buf_; fmt::format_to(yet_log_buf_, __VA_ARGS__); yet::Log::log(spdlog::level::err, yet_log_buf_, __FUNCTION__, __LINE__); }
+#define YET_LOG_ASSERT(cond, ...) if (YET_LOG_ACTIVE_LEVEL <= 4 && !(cond) && yet::Log::should_log(spdlog::level::err)) { fmt::memory_buffer yet_log_buf_; fmt::format_to(yet_log_buf_, "CHEFASSERTME "); fmt::format_to(yet_log_buf_, __VA_ARGS__); yet::Log::log(spdlog::level::err, yet_log_buf_, __FUNCTION__, __LINE__); }
 
 namespace yet {
 
+/// logs to stdout synchronously until <init>.
+///
+/// in async mode the caller only formats into a lock-free ring of its own thread,
+/// a dedicated thread drains all rings and writes them out in batches.
+/// a msg is dropped and counted if the ring is full, the caller never blocks.
 class Log {
   public:
-    static std::shared_ptr<spdlog::logger> instance();
+    /// call before any io thread starts
+    /// @param async    whether to log by a dedicated thread
+    /// @param filename empty for stdout
+    static void init(bool async, const std::string &filename);
+
+    static bool should_log(spdlog::level::level_enum level) { return level >= level_; }
+    static void set_level(spdlog::level::level_enum level) { level_ = level; }
+
+    /// @param msg formatted by the caller, location is appended to it
+    static void log(spdlog::level::level_enum level, fmt::memory_buffer &msg, const char *func, int line);
+
+    /// logger of sync mode
+    static const std::shared_ptr<spdlog::logger> &instance();
 
-    // just for mem check
+    // just for mem check, and flush msgs left in async mode
     static void dispose();
 
   private:
@@ -32,6 +55,7 @@ class Log {
 
   private:
     static std::shared_ptr<spdlog::logger> core_;
+    static spdlog::level::level_enum       level_;
 };
 
 }
@@ -0,0 +1,107 @@
+#include "yet_metrics.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace yet {
+
+namespace {
+
+static const char *COUNTER_NAMES[METRIC_COUNTER_NUM] = {
+  "yet_rtmp_conn_accepted_total",
+  "yet_rtmp_handshake_failed_total",
+  "yet_rtmp_bytes_in_total",
+  "yet_rtmp_bytes_out_total",
+  "yet_http_flv_conn_accepted_total",
+  "yet_http_flv_bytes_in_total",
+  "yet_http_flv_bytes_out_total",
+  "yet_av_msg_in_total",
+  "yet_sub_frame_dropped_total",
+  "yet_group_created_total",
+  "yet_group_released_total",
+  "yet_fanout_msg_out_total",
+  "yet_fanout_msg_dropped_total",
+  "yet_http_flv_pull_retry_total",
+  "yet_handover_failed_total",
+  "yet_rtmp_pull_retry_total",
+};
+
+static const char *HISTOGRAM_NAMES[METRIC_HISTOGRAM_NUM] = {
+  "yet_rtmp_handshake_seconds",
+  "yet_rtmp_first_frame_seconds",
+  "yet_http_flv_first_frame_seconds",
+};
+
+/// blocks of exited threads are kept, so counters never go back
+struct BlockRegistry {
+  std::mutex                                   mutex;
+  std::vector<std::unique_ptr<Metrics::Block>> blocks;
+};
+
+static BlockRegistry &registry() {
+  static BlockRegistry r;
+  return r;
+}
+
+}
+
+Metrics::Block *Metrics::create_block() {
+  Block *block = new Block(); // value initialized, all zero
+  BlockRegistry &r = registry();
+  std::lock_guard<std::mutex> guard(r.mutex);
+  r.blocks.emplace_back(block);
+  return block;
+}
+
+void Metrics::observe(MetricHistogram id, uint64_t us) {
+  std::size_t index = 0;
+  while (index < METRIC_BUCKET_NUM-1 && us > METRIC_BUCKET_BOUNDS_US[index]) { index++; }
+
+  Block::Histogram &h = local().histograms[id];
+  bump(h.buckets[index], 1);
+  bump(h.sum_us, us);
+}
+
+MetricsSnapshot Metrics::snapshot() {
+  MetricsSnapshot s;
+  BlockRegistry &r = registry();
+  std::lock_guard<std::mutex> guard(r.mutex);
+  for (auto &block : r.blocks) {
+    for (std::size_t i = 0; i < METRIC_COUNTER_NUM; i++) {
+      s.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < METRIC_HISTOGRAM_NUM; i++) {
+      const Block::Histogram &from = block->histograms[i];
+      MetricsSnapshot::Histogram &to = s.histograms[i];
+      for (std::size_t j = 0; j < METRIC_BUCKET_NUM; j++) {
+        to.buckets[j] += from.buckets[j].load(std::memory_order_relaxed);
+      }
+      to.sum_us += from.sum_us.load(std::memory_order_relaxed);
+    }
+  }
+  return s;
+}
+
+void Metrics::dump(fmt::memory_buffer &out) {
+  MetricsSnapshot s = snapshot();
+
+  for (std::size_t i = 0; i < METRIC_COUNTER_NUM; i++) {
+    fmt::format_to(out, "# TYPE {} counter\n{} {}\n", COUNTER_NAMES[i], COUNTER_NAMES[i], s.counters[i]);
+  }
+
+  for (std::size_t i = 0; i < METRIC_HISTOGRAM_NUM; i++) {
+    const char *name = HISTOGRAM_NAMES[i];
+    const MetricsSnapshot::Histogram &h = s.histograms[i];
+    fmt::format_to(out, "# TYPE {} histogram\n", name);
+    uint64_t cumulative = 0;
+    for (std::size_t j = 0; j < METRIC_BUCKET_NUM-1; j++) {
+      cumulative += h.buckets[j];
+      fmt::format_to(out, "{}_bucket{{le=\"{}\"}} {}\n", name, METRIC_BUCKET_BOUNDS_US[j] / 1e6, cumulative);
+    }
+    cumulative += h.buckets[METRIC_BUCKET_NUM-1];
+    fmt::format_to(out, "{}_bucket{{le=\"+Inf\"}} {}\n", name, cumulative);
+    fmt::format_to(out, "{}_sum {}\n{}_count {}\n", name, h.sum_us / 1e6, name, cumulative);
+  }
+}
+
+}
@@ -0,0 +1,105 @@
+/**
+ * @file   yet_metrics.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cinttypes>
+#include <spdlog/spdlog.h>
+
+namespace yet {
+
+enum MetricCounter {
+  METRIC_RTMP_CONN_ACCEPTED = 0,
+  METRIC_RTMP_HANDSHAKE_FAILED,
+  METRIC_RTMP_BYTES_IN,
+  METRIC_RTMP_BYTES_OUT,
+  METRIC_HTTP_FLV_CONN_ACCEPTED,
+  METRIC_HTTP_FLV_BYTES_IN,  // of http flv pulls
+  METRIC_HTTP_FLV_BYTES_OUT, // of http flv subs
+  METRIC_AV_MSG_IN,          // audio/video msgs of rtmp pubs and http flv pulls
+  METRIC_SUB_FRAME_DROPPED,  // by send queues of subs
+  METRIC_GROUP_CREATED,
+  METRIC_GROUP_RELEASED,     // idle for longer than the linger
+  METRIC_FANOUT_MSG_OUT,     // to replica groups in other io threads
+  METRIC_FANOUT_MSG_DROPPED, // ring to the io thread of a replica was full
+  METRIC_HTTP_FLV_PULL_RETRY, // reconnects of http flv pulls after the upstream failed
+  METRIC_HANDOVER_FAILED,     // sessions closed as the socket could not move to the io thread of the live name
+  METRIC_RTMP_PULL_RETRY,     // reconnects of rtmp pulls after the upstream failed or refused to play
+  METRIC_COUNTER_NUM
+};
+
+enum MetricHistogram {
+  METRIC_RTMP_HANDSHAKE_US = 0,     // from accept to c2
+  METRIC_RTMP_FIRST_FRAME_US,       // from accept to first av data queued to sub
+  METRIC_HTTP_FLV_FIRST_FRAME_US,   // from accept to first av data written to sub
+  METRIC_HISTOGRAM_NUM
+};
+
+/// upper bounds of histogram buckets in microseconds, the last bucket is +Inf
+static constexpr std::size_t METRIC_BUCKET_NUM = 13;
+static constexpr uint64_t METRIC_BUCKET_BOUNDS_US[METRIC_BUCKET_NUM-1] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+struct MetricsSnapshot {
+  uint64_t counters[METRIC_COUNTER_NUM] = {};
+
+  struct Histogram {
+    uint64_t buckets[METRIC_BUCKET_NUM] = {}; // not cumulative, count is the sum of them
+    uint64_t sum_us = 0;
+  } histograms[METRIC_HISTOGRAM_NUM];
+};
+
+/// process wide counters and latency histograms.
+///
+/// each thread updates a block of its own, which is summed up on <snapshot>.
+/// the owner thread is the only writer of its block, so an update is a relaxed load and store,
+/// no locked instruction, and no cache line is shared with other io threads on the per-packet path.
+class Metrics {
+  public:
+    static void add(MetricCounter id, uint64_t n=1) { bump(local().counters[id], n); }
+
+    static void observe(MetricHistogram id, uint64_t us);
+
+    /// sum of all threads, may be called in any thread
+    static MetricsSnapshot snapshot();
+
+    /// append <snapshot> in prometheus text format
+    static void dump(fmt::memory_buffer &out);
+
+  public:
+    struct Block {
+      std::atomic<uint64_t> counters[METRIC_COUNTER_NUM];
+
+      struct Histogram {
+        std::atomic<uint64_t> buckets[METRIC_BUCKET_NUM];
+        std::atomic<uint64_t> sum_us;
+      } histograms[METRIC_HISTOGRAM_NUM];
+
+      uint8_t pad[64]; // keeps tail of one block and head of the next one off the same cache line
+    };
+
+  private:
+    static void bump(std::atomic<uint64_t> &v, uint64_t n) {
+      v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static Block &local() {
+      static thread_local Block *block = create_block();
+      return *block;
+    }
+
+    static Block *create_block();
+
+  private:
+    Metrics() = delete;
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+};
+
+}
@@ -0,0 +1,226 @@
+/**
+ * @file   yet_send_queue.hpp
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <asio.hpp>
+#include "yet_common/yet_common.hpp"
+#include "yet_common/yet_metrics.h"
+
+namespace yet {
+
+enum SendQueueVerdict {
+  SENDQUEUEVERDICT_PASS,   // push the frame
+  SENDQUEUEVERDICT_DROP,   // drop the frame only
+  SENDQUEUEVERDICT_SKIP,   // queue overflowed, drop frames until a key frame
+  SENDQUEUEVERDICT_RESYNC, // restart from this key frame, seq headers should be sent before it
+};
+
+struct SendQueueStat {
+  uint64_t dropped_frame_num = 0;
+  uint64_t dropped_bytes     = 0;
+  uint64_t skip_num          = 0; // times of skipping to next key frame
+};
+
+/// queue of buffers waiting to be sent to one peer.
+/// queued buffers are gathered into one buffer sequence, so a peer which falls behind
+/// drains its backlog with one vectored write (writev) instead of one write per buffer.
+///
+/// the queue is bounded by bytes and delay of the oldest buffer. av frames pass <admit_frame> before pushing:
+/// over half of the budget non-reference frames are dropped, over the budget frames are skipped until next key frame.
+///
+/// items are kept in a ring which only grows, and a gather is handed to asio by reference,
+/// so nothing is allocated per buffer in steady state.
+class SendQueue {
+  public:
+    /// buffer sequence which refers to the gathered buffers, so asio does not copy them into each write op
+    class Gathered {
+      public:
+        typedef asio::const_buffer                                value_type;
+        typedef std::vector<asio::const_buffer>::const_iterator const_iterator;
+
+        explicit Gathered(const std::vector<asio::const_buffer> *bufs) : bufs_(bufs) {}
+
+        const_iterator begin() const { return bufs_->begin(); }
+        const_iterator end() const { return bufs_->end(); }
+
+      private:
+        const std::vector<asio::const_buffer> *bufs_;
+    };
+
+  public:
+    /// @param max_batch_num   max num of buffers in one gather, asio limits iovec num of one writev to 64 anyway
+    /// @param max_batch_bytes max bytes of one gather, at least one buffer is gathered whatever its size
+    /// @param max_bytes       budget of queued bytes, 0 means unlimited
+    /// @param max_delay_ms    budget of delay of the oldest queued buffer, 0 means unlimited
+    SendQueue(std::size_t max_batch_num, std::size_t max_batch_bytes, std::size_t max_bytes, uint32_t max_delay_ms)
+      : max_batch_num_(max_batch_num)
+      , max_batch_bytes_(max_batch_bytes)
+      , max_bytes_(max_bytes)
+      , max_delay_ms_(max_delay_ms)
+    {}
+
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    std::size_t bytes() const { return bytes_; }
+    bool is_skipping() const { return skipping_; }
+    /// whether buffers of last <gather> are being written
+    bool is_sending() const { return !gathered_.empty(); }
+    const SendQueueStat &stat() const { return stat_; }
+
+    /// @param droppable if true, <buf> may be dropped by <purge_unsent> before sending
+    void push(BufferPtr buf, bool droppable=false) {
+      bytes_ += buf->readable_size();
+      if (size_ == ring_.size()) { grow(); }
+      item(size_) = Item{buf, Clock::now(), droppable};
+      size_++;
+    }
+
+    SendQueueVerdict admit_frame(bool is_key_frame, bool is_non_ref_frame, std::size_t len) {
+      if (skipping_) {
+        if (is_key_frame) {
+          skipping_ = false;
+          return SENDQUEUEVERDICT_RESYNC;
+        }
+        count_drop(len);
+        return SENDQUEUEVERDICT_DROP;
+      }
+
+      int level = congestion_level();
+      if (level == 0) { return SENDQUEUEVERDICT_PASS; }
+
+      if (level == 1) {
+        if (!is_non_ref_frame) { return SENDQUEUEVERDICT_PASS; }
+
+        count_drop(len);
+        return SENDQUEUEVERDICT_DROP;
+      }
+
+      stat_.skip_num++;
+      YET_LOG_WARN("Send queue overflow, skip to next key frame. bytes:{}, num:{}, delay:{}ms",
+                   bytes_, size_, front_delay_ms());
+      if (is_key_frame) { return SENDQUEUEVERDICT_RESYNC; }
+
+      skipping_ = true;
+      count_drop(len);
+      return SENDQUEUEVERDICT_SKIP;
+    }
+
+    /// drop droppable buffers which are not being written
+    void purge_unsent() {
+      std::size_t kept = gathered_.size();
+      for (std::size_t i = gathered_.size(); i < size_; i++) {
+        if (!item(i).droppable) {
+          if (i != kept) { item(kept) = std::move(item(i)); }
+          kept++;
+        } else {
+          count_drop(item(i).buf->readable_size());
+          bytes_ -= item(i).buf->readable_size();
+        }
+      }
+      for (std::size_t i = kept; i < size_; i++) { item(i).buf.reset(); }
+      size_ = kept;
+    }
+
+    /// @NOTICE queue must not be empty, and the result must be kept valid until <pop_gathered>
+    Gathered gather() {
+      gathered_.clear();
+      std::size_t gathered_bytes = 0;
+      for (std::size_t i = 0; i < size_; i++) {
+        const BufferPtr &buf = item(i).buf;
+        if (gathered_.size() == max_batch_num_) { break; }
+        if (!gathered_.empty() && gathered_bytes + buf->readable_size() > max_batch_bytes_) { break; }
+
+        gathered_.push_back(asio::const_buffer(buf->read_pos(), buf->readable_size()));
+        gathered_bytes += buf->readable_size();
+      }
+      return Gathered(&gathered_);
+    }
+
+    /// drop buffers of last <gather> after they are written
+    void pop_gathered() {
+      for (std::size_t i = 0; i < gathered_.size(); i++) {
+        bytes_ -= item(0).buf->readable_size();
+        item(0).buf.reset();
+        head_ = (head_ + 1) & (ring_.size() - 1);
+        size_--;
+      }
+      gathered_.clear();
+    }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Item {
+      BufferPtr         buf;
+      Clock::time_point push_time;
+      bool              droppable;
+    };
+
+  private:
+    Item &item(std::size_t index) { return ring_[(head_ + index) & (ring_.size() - 1)]; }
+    const Item &item(std::size_t index) const { return ring_[(head_ + index) & (ring_.size() - 1)]; }
+
+    /// size of ring is kept power of 2
+    void grow() {
+      std::vector<Item> ring(ring_.empty() ? 16 : ring_.size() * 2);
+      for (std::size_t i = 0; i < size_; i++) { ring[i] = std::move(item(i)); }
+      ring_.swap(ring);
+      head_ = 0;
+    }
+
+    /// delay of the oldest buffer not being written, buffers being written are not counted,
+    /// otherwise the new key frame after a resync would be purged as soon as it's pushed
+    int64_t front_delay_ms() const {
+      if (size_ <= gathered_.size()) { return 0; }
+
+      return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - item(gathered_.size()).push_time).count();
+    }
+
+    /// 0 under half of the budget, 1 under the budget, 2 over the budget
+    int congestion_level() const {
+      if (size_ == 0) { return 0; }
+
+      int level = 0;
+      if (max_bytes_) {
+        if (bytes_ > max_bytes_) { return 2; }
+        if (bytes_ > max_bytes_ / 2) { level = 1; }
+      }
+      if (max_delay_ms_) {
+        int64_t delay_ms = front_delay_ms();
+        if (delay_ms > max_delay_ms_) { return 2; }
+        if (delay_ms > max_delay_ms_ / 2) { level = 1; }
+      }
+      return level;
+    }
+
+    void count_drop(std::size_t len) {
+      stat_.dropped_frame_num++;
+      stat_.dropped_bytes += len;
+      Metrics::add(METRIC_SUB_FRAME_DROPPED);
+    }
+
+  private:
+    SendQueue(const SendQueue &) = delete;
+    SendQueue &operator=(const SendQueue &) = delete;
+
+  private:
+    const std::size_t               max_batch_num_;
+    const std::size_t               max_batch_bytes_;
+    const std::size_t               max_bytes_;
+    const int64_t                   max_delay_ms_;
+    std::vector<Item>               ring_;
+    std::size_t                     head_ = 0;
+    std::size_t                     size_ = 0;
+    std::size_t                     bytes_ = 0;
+    std::vector<asio::const_buffer> gathered_;
+    bool                            skipping_ = false;
+    SendQueueStat                   stat_;
+};
+
+}
@@ -0,0 +1,244 @@
+#include "yet_sha256.h"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YET_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace yet {
+
+namespace {
+
+typedef void (*CompressFn)(uint32_t *state, const uint8_t *blocks, std::size_t num);
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t INIT_STATE[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static inline uint32_t read_be32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static void compress_portable(uint32_t *state, const uint8_t *blocks, std::size_t num) {
+  for (; num; num--, blocks += Sha256::BLOCK_LEN) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) { w[i] = read_be32(blocks + i*4); }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+      uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & (f ^ g)) ^ g) + K[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & (b | c)) | (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#if defined(YET_SHA256_X86)
+
+/// two rounds per sha256rnds2, state kept as ABEF and CDGH as the instructions want
+__attribute__((target("sha,sse4.1")))
+static void compress_shani(uint32_t *state, const uint8_t *blocks, std::size_t num) {
+  const __m128i BSWAP_MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1); // CDAB
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+  for (; num; num--, blocks += Sha256::BLOCK_LEN) {
+    __m128i abef_save = state0;
+    __m128i cdgh_save = state1;
+
+    // msgs[g & 3] holds w[4g..4g+3], the last 4 groups are all the schedule needs
+    __m128i msgs[4];
+    for (int g = 0; g < 16; g++) {
+      __m128i msg;
+      if (g < 4) {
+        msg = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + g*16)), BSWAP_MASK);
+      } else {
+        msg = _mm_sha256msg1_epu32(msgs[g & 3], msgs[(g+1) & 3]);
+        msg = _mm_add_epi32(msg, _mm_alignr_epi8(msgs[(g+3) & 3], msgs[(g+2) & 3], 4));
+        msg = _mm_sha256msg2_epu32(msg, msgs[(g+3) & 3]);
+      }
+      msgs[g & 3] = msg;
+
+      __m128i wk = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *)&K[g*4]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+    }
+
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
+
+static bool cpu_has_shani() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+  bool ssse3_sse41 = (ecx & bit_SSSE3) && (ecx & bit_SSE4_1);
+
+  if (__get_cpuid_max(0, nullptr) < 7) { return false; }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return ssse3_sse41 && (ebx & (1u << 29));
+}
+
+#endif
+
+static const CompressFn ENGINE_FNS[Sha256::ENGINE_NUM] = {
+  compress_portable,
+#if defined(YET_SHA256_X86)
+  compress_shani,
+#else
+  nullptr,
+#endif
+};
+
+static bool supported(Sha256::Engine e) {
+#if defined(YET_SHA256_X86)
+  if (e == Sha256::ENGINE_SHANI) { return cpu_has_shani(); }
+#endif
+  return ENGINE_FNS[e] != nullptr;
+}
+
+static Sha256::Engine pick_engine() {
+  return supported(Sha256::ENGINE_SHANI) ? Sha256::ENGINE_SHANI : Sha256::ENGINE_PORTABLE;
+}
+
+static void compress_resolve(uint32_t *state, const uint8_t *blocks, std::size_t num);
+
+// constant initialized, so hashing in static init of other units is fine too
+static std::atomic<CompressFn> compress_{compress_resolve};
+static std::atomic<int>        engine_{Sha256::ENGINE_PORTABLE};
+
+static void resolve() {
+  Sha256::Engine e = pick_engine();
+  engine_.store(e, std::memory_order_relaxed);
+  compress_.store(ENGINE_FNS[e], std::memory_order_relaxed);
+}
+
+/// first call picks the engine
+static void compress_resolve(uint32_t *state, const uint8_t *blocks, std::size_t num) {
+  resolve();
+  compress_.load(std::memory_order_relaxed)(state, blocks, num);
+}
+
+static inline void compress(uint32_t *state, const uint8_t *blocks, std::size_t num) {
+  compress_.load(std::memory_order_relaxed)(state, blocks, num);
+}
+
+}
+
+void Sha256::init() {
+  memcpy(state_, INIT_STATE, sizeof state_);
+  total_len_ = 0;
+  block_len_ = 0;
+}
+
+void Sha256::update(const uint8_t *data, std::size_t len) {
+  total_len_ += len;
+
+  if (block_len_) {
+    std::size_t n = std::min(len, BLOCK_LEN - block_len_);
+    memcpy(block_ + block_len_, data, n);
+    block_len_ += n;
+    data += n;
+    len -= n;
+    if (block_len_ < BLOCK_LEN) { return; }
+
+    compress(state_, block_, 1);
+    block_len_ = 0;
+  }
+
+  std::size_t num = len / BLOCK_LEN;
+  if (num) {
+    compress(state_, data, num);
+    data += num * BLOCK_LEN;
+    len -= num * BLOCK_LEN;
+  }
+
+  if (len) {
+    memcpy(block_, data, len);
+    block_len_ = len;
+  }
+}
+
+void Sha256::final(uint8_t *digest) {
+  uint64_t bits = total_len_ * 8;
+
+  // 0x80, zero pad, then 8 bytes of length in bits, 1 or 2 blocks
+  block_[block_len_++] = 0x80;
+  if (block_len_ > BLOCK_LEN - 8) {
+    memset(block_ + block_len_, 0, BLOCK_LEN - block_len_);
+    compress(state_, block_, 1);
+    block_len_ = 0;
+  }
+  memset(block_ + block_len_, 0, BLOCK_LEN - 8 - block_len_);
+  for (int i = 0; i < 8; i++) { block_[BLOCK_LEN - 1 - i] = static_cast<uint8_t>(bits >> (i * 8)); }
+  compress(state_, block_, 1);
+
+  for (int i = 0; i < 8; i++) {
+    digest[i*4]   = static_cast<uint8_t>(state_[i] >> 24);
+    digest[i*4+1] = static_cast<uint8_t>(state_[i] >> 16);
+    digest[i*4+2] = static_cast<uint8_t>(state_[i] >> 8);
+    digest[i*4+3] = static_cast<uint8_t>(state_[i]);
+  }
+}
+
+Sha256::Engine Sha256::engine() {
+  if (compress_.load(std::memory_order_relaxed) == compress_resolve) { resolve(); }
+  return static_cast<Engine>(engine_.load(std::memory_order_relaxed));
+}
+
+const char *Sha256::engine_name(Engine e) {
+  switch (e) {
+  case ENGINE_PORTABLE: return "portable";
+  case ENGINE_SHANI:    return "shani";
+  default:              return "unknown";
+  }
+}
+
+bool Sha256::engine_supported(Engine e) {
+  return e < ENGINE_NUM && supported(e);
+}
+
+bool Sha256::set_engine(Engine e) {
+  if (!engine_supported(e)) { return false; }
+
+  engine_.store(e, std::memory_order_relaxed);
+  compress_.store(ENGINE_FNS[e], std::memory_order_relaxed);
+  return true;
+}
+
+}
@@ -0,0 +1,55 @@
+/**
+ * @file   yet_sha256.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cinttypes>
+
+namespace yet {
+
+/// sha256 hashing whole blocks at a time.
+///
+/// the block function is picked once by cpu at startup,
+/// x86 sha extensions if supported, otherwise the portable one.
+/// plain value type, copy of a context continues from the same state.
+class Sha256 {
+  public:
+    static constexpr std::size_t BLOCK_LEN  = 64;
+    static constexpr std::size_t DIGEST_LEN = 32;
+
+    enum Engine {
+      ENGINE_PORTABLE = 0,
+      ENGINE_SHANI    = 1,
+      ENGINE_NUM
+    };
+
+  public:
+    Sha256() { init(); }
+
+    void init();
+    void update(const uint8_t *data, std::size_t len);
+
+    /// context is not usable after it, until next <init>
+    void final(uint8_t *digest);
+
+  public:
+    static Engine engine();
+    static const char *engine_name(Engine e);
+    static bool engine_supported(Engine e);
+
+    /// for benches and comparison, not thread safe with hashing in other threads
+    /// @return false if not supported by cpu
+    static bool set_engine(Engine e);
+
+  private:
+    uint32_t    state_[8];
+    uint64_t    total_len_;
+    std::size_t block_len_;
+    uint8_t     block_[BLOCK_LEN];
+};
+
+}
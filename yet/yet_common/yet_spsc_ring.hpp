@@ -0,0 +1,90 @@
+/**
+ * @file   yet_spsc_ring.hpp
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cinttypes>
+#include <utility>
+#include <vector>
+
+namespace yet {
+
+/// bounded lock-free queue of one producer thread and one consumer thread.
+///
+/// each side owns one index and keeps a cached copy of the other side's index,
+/// so the shared index is loaded only when the cache says the ring looks full or empty.
+/// indexes are kept off the cache line of each other, the same as blocks of <Metrics>.
+template <typename T>
+class SpscRing {
+  public:
+    /// @param capacity rounded up to power of 2
+    explicit SpscRing(std::size_t capacity)
+      : items_(round_up(capacity))
+      , mask_(items_.size() - 1)
+    {
+    }
+
+    /// @NOTICE producer thread only
+    /// @return false if full, <item> is left untouched
+    bool push(T &&item) {
+      std::size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_cache_ > mask_) {
+        head_cache_ = head_.load(std::memory_order_acquire);
+        if (tail - head_cache_ > mask_) { return false; }
+      }
+
+      items_[tail & mask_] = std::move(item);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// @NOTICE consumer thread only, the slot is moved out so refs held by <T> go with <item>
+    /// @return false if empty
+    bool pop(T &item) {
+      std::size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_cache_) {
+        tail_cache_ = tail_.load(std::memory_order_acquire);
+        if (head == tail_cache_) { return false; }
+      }
+
+      item = std::move(items_[head & mask_]);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// may be called in either thread, only a hint while the other side is running
+    bool empty() const {
+      return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return items_.size(); }
+
+  private:
+    static std::size_t round_up(std::size_t n) {
+      std::size_t cap = 2;
+      while (cap < n) { cap <<= 1; }
+      return cap;
+    }
+
+  private:
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+  private:
+    std::vector<T>           items_;
+    const std::size_t        mask_;
+    uint8_t                  pad0_[64];
+    std::atomic<std::size_t> head_{0};       // written by consumer
+    std::size_t              tail_cache_ = 0; // consumer's copy of <tail_>
+    uint8_t                  pad1_[64];
+    std::atomic<std::size_t> tail_{0};       // written by producer
+    std::size_t              head_cache_ = 0; // producer's copy of <head_>
+    uint8_t                  pad2_[64];
+};
+
+}
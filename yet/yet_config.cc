@@ -1,4 +1,7 @@
 #include "yet_config.h"
+#include <algorithm>
+#include <random>
+#include "chef_base/chef_strings_op.hpp"
 
 namespace yet {
 
@@ -16,4 +19,44 @@ void Config::dispose() {
   if (core_) { delete core_; }
 }
 
+bool Config::set_rtmp_push_rules_by_spec(const std::string &spec) {
+  std::vector<RtmpPushRule> rules;
+  for (auto &item : chef::strings_op::split(spec, ',', false)) {
+    std::vector<std::string> kv = chef::strings_op::split(item, '=', true, true);
+    if (kv.size() != 2 || kv[0].empty() || kv[1].empty()) { return false; }
+
+    RtmpPushRule rule;
+    rule.pattern = kv[0];
+    std::size_t pos = kv[1].find('/');
+    rule.server = kv[1].substr(0, pos);
+    if (pos != std::string::npos) { rule.app = kv[1].substr(pos+1); }
+    if (rule.server.empty()) { return false; }
+
+    rules.push_back(rule);
+  }
+  rtmp_push_rules_ = rules;
+  return true;
+}
+
+std::vector<RtmpPushRule> Config::match_rtmp_push_rules(const std::string &app, const std::string &live_name) const {
+  std::string path = app + "/" + live_name;
+  std::vector<RtmpPushRule> matched;
+  for (auto &rule : rtmp_push_rules_) {
+    const std::string &p = rule.pattern;
+    bool match = (!p.empty() && p.back() == '*') ? path.compare(0, p.size()-1, p, 0, p.size()-1) == 0 : path == p;
+    if (match) { matched.push_back(rule); }
+  }
+  return matched;
+}
+
+uint32_t Config::pull_retry_delay_ms(uint32_t retry_num) const {
+  // full jitter over the upper half, so pulls dropped by one upstream failure spread out
+  static thread_local std::minstd_rand rand_engine(std::random_device{}());
+  uint32_t max_ms = std::max(pull_retry_min_ms_, pull_retry_max_ms_);
+  uint32_t delay_ms = pull_retry_min_ms_;
+  for (uint32_t i = 0; i < retry_num && delay_ms < max_ms; i++) { delay_ms *= 2; }
+  delay_ms = std::min(delay_ms, max_ms);
+  return delay_ms - std::uniform_int_distribution<uint32_t>(0, delay_ms / 2)(rand_engine);
+}
+
 }
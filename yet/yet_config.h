@@ -7,11 +7,19 @@
 
 #pragma once
 
+#include <cinttypes>
 #include <string>
+#include <vector>
 #include "chef_base/chef_snippet.hpp"
 
 namespace yet {
 
+struct RtmpPushRule {
+  std::string pattern; // app/live name, a trailing * matches any suffix
+  std::string server;  // host[:port] of the downstream server
+  std::string app;     // app on the downstream server, the same as of the pub if empty
+};
+
 class Config {
   public:
     static Config *instance();
@@ -22,6 +30,53 @@ class Config {
   public:
     CHEF_PROPERTY(std::string, http_flv_pull_host);
 
+    // host[:port] of the rtmp origin, a live name not published here is played from it instead of pulled over http flv
+    CHEF_PROPERTY(std::string, rtmp_pull_host);
+
+    // gop cache of each group for instant start playing, 0 gop num means disable
+    CHEF_PROPERTY_WITH_INIT_VALUE(std::size_t, gop_cache_max_gop_num, 1);
+    CHEF_PROPERTY_WITH_INIT_VALUE(std::size_t, gop_cache_max_bytes, 16 * 1024 * 1024);
+
+    // send queue budget of each sub, over half of it non-reference frames are dropped,
+    // over it frames are skipped until next key frame. 0 means unlimited
+    CHEF_PROPERTY_WITH_INIT_VALUE(std::size_t, sub_queue_max_bytes, 16 * 1024 * 1024);
+    CHEF_PROPERTY_WITH_INIT_VALUE(uint32_t, sub_queue_max_delay_ms, 5000);
+
+    // a group with no pub and no sub is released after lingering this long, with its http flv pull.
+    // a sub comes back within it finds the pull still running and the gop cached
+    CHEF_PROPERTY_WITH_INIT_VALUE(uint32_t, group_idle_linger_ms, 5000);
+
+    // a pull reconnects after the upstream failed, the delay doubles from min to max on each failure in a row,
+    // and a random part of up to half of it is taken off, so pulls of one upstream do not come back all at once
+    CHEF_PROPERTY_WITH_INIT_VALUE(uint32_t, pull_retry_min_ms, 500);
+    CHEF_PROPERTY_WITH_INIT_VALUE(uint32_t, pull_retry_max_ms, 10000);
+
+    // http flv is sent with chunked transfer encoding to http/1.1 subs, so the end of stream is told from a failure
+    CHEF_PROPERTY_WITH_INIT_VALUE(bool, http_flv_chunked, false);
+
+    // a http connection is closed if no whole request head comes within it, either a new one or one kept alive
+    // after a short response such as stats
+    CHEF_PROPERTY_WITH_INIT_VALUE(uint32_t, http_request_timeout_ms, 15000);
+
+    // max msgs in flight from the home io thread of a live name to each other io thread which has its subs,
+    // over it msgs are dropped and the replica group restarts from next key frame
+    CHEF_PROPERTY_WITH_INIT_VALUE(std::size_t, fanout_ring_size, 4096);
+
+    // a pub is forwarded to the server of each rule it matches, each push has the send queue budget of a sub
+    CHEF_PROPERTY(std::vector<RtmpPushRule>, rtmp_push_rules);
+
+  public:
+    /// @param spec rules separated by comma, each as <pattern>=<host>[:<port>][/<app>], e.g. live/*=backup:1935
+    /// @return false if any rule is invalid, no rule is set then
+    bool set_rtmp_push_rules_by_spec(const std::string &spec);
+
+    /// rules matched by the pub of <live_name> in <app>
+    std::vector<RtmpPushRule> match_rtmp_push_rules(const std::string &app, const std::string &live_name) const;
+
+    /// delay before the next reconnect of a pull, see <pull_retry_min_ms>
+    /// @param retry_num failures in a row before this one
+    uint32_t pull_retry_delay_ms(uint32_t retry_num) const;
+
   private:
     Config() {}
 
@@ -0,0 +1,57 @@
+#include "yet_fanout.h"
+#include "yet_group.h"
+#include "yet_common/yet_metrics.h"
+
+namespace yet {
+
+// msgs handled per drain, then the drain yields to other handlers of the thread such as socket writes
+static constexpr std::size_t FANOUT_DRAIN_BATCH = 256;
+
+Fanout::Fanout(const std::vector<asio::io_context *> &io_ctxs, std::size_t ring_size)
+  : shard_num_(io_ctxs.size())
+{
+  for (std::size_t src = 0; src < shard_num_; src++) {
+    for (std::size_t dst = 0; dst < shard_num_; dst++) {
+      // a group never fans out to its own thread, rings of src == dst stay unused
+      channels_.emplace_back(new Channel(io_ctxs[dst], src == dst ? 0 : ring_size));
+    }
+  }
+}
+
+bool Fanout::send(std::size_t src, std::size_t dst, FanoutMsg &&msg) {
+  Channel *ch = channels_[src * shard_num_ + dst].get();
+  if (!ch->ring.push(std::move(msg))) {
+    Metrics::add(METRIC_FANOUT_MSG_DROPPED);
+    return false;
+  }
+  Metrics::add(METRIC_FANOUT_MSG_OUT);
+
+  // pairs with the fence in <drain>, either the consumer sees this msg or we see it is not draining
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!ch->draining.exchange(true)) {
+    asio::post(*ch->io_ctx, [this, ch] { drain(ch); });
+  }
+  return true;
+}
+
+void Fanout::drain(Channel *ch) {
+  FanoutMsg msg;
+  for (std::size_t i = 0; i < FANOUT_DRAIN_BATCH; i++) {
+    if (!ch->ring.pop(msg)) {
+      ch->draining.store(false);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      // a msg pushed between the pop and the store above did not post, take it over unless a newer post did
+      if (ch->ring.empty() || ch->draining.exchange(true)) { return; }
+      continue;
+    }
+
+    // the replica may have been released as idle since the msg was sent
+    if (GroupPtr replica = msg.replica.lock()) { replica->on_fanout_msg(msg); }
+    msg = FanoutMsg();
+  }
+
+  asio::post(*ch->io_ctx, [this, ch] { drain(ch); });
+}
+
+}
@@ -0,0 +1,70 @@
+/**
+ * @file   yet_fanout.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <asio.hpp>
+#include "yet.hpp"
+#include "yet_common/yet_spsc_ring.hpp"
+
+namespace yet {
+
+enum FanoutMsgType {
+  FANOUTMSGTYPE_PACKET = 0,
+  FANOUTMSGTYPE_PUBLISH,
+  FANOUTMSGTYPE_PUBLISH_STOP
+};
+
+struct FanoutMsg {
+  FanoutMsgType        type   = FANOUTMSGTYPE_PACKET;
+  std::weak_ptr<Group> replica; // group which handles the msg in the io thread of the dst
+  AvPacketPtr          pkt;            // frozen, see <AvPacket::freeze>
+  bool                 resync = false; // msgs before it are lost, the replica restarts from it
+};
+
+/// carries msgs of home groups to their replicas in other io threads.
+///
+/// a replica is owned by its own io thread only, msgs refer to it weakly, so a msg dropped or left behind in the home thread
+/// never releases it there.
+///
+/// there is one ring per pair of (src io thread, dst io thread), so each ring has a single producer and a single consumer,
+/// and a packet pushed to rings of all dst threads is shared by them without copy.
+/// no lock is taken per msg, the dst thread is woken up by one post for all msgs pushed until it drains the ring.
+class Fanout {
+  public:
+    /// @param io_ctxs   io context of each io thread, indexed by shard
+    /// @param ring_size max msgs in flight from one io thread to another
+    Fanout(const std::vector<asio::io_context *> &io_ctxs, std::size_t ring_size);
+
+    /// @NOTICE must be called in io thread <src>
+    /// @return false if the ring to <dst> is full, <msg> is dropped
+    bool send(std::size_t src, std::size_t dst, FanoutMsg &&msg);
+
+  private:
+    struct Channel {
+      asio::io_context       *io_ctx;
+      SpscRing<FanoutMsg>    ring;
+      std::atomic<bool>      draining;
+
+      Channel(asio::io_context *c, std::size_t ring_size) : io_ctx(c), ring(ring_size), draining(false) {}
+    };
+
+  private:
+    void drain(Channel *ch);
+
+  private:
+    Fanout(const Fanout &) = delete;
+    Fanout &operator=(const Fanout &) = delete;
+
+  private:
+    const std::size_t                     shard_num_;
+    std::vector<std::unique_ptr<Channel>> channels_; // src * shard_num_ + dst
+};
+
+}
@@ -0,0 +1,54 @@
+#include "yet_gop_cache.h"
+
+namespace yet {
+
+GopCache::GopCache(std::size_t max_gop_num, std::size_t max_bytes)
+  : max_gop_num_(max_gop_num)
+  , max_bytes_(max_bytes)
+{
+}
+
+void GopCache::push_key_frame(BufferPtr buf) {
+  if (max_gop_num_ == 0) { return; }
+
+  if (gops_.size() == max_gop_num_) { pop_front(); }
+
+  gops_.emplace_back();
+  push(buf);
+}
+
+void GopCache::push(BufferPtr buf) {
+  if (gops_.empty()) { return; }
+
+  std::size_t len = buf->readable_size();
+  gops_.back().bufs.push_back(buf);
+  gops_.back().bytes += len;
+  bytes_ += len;
+
+  for (; bytes_ > max_bytes_ && gops_.size() > 1; ) { pop_front(); }
+
+  if (bytes_ > max_bytes_) {
+    YET_LOG_WARN("Gop too big, drop it. bytes:{}, max:{}", bytes_, max_bytes_);
+    clear();
+  }
+}
+
+void GopCache::clear() {
+  gops_.clear();
+  bytes_ = 0;
+}
+
+void GopCache::for_each(const std::function<void(BufferPtr)> &fn) const {
+  for (auto &gop : gops_) {
+    for (auto &buf : gop.bufs) {
+      fn(buf);
+    }
+  }
+}
+
+void GopCache::pop_front() {
+  bytes_ -= gops_.front().bytes;
+  gops_.pop_front();
+}
+
+}
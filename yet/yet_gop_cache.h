@@ -0,0 +1,54 @@
+/**
+ * @file   yet_gop_cache.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include "yet.hpp"
+
+namespace yet {
+
+/// cache of the latest gops, each item is a buffer which is ready to send and shared with live fan-out.
+/// bounded by both gop num and total bytes, a gop which alone exceeds <max_bytes> is dropped as a whole.
+class GopCache {
+  public:
+    /// @param max_gop_num 0 means disable cache
+    GopCache(std::size_t max_gop_num, std::size_t max_bytes);
+
+    /// start a new gop with key frame <buf>
+    void push_key_frame(BufferPtr buf);
+
+    /// append <buf> to the latest gop, ignored if no gop started yet
+    void push(BufferPtr buf);
+
+    void clear();
+
+    bool empty() const { return gops_.empty(); }
+    std::size_t gop_num() const { return gops_.size(); }
+    std::size_t bytes() const { return bytes_; }
+
+    /// visit all cached buffers in order
+    void for_each(const std::function<void(BufferPtr)> &fn) const;
+
+  private:
+    void pop_front();
+
+  private:
+    struct Gop {
+      std::vector<BufferPtr> bufs;
+      std::size_t            bytes = 0;
+    };
+
+  private:
+    const std::size_t max_gop_num_;
+    const std::size_t max_bytes_;
+    std::deque<Gop>   gops_;
+    std::size_t       bytes_ = 0;
+};
+
+}
@@ -1,14 +1,26 @@
 #include "yet_group.h"
+#include <algorithm>
 #include "yet.hpp"
 #include "yet_rtmp/yet_rtmp_pack_op.h"
 #include "yet_http_flv_pull.h"
+#include "yet_rtmp_client.h"
 #include "yet_http_flv_sub.h"
 #include "yet_rtmp_session.h"
+#include "yet_av_packet.h"
+#include "yet_config.h"
+#include "yet_common/yet_av_op.hpp"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_common/yet_metrics.h"
+#include "chef_base/chef_stuff_op.hpp"
 
 namespace yet {
 
 Group::Group(const std::string &live_name)
   : live_name_(live_name)
+  , rtmp_tis_(1)
+  , rtmp_gop_cache_(Config::instance()->gop_cache_max_gop_num(), Config::instance()->gop_cache_max_bytes())
+  , http_flv_gop_cache_(Config::instance()->gop_cache_max_gop_num(), Config::instance()->gop_cache_max_bytes())
+  , idle_since_(std::chrono::steady_clock::now())
 {
   YET_LOG_DEBUG("Group() {}", (void *)this);
 }
@@ -21,6 +33,14 @@ Group::~Group() {
 
 void Group::dispose() {
   if (http_flv_pull_) { http_flv_pull_->dispose(); }
+  http_flv_pull_.reset();
+
+  if (rtmp_pull_) { rtmp_pull_->dispose(); }
+  rtmp_pull_.reset();
+
+  for (auto &it : rtmp_pushes_) { it->dispose(); }
+
+  rtmp_pushes_.clear();
 
   if (rtmp_pub_) { rtmp_pub_->dispose(); }
 
@@ -30,7 +50,156 @@ void Group::dispose() {
 
   for (auto &it : rtmp_subs_) { it->dispose(); }
 
-  http_flv_subs_.clear();
+  rtmp_subs_.clear();
+
+  replicas_.clear();
+}
+
+void Group::set_fanout(Fanout *fanout, std::size_t shard, bool is_replica) {
+  fanout_ = fanout;
+  shard_ = shard;
+  is_replica_ = is_replica;
+}
+
+static bool is_same_group(const std::weak_ptr<Group> &a, const std::weak_ptr<Group> &b) {
+  return !a.owner_before(b) && !b.owner_before(a);
+}
+
+void Group::add_replica(std::size_t shard, std::weak_ptr<Group> replica) {
+  if (replica.expired()) { return; }
+
+  auto iter = std::find_if(replicas_.begin(), replicas_.end(), [shard](const Replica &r) { return r.shard == shard; });
+  if (iter != replicas_.end() && is_same_group(iter->group, replica)) { return; }
+
+  // the old replica of the thread was released, the new one replaces it
+  if (iter == replicas_.end()) {
+    replicas_.push_back(Replica{shard, replica, false});
+    iter = replicas_.end() - 1;
+  }
+  iter->group = replica;
+  YET_LOG_DEBUG("Add replica. live name:{}, shard:{}, gop pkts:{}", live_name_, shard, fanout_gop_.size());
+  sync_replica(*iter, fanout_gop_);
+  update_idle();
+}
+
+void Group::del_replica(std::size_t shard, std::weak_ptr<Group> replica) {
+  replicas_.erase(std::remove_if(replicas_.begin(), replicas_.end(),
+                                 [shard, &replica](const Replica &r) {
+                                   return r.shard == shard && is_same_group(r.group, replica);
+                                 }),
+                  replicas_.end());
+  update_idle();
+}
+
+void Group::on_fanout_msg(const FanoutMsg &msg) {
+  switch (msg.type) {
+  case FANOUTMSGTYPE_PUBLISH:
+    clear_gop_caches();
+    on_rtmp_publish();
+    return;
+  case FANOUTMSGTYPE_PUBLISH_STOP:
+    on_rtmp_publish_stop();
+    return;
+  case FANOUTMSGTYPE_PACKET:
+    break;
+  }
+
+  if (msg.resync) {
+    // subs got some msgs before the lost ones, they start over from next key frame with seq headers
+    clear_gop_caches();
+    for (auto sub : rtmp_subs_) { sub->set_has_sent_key_frame(false); }
+  }
+
+  // headers resent by a sync are the ones cached already, subs have got them
+  AvPacketPtr pkt = msg.pkt;
+  if (pkt == metadata_ || pkt == avc_header_ || pkt == aac_header_) { return; }
+
+  // same as a msg of rtmp pub, except the packet is built by the home group
+  if (pkt->is_metadata()) {
+    on_metadata(pkt);
+  } else {
+    on_av_packet(pkt);
+    cache_http_flv_gop(pkt);
+  }
+
+  send_http_flv_tag(pkt);
+}
+
+void Group::fanout_packet(AvPacketPtr pkt) {
+  if (!fanout_ || is_replica_) { return; }
+
+  keep_fanout_gop(pkt);
+  if (replicas_.empty()) { return; }
+
+  pkt->freeze();
+  for (auto &r : replicas_) {
+    if (r.resync) {
+      if (pkt->is_key_frame()) { sync_replica(r, std::vector<AvPacketPtr>(1, pkt)); }
+      continue;
+    }
+
+    FanoutMsg msg;
+    msg.replica = r.group;
+    msg.pkt = pkt;
+    if (!fanout_->send(shard_, r.shard, std::move(msg))) {
+      YET_LOG_WARN("Fanout ring full, replica resyncs at next key frame. live name:{}, shard:{}", live_name_, r.shard);
+      r.resync = true;
+    }
+  }
+}
+
+void Group::fanout_ctrl(FanoutMsgType type) {
+  if (!fanout_ || is_replica_) { return; }
+
+  for (auto &r : replicas_) {
+    FanoutMsg msg;
+    msg.type = type;
+    msg.replica = r.group;
+    if (!fanout_->send(shard_, r.shard, std::move(msg))) { r.resync = true; }
+  }
+}
+
+void Group::keep_fanout_gop(AvPacketPtr pkt) {
+  // seq headers and metadata are synced on their own
+  if (pkt->is_metadata() || pkt->is_seq_header()) { return; }
+
+  std::size_t max_bytes = Config::instance()->gop_cache_max_bytes();
+  if (pkt->is_key_frame()) {
+    fanout_gop_.clear();
+    fanout_gop_bytes_ = 0;
+  } else if (fanout_gop_.empty()) {
+    return;
+  }
+
+  // a gop too large is dropped as a whole, same as <GopCache>
+  if (Config::instance()->gop_cache_max_gop_num() == 0 || fanout_gop_bytes_ + pkt->payload_len() > max_bytes) {
+    fanout_gop_.clear();
+    fanout_gop_bytes_ = 0;
+    return;
+  }
+  fanout_gop_.push_back(pkt);
+  fanout_gop_bytes_ += pkt->payload_len();
+}
+
+void Group::sync_replica(Replica &r, const std::vector<AvPacketPtr> &pkts) {
+  std::vector<AvPacketPtr> all;
+  for (auto &pkt : { metadata_, avc_header_, aac_header_ }) {
+    if (pkt) { all.push_back(pkt); }
+  }
+  all.insert(all.end(), pkts.begin(), pkts.end());
+
+  r.resync = false;
+  for (std::size_t i = 0; i < all.size(); i++) {
+    all[i]->freeze();
+    FanoutMsg msg;
+    msg.replica = r.group;
+    msg.pkt = all[i];
+    msg.resync = i == 0;
+    if (!fanout_->send(shard_, r.shard, std::move(msg))) {
+      r.resync = true;
+      return;
+    }
+  }
 }
 
 void Group::set_http_flv_pull(HttpFlvPullPtr pull) {
@@ -41,31 +210,92 @@ void Group::set_http_flv_pull(HttpFlvPullPtr pull) {
 void Group::set_rtmp_pub(RtmpSessionPtr pub) {
   pub->set_rtmp_data_cb(std::bind(&Group::on_rtmp_data, this, _1, _2, _3));
   rtmp_pub_ = pub;
+  update_idle();
+
+  // subs are fed by rtmp pub from now on, gop remuxed from http flv pull is stale
+  clear_gop_caches();
 }
 
 void Group::reset_rtmp_pub() {
   rtmp_pub_.reset();
+  for (auto &it : rtmp_pushes_) { it->dispose(); }
+  rtmp_pushes_.clear();
+  clear_gop_caches();
+  update_idle();
+}
+
+void Group::clear_gop_caches() {
+  rtmp_gop_cache_.clear();
+  rtmp_gop_audio_in_sync_ = false;
+  rtmp_gop_video_in_sync_ = false;
+  http_flv_gop_cache_.clear();
+  fanout_gop_.clear();
+  fanout_gop_bytes_ = 0;
 }
 
 HttpFlvPullPtr Group::get_http_flv_pull() {
   return http_flv_pull_;
 }
 
+void Group::set_rtmp_pull(RtmpClientPtr pull) {
+  pull->set_group(shared_from_this());
+  rtmp_pull_ = pull;
+}
+
+RtmpClientPtr Group::get_rtmp_pull() {
+  return rtmp_pull_;
+}
+
+void Group::add_rtmp_push(RtmpClientPtr push) {
+  // the push may start after the pub, it gets the seq headers to send before its first key frame
+  for (auto &pkt : { metadata_, avc_header_, aac_header_ }) {
+    if (pkt) { push->on_packet(pkt); }
+  }
+  rtmp_pushes_.push_back(push);
+}
+
 void Group::add_http_flv_sub(HttpFlvSubPtr sub) {
   sub->set_group(shared_from_this());
   http_flv_subs_.insert(sub);
+  update_idle();
 }
 
 void Group::del_http_flv_sub(HttpFlvSubPtr sub) {
   http_flv_subs_.erase(sub);
+  update_idle();
 }
 
 void Group::add_rtmp_sub(RtmpSessionPtr sub) {
   rtmp_subs_.insert(sub);
+  update_idle();
+
+  sub->async_send(create_stream_begin());
+
+  // no gop cached, wait for next key frame in <on_rtmp_data>
+  if (rtmp_gop_cache_.empty()) { return; }
+
+  send_rtmp_seq_headers(sub);
+  rtmp_gop_cache_.for_each([&sub](BufferPtr chunks) { sub->async_send(chunks, true); });
+  sub->set_has_sent_key_frame(true);
+  sub->set_has_sent_audio(rtmp_gop_audio_in_sync_);
+  sub->set_has_sent_video(rtmp_gop_video_in_sync_);
 }
 
 void Group::del_rtmp_sub(RtmpSessionPtr sub) {
   rtmp_subs_.erase(sub);
+  update_idle();
+}
+
+void Group::update_idle() {
+  bool idle = !rtmp_pub_ && rtmp_subs_.empty() && http_flv_subs_.empty() && replicas_.empty();
+  if (idle && !idle_) { idle_since_ = std::chrono::steady_clock::now(); }
+  idle_ = idle;
+}
+
+uint64_t Group::idle_ms() const {
+  if (!idle_) { return 0; }
+
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - idle_since_).count();
 }
 
 
@@ -74,160 +304,375 @@ void Group::on_http_flv_pull_connected() {
 }
 
 void Group::on_http_flv_data(BufferPtr buf, const std::vector<FlvTagInfo> &tis) {
+  // rtmp pub takes over, the two streams must not be mixed
+  if (rtmp_pub_) { return; }
+
   for (auto sub : http_flv_subs_) {
     sub->async_send(buf, tis);
   }
+
+  cache_http_flv_gop(buf, tis);
+
+  remux_http_flv(buf, tis);
+}
+
+void Group::remux_http_flv(BufferPtr buf, const std::vector<FlvTagInfo> &tis) {
+  // tags are handed out in place if whole in <buf>, otherwise joined in <http_flv_tag_> first
+  if (http_flv_tag_miss_len_) {
+    std::size_t len = std::min(http_flv_tag_miss_len_, get_prefix_extra(buf, tis));
+    http_flv_tag_->append(buf->read_pos(), len);
+    http_flv_tag_miss_len_ -= len;
+    if (http_flv_tag_miss_len_ == 0) {
+      on_http_flv_tag(http_flv_tag_->read_pos());
+      http_flv_tag_.reset();
+    }
+  }
+
+  for (auto &ti : tis) {
+    std::size_t miss_len = check_tag_complete(buf, ti);
+    if (miss_len == 0) {
+      on_http_flv_tag(ti.tag_pos);
+      continue;
+    }
+
+    http_flv_tag_ = BufferPool::acquire(ti.tag_whole_size);
+    http_flv_tag_->append(ti.tag_pos, ti.tag_whole_size - miss_len);
+    http_flv_tag_miss_len_ = miss_len;
+  }
+}
+
+void Group::cache_http_flv_gop(BufferPtr buf, const std::vector<FlvTagInfo> &tis) {
+  // @NOTICE <buf> may begin or end in the middle of a tag, but all bufs make up a continuous flv stream,
+  //         so gop is cached as the stream from start of key frame tag.
+  //         only the bytes around a key frame are copied, others are shared.
+  uint8_t *pos = buf->read_pos();
+  for (auto &ti : tis) {
+    if (ti.tag_type != FLVTAGTYPE_VIDEO ||
+        !AvOp::is_video_key_frame(ti.tag_pos + FLV_TAG_HEADER_LEN, buf->write_pos() - ti.tag_pos - FLV_TAG_HEADER_LEN))
+    {
+      continue;
+    }
+
+    if (ti.tag_pos > pos) {
+      http_flv_gop_cache_.push(BufferPool::acquire(pos, ti.tag_pos - pos));
+    }
+    pos = ti.tag_pos;
+
+    // find end of this gop in <buf>
+    uint8_t *end = buf->write_pos();
+    for (auto &next : tis) {
+      if (next.tag_pos > pos && next.tag_type == FLVTAGTYPE_VIDEO &&
+          AvOp::is_video_key_frame(next.tag_pos + FLV_TAG_HEADER_LEN, buf->write_pos() - next.tag_pos - FLV_TAG_HEADER_LEN))
+      {
+        end = next.tag_pos;
+        break;
+      }
+    }
+    http_flv_gop_cache_.push_key_frame(BufferPool::acquire(pos, end - pos));
+    pos = end;
+  }
+
+  if (pos == buf->read_pos()) {
+    http_flv_gop_cache_.push(buf);
+  } else if (pos < buf->write_pos()) {
+    http_flv_gop_cache_.push(BufferPool::acquire(pos, buf->write_pos() - pos));
+  }
 }
 
 BufferPtr Group::get_metadata() {
+  if (rtmp_pub_ || rtmp_pull_ || is_replica_) { return metadata_ ? metadata_->flv_tag() : nullptr; }
+
   return http_flv_pull_ ? http_flv_pull_->get_metadata() : nullptr;
 }
 
 BufferPtr Group::get_video_seq_header() {
+  if (rtmp_pub_ || rtmp_pull_ || is_replica_) { return avc_header_ ? avc_header_->flv_tag() : nullptr; }
+
   return http_flv_pull_ ? http_flv_pull_->get_video_seq_header() : nullptr;
 }
 
-void Group::on_rtmp_data(RtmpSessionPtr pub, BufferPtr msg, const RtmpHeader &h) {
-  RtmpHeader *prev = h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO ? prev_audio_header_ : prev_video_header_;
-  //BufferPtr avc_header_chunks;
-  //BufferPtr aac_header_chunks;
-  BufferPtr delta_chunks;
-  BufferPtr abs_chunks;
+BufferPtr Group::get_audio_seq_header() {
+  if (rtmp_pub_ || rtmp_pull_ || is_replica_) { return aac_header_ ? aac_header_->flv_tag() : nullptr; }
 
-  for (auto sub : rtmp_subs_) {
-    if (!sub->has_sent_video()) {
-      if (avc_header_) {
-        //if (!avc_header_chunks) {
-        //  avc_header_chunks = RtmpChunkOp::msg2chunks(avc_header_, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
-        //}
+  return http_flv_pull_ ? http_flv_pull_->get_audio_seq_header() : nullptr;
+}
 
-        //YET_LOG_DEBUG("send avc header.");
-        sub->async_send(avc_header_);
+void Group::on_rtmp_data(RtmpSessionPtr pub, const uint8_t *msg, const RtmpHeader &h) {
+  AvPacketPtr pkt;
+  if (h.msg_type_id == RTMP_MSG_TYPE_ID_DATA_MESSAGE_AMF0) {
+    pkt = AvPacket::create(h, msg, nullptr);
+    on_metadata(pkt);
+  } else {
+    pkt = on_av_msg(h, msg);
+    cache_http_flv_gop(pkt);
+  }
 
-        sub->set_has_sent_video(true);
-      }
+  send_http_flv_tag(pkt);
+}
 
-    }
+void Group::on_rtmp_pull_data(const uint8_t *msg, const RtmpHeader &h) {
+  // rtmp pub takes over, the two streams must not be mixed
+  if (rtmp_pub_) { return; }
+
+  on_rtmp_data(nullptr, msg, h);
+}
 
-    if (!sub->has_sent_audio()) {
-      if (aac_header_) {
-        //if (!aac_header_chunks) {
-        //  aac_header_chunks = RtmpChunkOp::msg2chunks(aac_header_, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
-        //}
+void Group::on_rtmp_pull_start() {
+  if (rtmp_pub_) { return; }
 
-        //YET_LOG_DEBUG("send aac header.");
-        sub->async_send(aac_header_);
+  // msgs cached from the last session of the pull must not be mixed with the new one
+  clear_gop_caches();
+  on_rtmp_publish();
+}
 
-        sub->set_has_sent_audio(true);
-      }
+void Group::on_rtmp_pull_stop() {
+  if (rtmp_pub_) { return; }
+
+  on_rtmp_publish_stop();
+}
+
+void Group::on_http_flv_tag(const uint8_t *tag) {
+  RtmpHeader h;
+  h.msg_type_id = tag[0];
+  h.msg_len = chef::stuff_op::read_be_int(tag+1, 3);
+  h.timestamp = static_cast<uint32_t>(chef::stuff_op::read_be_int(tag+4, 3)) | (static_cast<uint32_t>(tag[7]) << 24);
+  h.msg_stream_id = RTMP_MSID;
+  const uint8_t *msg = tag + FLV_TAG_HEADER_LEN;
+
+  switch (h.msg_type_id) {
+  case RTMP_MSG_TYPE_ID_DATA_MESSAGE_AMF0:
+    h.csid = RTMP_CSID_OVER_STREAM;
+    on_metadata(AvPacket::create(h, msg, nullptr));
+    break;
+  case RTMP_MSG_TYPE_ID_AUDIO:
+    h.csid = RTMP_CSID_AUDIO;
+    on_av_msg(h, msg);
+    break;
+  case RTMP_MSG_TYPE_ID_VIDEO:
+    h.csid = RTMP_CSID_VIDEO;
+    on_av_msg(h, msg);
+    break;
+  default:
+    YET_LOG_WARN("Unknown flv tag type, ignore it. {}", h.msg_type_id);
+  }
+}
+
+AvPacketPtr Group::on_av_msg(const RtmpHeader &h, const uint8_t *msg) {
+  bool is_audio = h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO;
+  RtmpHeader *prev = is_audio ? prev_audio_header_ : prev_video_header_;
+
+  // each wire form is serialized at most once, on first use, then shared by all subs and gop cache
+  AvPacketPtr pkt = AvPacket::create(h, msg, prev);
+  Metrics::add(METRIC_AV_MSG_IN);
 
+  if (is_audio) {
+    if (!prev_audio_header_) { prev_audio_header_ = new RtmpHeader(); }
+
+    *prev_audio_header_ = h;
+  } else {
+    if (!prev_video_header_) { prev_video_header_ = new RtmpHeader(); }
+
+    *prev_video_header_ = h;
+  }
+
+  on_av_packet(pkt);
+  return pkt;
+}
+
+void Group::on_av_packet(AvPacketPtr pkt) {
+  bool is_audio = pkt->is_audio();
+  for (auto sub : rtmp_subs_) {
+    if (!sub->admit_av_msg(is_audio, pkt->is_key_frame(), pkt->is_non_ref_frame(), pkt->payload_len())) {
+      continue;
     }
 
     if (!sub->has_sent_key_frame()) {
-      if (h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO) {
-        //YET_LOG_DEBUG("audio waiting key frame.");
+      if (!pkt->is_key_frame()) {
+        //YET_LOG_DEBUG("waiting key frame.");
         continue;
-      } else if (h.msg_type_id == RTMP_MSG_TYPE_ID_VIDEO) {
-        if (msg->readable_size() > 1 && msg->read_pos()[0] == 0x17) {
-          sub->set_has_sent_key_frame(true);
-        } else {
-          //YET_LOG_DEBUG("video waiting key frame.");
-          continue;
-        }
       }
+
+      send_rtmp_seq_headers(sub);
+      sub->set_has_sent_key_frame(true);
     }
 
-    if ((h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO)) {
-      if (sub->has_sent_audio()) {
-        if (!delta_chunks) {
-          delta_chunks = RtmpChunkOp::msg2chunks(msg, h, prev, RTMP_LOCAL_CHUNK_SIZE);
-        }
-        //YET_LOG_DEBUG("send audio delta.");
-        sub->async_send(delta_chunks);
-      } else {
-        if (!abs_chunks) {
-          abs_chunks = RtmpChunkOp::msg2chunks(msg, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
-        }
-        sub->async_send(abs_chunks);
+    // has_sent_audio/video means last audio/video sent to sub is <prev>, so delta chunks can be sent
+    bool has_sent = is_audio ? sub->has_sent_audio() : sub->has_sent_video();
+    if (has_sent) {
+      //YET_LOG_DEBUG("send delta.");
+      sub->async_send(pkt->rtmp_delta_chunks(), true);
+    } else {
+      //YET_LOG_DEBUG("send abs.");
+      sub->async_send(pkt->rtmp_abs_chunks(), true);
 
-        //YET_LOG_DEBUG("send audio abs.");
+      if (is_audio) {
         sub->set_has_sent_audio(true);
-      }
-    } else {
-      if (sub->has_sent_video()) {
-        if (!delta_chunks) {
-          delta_chunks = RtmpChunkOp::msg2chunks(msg, h, prev, RTMP_LOCAL_CHUNK_SIZE);
-        }
-        //YET_LOG_DEBUG("send video delta.");
-        sub->async_send(delta_chunks);
       } else {
-        if (!abs_chunks) {
-          abs_chunks = RtmpChunkOp::msg2chunks(msg, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
-        }
-        //YET_LOG_DEBUG("send video abs.");
-        sub->async_send(abs_chunks);
-
         sub->set_has_sent_video(true);
       }
     }
+  }
+
+  // each push queues on its own, a slow downstream never holds the packet back from subs
+  for (auto &push : rtmp_pushes_) { push->on_packet(pkt); }
+
+  cache_rtmp_gop(pkt);
 
+  if (pkt->is_seq_header()) {
+    YET_LOG_DEBUG("Cache {} header.", is_audio ? "aac" : "avc");
+    (is_audio ? aac_header_ : avc_header_) = pkt;
   }
 
-  if (h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO) {
-    cache_aac_header(msg, h);
-    if (!prev_audio_header_) { prev_audio_header_ = new RtmpHeader(); }
+  fanout_packet(pkt);
+}
 
-    *prev_audio_header_ = h;
-  } else {
-    cache_avc_header(msg, h);
-    if (!prev_video_header_) { prev_video_header_ = new RtmpHeader(); }
+void Group::on_metadata(AvPacketPtr pkt) {
+  YET_LOG_DEBUG("Cache metadata.");
+  metadata_ = pkt;
 
-    *prev_video_header_ = h;
+  // subs still waiting for key frame get it with seq headers
+  for (auto sub : rtmp_subs_) {
+    if (sub->has_sent_key_frame()) { sub->async_send(pkt->rtmp_abs_chunks()); }
+  }
+  for (auto &push : rtmp_pushes_) { push->on_packet(pkt); }
+
+  fanout_packet(pkt);
+}
+
+void Group::send_http_flv_tag(AvPacketPtr pkt) {
+  if (http_flv_subs_.empty()) { return; }
+
+  // the tag buffer is shared by all subs, the same as a buffer from http flv pull which holds one whole tag
+  rtmp_tis_[0] = pkt->flv_tag_info();
+  BufferPtr tag = pkt->flv_tag();
+  for (auto sub : http_flv_subs_) {
+    sub->async_send(tag, rtmp_tis_);
   }
+}
 
+void Group::cache_http_flv_gop(AvPacketPtr pkt) {
+  // seq headers are cached and sent separately
+  if (pkt->is_seq_header()) { return; }
 
+  if (pkt->is_key_frame()) {
+    http_flv_gop_cache_.push_key_frame(pkt->flv_tag());
+  } else {
+    http_flv_gop_cache_.push(pkt->flv_tag());
+  }
 }
 
-void Group::cache_aac_header(BufferPtr msg, const RtmpHeader &h) {
-  uint8_t *p = msg->read_pos();
-  if (h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO && msg->readable_size() > 2 && (p[0] >> 4) == 0xa && p[1] == 0) {
-    YET_LOG_DEBUG("Cache aac header.");
-    //aac_header_ = std::make_shared<Buffer>(*msg);
-    aac_header_ = RtmpChunkOp::msg2chunks(msg, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
+void Group::cache_rtmp_gop(AvPacketPtr pkt) {
+  bool is_audio = pkt->is_audio();
+
+  // seq headers are cached and sent separately
+  if (pkt->is_seq_header()) {
+    (is_audio ? rtmp_gop_audio_in_sync_ : rtmp_gop_video_in_sync_) = false;
+    return;
+  }
+
+  // first audio/video of gop use abs chunks, the rest use delta chunks same as live, so the replay is a valid chunk stream
+  if (pkt->is_key_frame()) {
+    rtmp_gop_cache_.push_key_frame(pkt->rtmp_abs_chunks());
+    rtmp_gop_audio_in_sync_ = false;
+    rtmp_gop_video_in_sync_ = true;
+  } else if (!rtmp_gop_cache_.empty()) {
+    bool &in_sync = is_audio ? rtmp_gop_audio_in_sync_ : rtmp_gop_video_in_sync_;
+    if (in_sync) {
+      rtmp_gop_cache_.push(pkt->rtmp_delta_chunks());
+    } else {
+      rtmp_gop_cache_.push(pkt->rtmp_abs_chunks());
+      in_sync = true;
+    }
+  }
+
+  if (rtmp_gop_cache_.empty()) {
+    rtmp_gop_audio_in_sync_ = false;
+    rtmp_gop_video_in_sync_ = false;
   }
 }
 
-void Group::cache_avc_header(BufferPtr msg, const RtmpHeader &h) {
-  uint8_t *p = msg->read_pos();
-  if (h.msg_type_id == RTMP_MSG_TYPE_ID_VIDEO && msg->readable_size() > 2 && p[0] == 0x17 && p[1] == 0x0) {
-    YET_LOG_DEBUG("Cache avc header.");
-    //avc_header_ = std::make_shared<Buffer>(*msg);
-    avc_header_ = RtmpChunkOp::msg2chunks(msg, h, nullptr, RTMP_LOCAL_CHUNK_SIZE);
+void Group::send_rtmp_seq_headers(RtmpSessionPtr sub) {
+  // seq headers are abs chunks, next audio/video should be abs too
+  if (metadata_) {
+    sub->async_send(metadata_->rtmp_abs_chunks(), true);
+  }
+  if (avc_header_) {
+    //YET_LOG_DEBUG("send avc header.");
+    sub->async_send(avc_header_->rtmp_abs_chunks(), true);
   }
+  if (aac_header_) {
+    //YET_LOG_DEBUG("send aac header.");
+    sub->async_send(aac_header_->rtmp_abs_chunks(), true);
+  }
+  sub->set_has_sent_audio(false);
+  sub->set_has_sent_video(false);
 }
 
-void Group::on_rtmp_publish() {
+BufferPtr Group::create_stream_begin() {
   std::size_t len = RtmpPackOp::encode_rtmp_msg_user_control_stream_begin_reserve();
-  BufferPtr buf = std::make_shared<Buffer>(len);
+  BufferPtr buf = BufferPool::acquire(len);
   RtmpPackOp::encode_user_control_stream_begin(buf->write_pos());
   buf->seek_write_pos(len);
+  return buf;
+}
+
+void Group::on_rtmp_publish() {
+  BufferPtr buf = create_stream_begin();
   for (auto sub : rtmp_subs_) {
     sub->async_send(buf);
   }
+
+  fanout_ctrl(FANOUTMSGTYPE_PUBLISH);
 }
 
 void Group::on_rtmp_publish_stop() {
+  clear_gop_caches();
+
   std::size_t len = RtmpPackOp::encode_rtmp_msg_user_control_stream_eof_reserve();
-  BufferPtr buf = std::make_shared<Buffer>(len);
+  BufferPtr buf = BufferPool::acquire(len);
   RtmpPackOp::encode_user_control_stream_eof(buf->write_pos());
   buf->seek_write_pos(len);
   for (auto sub : rtmp_subs_) {
     sub->async_send(buf);
   }
+
+  fanout_ctrl(FANOUTMSGTYPE_PUBLISH_STOP);
+}
+
+GroupStat Group::stat() const {
+  GroupStat s;
+  s.live_name = live_name_;
+  s.has_rtmp_pub = rtmp_pub_ != nullptr;
+  s.has_http_flv_pull = http_flv_pull_ != nullptr;
+  s.has_rtmp_pull = rtmp_pull_ != nullptr;
+  s.rtmp_push_num = rtmp_pushes_.size();
+  s.rtmp_sub_num = rtmp_subs_.size();
+  s.http_flv_sub_num = http_flv_subs_.size();
+  for (auto &sub : rtmp_subs_) {
+    s.sub_queue_bytes += sub->send_queue_bytes();
+    s.sub_queue_max_bytes = std::max(s.sub_queue_max_bytes, sub->send_queue_bytes());
+    s.sub_dropped_frame_num += sub->send_queue_stat().dropped_frame_num;
+  }
+  for (auto &sub : http_flv_subs_) {
+    s.sub_queue_bytes += sub->send_queue_bytes();
+    s.sub_queue_max_bytes = std::max(s.sub_queue_max_bytes, sub->send_queue_bytes());
+    s.sub_dropped_frame_num += sub->send_queue_stat().dropped_frame_num;
+  }
+  s.gop_cache_bytes = rtmp_gop_cache_.bytes() + http_flv_gop_cache_.bytes();
+  s.cache_bytes = s.gop_cache_bytes;
+  if (metadata_)   { s.cache_bytes += metadata_->payload_len(); }
+  if (avc_header_) { s.cache_bytes += avc_header_->payload_len(); }
+  if (aac_header_) { s.cache_bytes += aac_header_->payload_len(); }
+  if (http_flv_pull_) { s.cache_bytes += http_flv_pull_->cache_bytes(); }
+  s.idle_ms = idle_ms();
+  s.shard = shard_;
+  s.is_replica = is_replica_;
+  s.replica_num = replicas_.size();
+  return s;
 }
 
 void Group::on_rtmp_session_close(RtmpSessionPtr session) {
-       if (session->type() == RTMP_SESSION_TYPE_PUB) { reset_rtmp_pub(); }
+       if (session == rtmp_pub_)                      { reset_rtmp_pub(); }
   else if (session->type() == RTMP_SESSION_TYPE_SUB) { del_rtmp_sub(session); }
 }
 
@@ -7,15 +7,38 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <unordered_set>
 #include "yet.hpp"
 #include "yet_http_flv/yet_http_flv_buffer_t.hpp"
 #include "yet_rtmp/yet_rtmp_chunk_op.h"
+#include "yet_gop_cache.h"
+#include "yet_fanout.h"
 
 namespace yet {
 
+struct GroupStat {
+  std::string live_name;
+  bool        has_rtmp_pub          = false;
+  bool        has_http_flv_pull     = false;
+  bool        has_rtmp_pull         = false;
+  std::size_t rtmp_push_num         = 0;
+  std::size_t rtmp_sub_num          = 0;
+  std::size_t http_flv_sub_num      = 0;
+  std::size_t sub_queue_bytes       = 0; // sum of send queues of all subs
+  std::size_t sub_queue_max_bytes   = 0; // the longest send queue
+  uint64_t    sub_dropped_frame_num = 0; // of subs present
+  std::size_t gop_cache_bytes       = 0;
+  std::size_t cache_bytes           = 0; // gop caches, seq headers and metadata
+  uint64_t    idle_ms               = 0; // since last pub or sub left, 0 if in use
+  std::size_t shard                 = 0; // io thread of the group
+  bool        is_replica            = false;
+  std::size_t replica_num           = 0; // of a home group
+};
+
+
 class Group : public std::enable_shared_from_this<Group> {
   public:
     explicit Group(const std::string &live_name);
@@ -23,36 +46,107 @@ class Group : public std::enable_shared_from_this<Group> {
 
     void dispose();
 
+    const std::string &live_name() const { return live_name_; }
+
+    /// subs of one live name may be in every io thread, each thread has a group of the live name.
+    /// the one in the home thread of the live name gets the stream from pub or pull,
+    /// the others are replicas which serve their local subs with msgs fanned out from it.
+    /// @param shard index of the io thread of this group
+    void set_fanout(Fanout *fanout, std::size_t shard, bool is_replica);
+    bool is_replica() const { return is_replica_; }
+
+    /// @NOTICE called in the home thread, the replica is synced with seq headers and the latest gop first.
+    ///         replicas are kept as weak refs, a replica is released in its own thread only
+    void add_replica(std::size_t shard, std::weak_ptr<Group> replica);
+    void del_replica(std::size_t shard, std::weak_ptr<Group> replica);
+
+    /// @NOTICE called in the thread of the replica
+    void on_fanout_msg(const FanoutMsg &msg);
+
     void set_http_flv_pull(HttpFlvPullPtr pull);
     void reset_http_flv_pull();
     HttpFlvPullPtr get_http_flv_pull();
 
+    void set_rtmp_pull(RtmpClientPtr pull);
+    RtmpClientPtr get_rtmp_pull();
+
+    /// pushes of the rtmp pub, disposed when the pub stops
+    void add_rtmp_push(RtmpClientPtr push);
+
     void add_http_flv_sub(HttpFlvSubPtr sub);
     void del_http_flv_sub(HttpFlvSubPtr sub);
 
     void set_rtmp_pub(RtmpSessionPtr pub);
     void reset_rtmp_pub();
+    bool has_rtmp_pub() const { return rtmp_pub_ != nullptr; }
 
     void add_rtmp_sub(RtmpSessionPtr sub);
     void del_rtmp_sub(RtmpSessionPtr sub);
 
+    /// cached tags for http flv subs, from rtmp pub, rtmp pull or home group if any, otherwise from http flv pull
     BufferPtr get_metadata();
     BufferPtr get_video_seq_header();
+    BufferPtr get_audio_seq_header();
+    const GopCache &get_http_flv_gop_cache() const { return http_flv_gop_cache_; }
 
     void on_rtmp_publish();
     void on_rtmp_publish_stop();
 
+    GroupStat stat() const;
+
+    /// no rtmp pub, no sub and no replica, a pull alone does not keep the group in use
+    bool is_idle() const { return idle_; }
+
+    /// @return ms since the group became idle, 0 if in use
+    uint64_t idle_ms() const;
+
   public:
     void on_http_flv_pull_connected();
     void on_http_flv_data(BufferPtr buf, const std::vector<FlvTagInfo> &tis);
 
   public:
-    void on_rtmp_data(RtmpSessionPtr pub, BufferPtr msg, const RtmpHeader &h);
+    void on_rtmp_data(RtmpSessionPtr pub, const uint8_t *msg, const RtmpHeader &h);
     void on_rtmp_session_close(RtmpSessionPtr session);
 
+  public:
+    /// msgs of rtmp pull go the same way as of rtmp pub, unless a pub takes over
+    void on_rtmp_pull_data(const uint8_t *msg, const RtmpHeader &h);
+    /// the pull started playing or dropped, subs are told as for an rtmp pub which starts or stops
+    void on_rtmp_pull_start();
+    void on_rtmp_pull_stop();
+
+  private:
+    /// fan out an audio/video msg of either source to rtmp subs, cache it for rtmp subs
+    /// @return packet of the msg
+    AvPacketPtr on_av_msg(const RtmpHeader &h, const uint8_t *msg);
+    /// the part of <on_av_msg> after the packet is built, shared with replicas
+    void on_av_packet(AvPacketPtr pkt);
+    void on_metadata(AvPacketPtr pkt);
+    void send_http_flv_tag(AvPacketPtr pkt);
+    void remux_http_flv(BufferPtr buf, const std::vector<FlvTagInfo> &tis);
+    /// @param tag whole flv tag
+    void on_http_flv_tag(const uint8_t *tag);
+    void cache_rtmp_gop(AvPacketPtr pkt);
+    void cache_http_flv_gop(AvPacketPtr pkt);
+    void cache_http_flv_gop(BufferPtr buf, const std::vector<FlvTagInfo> &tis);
+    void clear_gop_caches();
+    void send_rtmp_seq_headers(RtmpSessionPtr sub);
+    BufferPtr create_stream_begin();
+    /// called whenever pub, subs or replicas change
+    void update_idle();
+
   private:
-    void cache_avc_header(BufferPtr msg, const RtmpHeader &h);
-    void cache_aac_header(BufferPtr msg, const RtmpHeader &h);
+    struct Replica {
+      std::size_t          shard;
+      std::weak_ptr<Group> group;
+      bool                 resync; // msgs were lost, nothing goes to it until next key frame
+    };
+
+    void fanout_packet(AvPacketPtr pkt);
+    void fanout_ctrl(FanoutMsgType type);
+    void keep_fanout_gop(AvPacketPtr pkt);
+    /// sends metadata, seq headers and <pkts>, the replica drops what it has and restarts from them
+    void sync_replica(Replica &r, const std::vector<AvPacketPtr> &pkts);
 
   private:
     Group(const Group &) = delete;
@@ -61,13 +155,31 @@ class Group : public std::enable_shared_from_this<Group> {
   private:
     const std::string                  live_name_;
     HttpFlvPullPtr                     http_flv_pull_;
+    RtmpClientPtr                      rtmp_pull_;
+    std::vector<RtmpClientPtr>         rtmp_pushes_;
     RtmpSessionPtr                     rtmp_pub_;
     std::unordered_set<HttpFlvSubPtr>  http_flv_subs_;
     std::unordered_set<RtmpSessionPtr> rtmp_subs_;
     RtmpHeader                         *prev_audio_header_=nullptr;
     RtmpHeader                         *prev_video_header_=nullptr;
-    BufferPtr                          avc_header_;
-    BufferPtr                          aac_header_;
+    AvPacketPtr                        metadata_;
+    AvPacketPtr                        avc_header_;
+    AvPacketPtr                        aac_header_;
+    std::vector<FlvTagInfo>            rtmp_tis_; // info of the one tag sent to http flv subs, reused
+    BufferPtr                          http_flv_tag_; // tag from http flv pull which is not complete yet
+    std::size_t                        http_flv_tag_miss_len_ = 0;
+    GopCache                           rtmp_gop_cache_;
+    bool                               rtmp_gop_audio_in_sync_ = false; // whether last audio is the tail audio of gop cache
+    bool                               rtmp_gop_video_in_sync_ = false;
+    GopCache                           http_flv_gop_cache_;
+    bool                               idle_ = true;
+    std::chrono::steady_clock::time_point idle_since_;
+    Fanout                             *fanout_ = nullptr; // null if only one io thread
+    std::size_t                        shard_ = 0;
+    bool                               is_replica_ = false;
+    std::vector<Replica>               replicas_;
+    std::vector<AvPacketPtr>           fanout_gop_; // latest gop of a home group, to sync new replicas
+    std::size_t                        fanout_gop_bytes_ = 0;
 };
 
 }
@@ -115,4 +115,14 @@ class TagCacheVideoSeqHeader : public TagCacheBase {
     }
 };
 
+class TagCacheAudioSeqHeader : public TagCacheBase {
+  public:
+    TagCacheAudioSeqHeader() : TagCacheBase(true, BUF_INIT_LEN_METADATA, BUF_SHRINK_LEN_METADATA) {}
+    virtual ~TagCacheAudioSeqHeader() {}
+
+    bool is_target_tag(const FlvTagInfo &ti) {
+      return ti.tag_type == FLVTAGTYPE_AUDIO && (*(ti.tag_pos + 11) >> 4) == 0xa && *(ti.tag_pos + 12) == 0x00;
+    }
+};
+
 }
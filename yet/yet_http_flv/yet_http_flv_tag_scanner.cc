@@ -0,0 +1,47 @@
+#include "yet_http_flv_tag_scanner.h"
+#include "chef_base/chef_stuff_op.hpp"
+
+namespace yet {
+
+static constexpr std::size_t ENSURE_PREFIX_OF_AUDIO_DATA = 3;
+static constexpr std::size_t ENSURE_PREFIX_OF_VIDEO_DATA = 5;
+
+std::size_t FlvTagScanner::scan(uint8_t *p, std::size_t len, std::vector<FlvTagInfo> &tis) {
+  tis.clear();
+
+  std::size_t rs = len;
+  for (; rs; ) {
+    if (substage_ == SUBSTAGE_TAG_HEADER) {
+      if (rs < FLV_TAG_HEADER_LEN) { return rs; }
+
+      // tag caches check prefix of av data, keep it with the header
+      uint8_t tag_type = *p;
+      if (tag_type == FLVTAGTYPE_VIDEO && rs < FLV_TAG_HEADER_LEN + ENSURE_PREFIX_OF_VIDEO_DATA) { return rs; }
+      if (tag_type == FLVTAGTYPE_AUDIO && rs < FLV_TAG_HEADER_LEN + ENSURE_PREFIX_OF_AUDIO_DATA) { return rs; }
+
+      FlvTagInfo ti;
+      ti.tag_pos = p;
+      ti.tag_type = static_cast<FlvTagType>(tag_type);
+      tag_size_ = chef::stuff_op::read_be_int(p+1, 3) + FLV_TAG_HEADER_LEN;
+      tag_data_size_ = tag_size_ - FLV_TAG_HEADER_LEN + FLV_PREV_TAG_SIZE_LEN;
+      ti.tag_whole_size = tag_data_size_ + FLV_TAG_HEADER_LEN;
+      tis.push_back(ti);
+
+      rs -= FLV_TAG_HEADER_LEN;
+      p += FLV_TAG_HEADER_LEN;
+      substage_ = SUBSTAGE_TAG_DATA;
+    } else {
+      if (rs < tag_data_size_) {
+        tag_data_size_ -= rs;
+        return 0;
+      }
+
+      rs -= tag_data_size_;
+      p += tag_data_size_;
+      substage_ = SUBSTAGE_TAG_HEADER;
+    }
+  }
+  return 0;
+}
+
+}
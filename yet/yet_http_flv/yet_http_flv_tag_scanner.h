@@ -0,0 +1,53 @@
+/**
+ * @file   yet_http_flv_tag_scanner.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include "yet_http_flv/yet_http_flv_buffer_t.hpp"
+
+namespace yet {
+
+/// splits flv body into tags without copy, data of one tag may cross multi calls of <scan>
+class FlvTagScanner {
+  public:
+    /// @param tis cleared first, then filled with tags whose header begins in <p>
+    ///
+    /// @return len of unscanned tail, which is an incomplete tag header,
+    ///         caller should pass it again at the head of next call
+    std::size_t scan(uint8_t *p, std::size_t len, std::vector<FlvTagInfo> &tis);
+
+    /// bytes of the last scanned tag not scanned yet, 0 if it is complete
+    std::size_t tag_left() const { return substage_ == SUBSTAGE_TAG_DATA ? tag_data_size_ : 0; }
+
+    /// PreviousTagSizeN of the last scanned tag, header and data
+    uint32_t tag_size() const { return tag_size_; }
+
+    /// starts over with a new flv body
+    void reset() {
+      substage_ = SUBSTAGE_TAG_HEADER;
+      tag_data_size_ = 0;
+    }
+
+  public:
+    FlvTagScanner() {}
+
+  private:
+    FlvTagScanner(const FlvTagScanner &) = delete;
+    FlvTagScanner &operator=(const FlvTagScanner &) = delete;
+
+  private:
+    enum Substage {
+      SUBSTAGE_TAG_HEADER = 0,
+      SUBSTAGE_TAG_DATA = 1
+    };
+
+    enum Substage substage_ = SUBSTAGE_TAG_HEADER;
+    std::size_t   tag_data_size_ = 0; // left of current tag, with PreviousTagSizeN
+    uint32_t      tag_size_ = 0;
+};
+
+}
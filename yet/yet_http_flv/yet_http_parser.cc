@@ -0,0 +1,239 @@
+#include "yet_http_parser.h"
+#include <algorithm>
+#include <cstring>
+
+namespace yet {
+
+static inline char to_lower_ascii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static inline bool is_ows(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static inline bool is_token_char(char c) {
+  if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) { return true; }
+  return strchr("!#$%&'*+-.^_`|~", c) != nullptr && c != '\0';
+}
+
+static inline bool iequals(const char *p, std::size_t len, const char *s) {
+  std::size_t i = 0;
+  for (; i < len && s[i]; i++) {
+    if (to_lower_ascii(p[i]) != to_lower_ascii(s[i])) { return false; }
+  }
+  return i == len && s[i] == '\0';
+}
+
+/// calls <fn> with each trimmed non empty element of a comma separated list
+template <typename Fn>
+static void for_each_list_element(const char *b, const char *e, Fn fn) {
+  while (b < e) {
+    const char *comma = static_cast<const char *>(memchr(b, ',', e - b));
+    const char *eb = b;
+    const char *ee = comma ? comma : e;
+    for (; eb < ee && is_ows(*eb); eb++);
+    for (; ee > eb && is_ows(*(ee-1)); ee--);
+    if (ee > eb) { fn(eb, ee); }
+    b = comma ? comma + 1 : e;
+  }
+}
+
+bool HttpSlice::equals(const char *s) const {
+  return strlen(s) == len && memcmp(data, s, len) == 0;
+}
+
+bool HttpSlice::iequals(const char *s) const {
+  return yet::iequals(data, len, s);
+}
+
+bool HttpSlice::has_suffix(const char *s) const {
+  std::size_t sl = strlen(s);
+  return sl <= len && memcmp(data + len - sl, s, sl) == 0;
+}
+
+HttpParseResult HttpParser::parse(const char *p, std::size_t len) {
+  if (done_) { return HTTP_PARSE_DONE; }
+
+  base_ = p;
+  for (;;) {
+    const char *b = p + pos_;
+    const char *from = p + std::max(pos_, scanned_);
+    const char *lf = static_cast<const char *>(memchr(from, '\n', p + len - from));
+    if (!lf) {
+      scanned_ = len;
+      return len < HTTP_HEAD_MAX_LEN ? HTTP_PARSE_AGAIN : HTTP_PARSE_ERROR;
+    }
+    if (static_cast<std::size_t>(lf - p) >= HTTP_HEAD_MAX_LEN) { return HTTP_PARSE_ERROR; }
+
+    // bare LF is taken as a line end too
+    const char *e = (lf > b && *(lf-1) == '\r') ? lf - 1 : lf;
+    pos_ = lf - p + 1;
+    scanned_ = pos_;
+
+    if (!has_start_line_) {
+      // empty lines before a request are ignored, some clients send an extra CRLF after a body
+      if (e == b && type_ == HTTP_PARSER_TYPE_REQUEST) { continue; }
+
+      bool ok = type_ == HTTP_PARSER_TYPE_REQUEST ? parse_request_line(b, e) : parse_status_line(b, e);
+      if (!ok) { return HTTP_PARSE_ERROR; }
+      has_start_line_ = true;
+      continue;
+    }
+
+    if (e == b) {
+      if (chunked_ && content_length_ >= 0) { return HTTP_PARSE_ERROR; }
+      done_ = true;
+      return HTTP_PARSE_DONE;
+    }
+
+    if (!parse_header_line(b, e)) { return HTTP_PARSE_ERROR; }
+  }
+}
+
+void HttpParser::reset() {
+  base_ = nullptr;
+  pos_ = 0;
+  scanned_ = 0;
+  has_start_line_ = false;
+  done_ = false;
+  method_ = target_ = path_ = query_ = Span();
+  status_code_ = 0;
+  version_minor_ = 0;
+  header_num_ = 0;
+  conn_close_ = false;
+  conn_keep_alive_ = false;
+  chunked_ = false;
+  content_length_ = -1;
+}
+
+HttpSlice HttpParser::header(const char *name) const {
+  for (std::size_t i = 0; i < header_num_; i++) {
+    if (header_name(i).iequals(name)) { return header_value(i); }
+  }
+  return HttpSlice();
+}
+
+bool HttpParser::keep_alive() const {
+  if (conn_close_) { return false; }
+  return version_minor_ >= 1 || conn_keep_alive_;
+}
+
+bool HttpParser::find_query_param(HttpSlice query, const char *key, HttpSlice &value) {
+  std::size_t key_len = strlen(key);
+  const char *b = query.data;
+  const char *e = query.data + query.len;
+  while (b < e) {
+    const char *amp = static_cast<const char *>(memchr(b, '&', e - b));
+    const char *pe = amp ? amp : e;
+    const char *eq = static_cast<const char *>(memchr(b, '=', pe - b));
+    const char *ke = eq ? eq : pe;
+    if (static_cast<std::size_t>(ke - b) == key_len && memcmp(b, key, key_len) == 0) {
+      value = eq ? HttpSlice(eq + 1, pe - eq - 1) : HttpSlice(pe, 0);
+      return true;
+    }
+    b = amp ? amp + 1 : e;
+  }
+  return false;
+}
+
+HttpParser::Span HttpParser::span(const char *b, const char *e) const {
+  Span s;
+  s.off = static_cast<uint32_t>(b - base_);
+  s.len = static_cast<uint32_t>(e - b);
+  return s;
+}
+
+bool HttpParser::parse_request_line(const char *b, const char *e) {
+  // method SP request-target SP HTTP-version
+  const char *p = b;
+  for (; p < e && is_token_char(*p); p++);
+  if (p == b || p == e || *p != ' ') { return false; }
+  method_ = span(b, p);
+
+  const char *tb = ++p;
+  for (; p < e && *p != ' '; p++) {
+    if (static_cast<unsigned char>(*p) <= 0x20 || *p == 0x7f) { return false; }
+  }
+  if (p == tb || p == e) { return false; }
+  target_ = span(tb, p);
+
+  const char *q = static_cast<const char *>(memchr(tb, '?', p - tb));
+  path_ = span(tb, q ? q : p);
+  if (q) { query_ = span(q + 1, p); }
+
+  return parse_version(p + 1, e);
+}
+
+bool HttpParser::parse_status_line(const char *b, const char *e) {
+  // HTTP-version SP status-code SP [ reason-phrase ]
+  const char *sp = static_cast<const char *>(memchr(b, ' ', e - b));
+  if (!sp || !parse_version(b, sp)) { return false; }
+
+  const char *p = sp + 1;
+  if (e - p < 3) { return false; }
+  status_code_ = 0;
+  for (int i = 0; i < 3; i++, p++) {
+    if (*p < '0' || *p > '9') { return false; }
+    status_code_ = status_code_ * 10 + (*p - '0');
+  }
+  return p == e || *p == ' ';
+}
+
+bool HttpParser::parse_version(const char *b, const char *e) {
+  static constexpr char prefix[] = "HTTP/1.";
+  static constexpr std::size_t prefix_len = sizeof(prefix) - 1;
+  if (static_cast<std::size_t>(e - b) != prefix_len + 1 || memcmp(b, prefix, prefix_len) != 0) { return false; }
+
+  char minor = b[prefix_len];
+  if (minor < '0' || minor > '9') { return false; }
+  version_minor_ = minor - '0';
+  return true;
+}
+
+bool HttpParser::parse_header_line(const char *b, const char *e) {
+  // field-name ":" OWS field-value OWS, obsolete line folding is not accepted
+  const char *p = b;
+  for (; p < e && is_token_char(*p); p++);
+  if (p == b || p == e || *p != ':') { return false; }
+  if (header_num_ == HTTP_MAX_HEADER_NUM) { return false; }
+
+  const char *vb = p + 1;
+  const char *ve = e;
+  for (; vb < ve && is_ows(*vb); vb++);
+  for (; ve > vb && is_ows(*(ve-1)); ve--);
+
+  Header &h = headers_[header_num_++];
+  h.name = span(b, p);
+  h.value = span(vb, ve);
+
+  std::size_t name_len = p - b;
+  if (iequals(b, name_len, "connection")) {
+    for_each_list_element(vb, ve, [this](const char *tb, const char *te) {
+      if (iequals(tb, te - tb, "close")) { conn_close_ = true; }
+      if (iequals(tb, te - tb, "keep-alive")) { conn_keep_alive_ = true; }
+    });
+  } else if (iequals(b, name_len, "transfer-encoding")) {
+    // chunked must be the last coding
+    bool last_chunked = false;
+    for_each_list_element(vb, ve, [&last_chunked](const char *tb, const char *te) {
+      last_chunked = iequals(tb, te - tb, "chunked");
+    });
+    // length of a request body is unknown otherwise
+    if (!last_chunked && type_ == HTTP_PARSER_TYPE_REQUEST) { return false; }
+    chunked_ = last_chunked;
+  } else if (iequals(b, name_len, "content-length")) {
+    if (vb == ve || ve - vb > 18) { return false; }
+    int64_t cl = 0;
+    for (const char *d = vb; d < ve; d++) {
+      if (*d < '0' || *d > '9') { return false; }
+      cl = cl * 10 + (*d - '0');
+    }
+    // the same value repeated is fine, different ones are not
+    if (content_length_ >= 0 && content_length_ != cl) { return false; }
+    content_length_ = cl;
+  }
+  return true;
+}
+
+}
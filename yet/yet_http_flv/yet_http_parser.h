@@ -0,0 +1,143 @@
+/**
+ * @file   yet_http_parser.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cinttypes>
+#include <string>
+
+namespace yet {
+
+/// max len of a request or response head, status line and headers with the empty line
+static constexpr std::size_t HTTP_HEAD_MAX_LEN   = 8192;
+static constexpr std::size_t HTTP_MAX_HEADER_NUM = 32;
+
+/// bytes in the buffer being parsed, no copy
+struct HttpSlice {
+  const char  *data = nullptr;
+  std::size_t len   = 0;
+
+  HttpSlice() {}
+  HttpSlice(const char *d, std::size_t l) : data(d), len(l) {}
+
+  bool empty() const { return len == 0; }
+  bool equals(const char *s) const;
+  bool iequals(const char *s) const; // ascii case insensitive
+  bool has_suffix(const char *s) const;
+  std::string str() const { return std::string(data, len); }
+};
+
+enum HttpParserType {
+  HTTP_PARSER_TYPE_REQUEST  = 1,
+  HTTP_PARSER_TYPE_RESPONSE = 2
+};
+
+enum HttpParseResult {
+  HTTP_PARSE_DONE  = 0, // whole head is parsed, see <HttpParser::head_len>
+  HTTP_PARSE_AGAIN = 1, // more bytes are needed
+  HTTP_PARSE_ERROR = 2
+};
+
+/// incremental parser of a http/1.x message head, nothing is allocated or copied.
+///
+/// the head is passed as it grows, from its first byte on each call, and lines parsed already are not scanned again.
+/// parsed parts are kept as offsets, and the slices returned refer to the buffer of the last <parse>,
+/// so the buffer may be moved or grown between calls as long as its bytes stay the same.
+///
+/// only the head is parsed, body of the message is up to the caller, see <content_length> and <chunked>.
+class HttpParser {
+  public:
+    explicit HttpParser(HttpParserType type) : type_(type) {}
+
+    /// @param p   head of the message, the same bytes as of last call followed by the newly received ones
+    /// @param len over <HTTP_HEAD_MAX_LEN> without the end of head is an error
+    HttpParseResult parse(const char *p, std::size_t len);
+
+    /// starts over with a new message, e.g. the next one on a kept alive connection
+    void reset();
+
+    /// bytes of the whole head, the body or the next message follows, valid after <HTTP_PARSE_DONE>
+    std::size_t head_len() const { return pos_; }
+
+    /// of a request
+    HttpSlice method() const { return slice(method_); }
+    HttpSlice target() const { return slice(target_); }
+    HttpSlice path() const { return slice(path_); }
+    HttpSlice query() const { return slice(query_); } // after '?' of the target, empty if none
+
+    /// of a response
+    int status_code() const { return status_code_; }
+
+    /// x of HTTP/1.x
+    int version_minor() const { return version_minor_; }
+
+    std::size_t header_num() const { return header_num_; }
+    HttpSlice header_name(std::size_t i) const { return slice(headers_[i].name); }
+    HttpSlice header_value(std::size_t i) const { return slice(headers_[i].value); }
+
+    /// value of the first header named <name>, case insensitive, empty if none
+    HttpSlice header(const char *name) const;
+
+    /// whether the connection is kept after this message, by version and `Connection` header
+    bool keep_alive() const;
+
+    /// whether `Transfer-Encoding` ends with chunked
+    bool chunked() const { return chunked_; }
+
+    /// -1 if no `Content-Length`
+    int64_t content_length() const { return content_length_; }
+
+  public:
+    /// value of <key> in <query> as `k1=v1&k2=v2`, raw without percent decoding, empty value for a key without '='
+    /// @return false if <key> is not found
+    static bool find_query_param(HttpSlice query, const char *key, HttpSlice &value);
+
+  private:
+    struct Span {
+      uint32_t off = 0;
+      uint32_t len = 0;
+    };
+
+    struct Header {
+      Span name;
+      Span value;
+    };
+
+    HttpSlice slice(const Span &s) const { return HttpSlice(base_ + s.off, s.len); }
+    Span span(const char *b, const char *e) const;
+
+    bool parse_request_line(const char *b, const char *e);
+    bool parse_status_line(const char *b, const char *e);
+    bool parse_version(const char *b, const char *e);
+    bool parse_header_line(const char *b, const char *e);
+
+  private:
+    HttpParser(const HttpParser &) = delete;
+    HttpParser &operator=(const HttpParser &) = delete;
+
+  private:
+    const HttpParserType type_;
+    const char           *base_ = nullptr;
+    std::size_t          pos_ = 0;          // begin of next line to parse, or len of head when done
+    std::size_t          scanned_ = 0;      // no line end in [pos_, scanned_)
+    bool                 has_start_line_ = false;
+    bool                 done_ = false;
+    Span                 method_;
+    Span                 target_;
+    Span                 path_;
+    Span                 query_;
+    int                  status_code_ = 0;
+    int                  version_minor_ = 0;
+    Header               headers_[HTTP_MAX_HEADER_NUM];
+    std::size_t          header_num_ = 0;
+    bool                 conn_close_ = false;
+    bool                 conn_keep_alive_ = false;
+    bool                 chunked_ = false;
+    int64_t              content_length_ = -1;
+};
+
+}
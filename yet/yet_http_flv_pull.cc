@@ -2,22 +2,35 @@
 #include <asio.hpp>
 #include "yet.hpp"
 #include "yet_group.h"
-#include "chef_base/chef_strings_op.hpp"
+#include "yet_config.h"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_common/yet_metrics.h"
 #include "chef_base/chef_stuff_op.hpp"
 #include "chef_base/chef_stringify_stl.hpp"
 
-#define SNIPPET_HANDLE_CB_ERROR if (ec) { YET_LOG_ERROR("ec:{}", ec.message()); return; }
+#define SNIPPET_HANDLE_CB_ERROR \
+  do { \
+    if (ec) { \
+      if (ec != asio::error::operation_aborted) { YET_LOG_ERROR("{} ec:{}", __func__, ec.message()); } \
+      retry(); \
+      return; \
+    } \
+  } while(0);
 
 namespace yet {
 
 HttpFlvPull::HttpFlvPull(asio::io_context &io_context, const std::string &server, const std::string &path)
-  : resolver_(io_context)
+  : server_(server)
+  , resolver_(io_context)
   , socket_(io_context)
-  , in_buf_(std::make_shared<chef::buffer>(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ, BUF_SHRINK_LEN_HTTP_FLV_PULL_EACH_READ))
+  , retry_timer_(io_context)
+  , in_buf_(BufferPool::acquire(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ))
+  , response_parser_(HTTP_PARSER_TYPE_RESPONSE)
 {
   YET_LOG_DEBUG("HttpFlvPull() {}.", (void *)this);
 
-  std::ostream request_stream(&request_);
+  // kept to be written again on each reconnect
+  std::ostringstream request_stream;
   request_stream << "GET " << path << " HTTP/1.0\r\n";
   //request_stream << "User-Agent: yet/0.0.1" << path << " HTTP/1.0\r\n";
   request_stream << "Accept: */*\r\n";
@@ -25,14 +38,82 @@ HttpFlvPull::HttpFlvPull(asio::io_context &io_context, const std::string &server
   request_stream << "Connection: close\r\n";
   request_stream << "Host: " << server << "\r\n";
   request_stream << "Icy-MetaData: 1\r\n\r\n";
-
-  resolver_.async_resolve(server, "http", std::bind(&HttpFlvPull::resolve_cb, this, _1, _2));
+  request_ = request_stream.str();
 }
 
 HttpFlvPull::~HttpFlvPull() {
   YET_LOG_DEBUG("~HttpFlvPull() {}.", (void *)this);
 }
 
+void HttpFlvPull::start() {
+  do_connect();
+}
+
+void HttpFlvPull::do_connect() {
+  resolver_.async_resolve(server_, "http", std::bind(&HttpFlvPull::resolve_cb, shared_from_this(), _1, _2));
+}
+
+void HttpFlvPull::dispose() {
+  YET_LOG_DEBUG("Dispose http flv pull. {}", (void *)this);
+  disposed_ = true;
+  resolver_.cancel();
+  retry_timer_.cancel();
+  ErrorCode ec;
+  socket_.close(ec);
+}
+
+void HttpFlvPull::retry() {
+  if (disposed_) { return; }
+
+  ErrorCode ec;
+  socket_.close(ec);
+  complete_torn_tag();
+  scanner_.reset();
+  in_buf_ = BufferPool::acquire(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ);
+
+  uint32_t delay_ms = Config::instance()->pull_retry_delay_ms(retry_num_);
+  retry_num_++;
+
+  YET_LOG_WARN("Http flv pull retry. server:{}, retry num:{}, delay:{}ms", server_, retry_num_, delay_ms);
+  Metrics::add(METRIC_HTTP_FLV_PULL_RETRY);
+
+  auto self = shared_from_this();
+  retry_timer_.expires_after(std::chrono::milliseconds(delay_ms));
+  retry_timer_.async_wait([this, self](const ErrorCode &timer_ec) {
+    if (timer_ec || disposed_) { return; }
+
+    stage_ = STAGE_HTTP_HEAD;
+    response_parser_.reset();
+    do_connect();
+  });
+}
+
+void HttpFlvPull::complete_torn_tag() {
+  // subs got the head of the tag already, the rest of data is filled with zeros, and the next session starts at a tag
+  std::size_t len = stage_ == STAGE_FLV_BODY ? scanner_.tag_left() : 0;
+  if (len == 0) { return; }
+
+  uint8_t prev_tag_size[FLV_PREV_TAG_SIZE_LEN];
+  uint32_t tag_size = scanner_.tag_size();
+  for (std::size_t i = 0; i < FLV_PREV_TAG_SIZE_LEN; i++) { prev_tag_size[i] = tag_size >> (8 * (FLV_PREV_TAG_SIZE_LEN-1-i)); }
+
+  BufferPtr filler = BufferPool::acquire(len);
+  uint8_t *p = filler->write_pos();
+  std::size_t prev_len = std::min(len, FLV_PREV_TAG_SIZE_LEN);
+  memset(p, 0, len - prev_len);
+  memcpy(p + len - prev_len, prev_tag_size + FLV_PREV_TAG_SIZE_LEN - prev_len, prev_len);
+  filler->seek_write_pos(len);
+  tis_.clear();
+  tcmd_.on_buffer(filler, tis_);
+  tcvsh_.on_buffer(filler, tis_);
+  tcash_.on_buffer(filler, tis_);
+  if (auto group = group_.lock()) {
+    group->on_http_flv_data(filler, tis_);
+  }
+
+  session_head_ = true;
+}
+
 void HttpFlvPull::resolve_cb(const ErrorCode &ec, const asio::ip::tcp::resolver::results_type &endpoints) {
   SNIPPET_HANDLE_CB_ERROR;
   asio::async_connect(socket_, endpoints, std::bind(&HttpFlvPull::connect_cb, shared_from_this(), _1));
@@ -40,7 +121,7 @@ void HttpFlvPull::resolve_cb(const ErrorCode &ec, const asio::ip::tcp::resolver:
 
 void HttpFlvPull::connect_cb(const ErrorCode &ec) {
   SNIPPET_HANDLE_CB_ERROR;
-  asio::async_write(socket_, request_, std::bind(&HttpFlvPull::write_request_cb, shared_from_this(), _1));
+  asio::async_write(socket_, asio::buffer(request_), std::bind(&HttpFlvPull::write_request_cb, shared_from_this(), _1));
 }
 
 void HttpFlvPull::write_request_cb(const ErrorCode &ec) {
@@ -49,6 +130,7 @@ void HttpFlvPull::write_request_cb(const ErrorCode &ec) {
 }
 
 void HttpFlvPull::do_read_header_stuff() {
+  in_buf_->reserve(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ);
   socket_.async_read_some(asio::buffer(in_buf_->write_pos(), BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ),
                           std::bind(&HttpFlvPull::read_header_stuff_cb, shared_from_this(), _1, _2));
 }
@@ -57,53 +139,50 @@ void HttpFlvPull::read_header_stuff_cb(const ErrorCode &ec, std::size_t len) {
   SNIPPET_HANDLE_CB_ERROR;
 
   in_buf_->seek_write_pos(len);
+  Metrics::add(METRIC_HTTP_FLV_BYTES_IN, len);
   YET_LOG_DEBUG("len:{} {}", len, in_buf_->readable_size());
 
   for (; in_buf_->readable_size(); ) {
-    if (stage_ == STAGE_HTTP_STATUS_LINE) {
-      uint8_t *q = in_buf_->find_crlf();
-      if (q) {
-        uint8_t *p = in_buf_->read_pos();
-        std::string status_line = std::string((const char *)p, q-p);
-        YET_LOG_DEBUG("{}", status_line);
-
-        auto sls = chef::strings_op::split(status_line, " ");
-        if (sls.size() != 3 ||
-            !chef::strings_op::has_prefix(sls[0], "HTTP/") || sls[1] != "200" || sls[2] != "OK")
-        {
-          YET_LOG_ERROR("Invalid status line, {}", status_line);
-          return;
-        }
-
-        in_buf_->erase(q-p+2);
-        stage_ = STAGE_HTTP_HEADERS;
+    if (stage_ == STAGE_HTTP_HEAD) {
+      HttpParseResult r = response_parser_.parse(reinterpret_cast<const char *>(in_buf_->read_pos()), in_buf_->readable_size());
+      if (r == HTTP_PARSE_AGAIN) { break; }
+
+      // body is read as a bare flv stream till the end, the request is http/1.0 not to get it chunked
+      if (r == HTTP_PARSE_ERROR || response_parser_.status_code() != 200 || response_parser_.chunked()) {
+        std::size_t dump_len = std::min<std::size_t>(in_buf_->readable_size(), 64);
+        YET_LOG_ERROR("Invalid http response. status:{}, chunked:{}, {}", response_parser_.status_code(),
+                      response_parser_.chunked(), std::string((const char *)in_buf_->read_pos(), dump_len));
+        retry();
+        return;
       }
-    } else if (stage_ == STAGE_HTTP_HEADERS) {
-      uint8_t *q = in_buf_->find((const uint8_t *)"\r\n\r\n", 4);
-      if (q) {
-        uint8_t *p = in_buf_->read_pos();
-        std::string headers = std::string((const char *)p, q-p);
-        YET_LOG_DEBUG("{}", headers);
-        in_buf_->erase(q-p+4);
-        stage_ = STAGE_FLV_HEADER;
-
-        if (auto group = group_.lock()) {
-          group->on_http_flv_pull_connected();
-        }
+
+      in_buf_->erase(response_parser_.head_len());
+      response_parser_.reset();
+      stage_ = STAGE_FLV_HEADER;
+
+      if (auto group = group_.lock()) {
+        group->on_http_flv_pull_connected();
       }
     } else if (stage_ == STAGE_FLV_HEADER) {
-      if (in_buf_->readable_size() < 13) { return; }
+      if (in_buf_->readable_size() < 13) { break; }
 
       uint8_t *p = in_buf_->read_pos();
       if (*p != 'F' || *(p+1) != 'L' || *(p+2) != 'V' ||
           chef::stuff_op::read_be_int(p+5, 4) != FLV_HEADER_FLV_VERSION
       ) {
         YET_LOG_ERROR("Invalid flv header. {}", chef::stuff_op::bytes_to_hex(in_buf_->read_pos(), 32, 16));
+        retry();
         return;
       }
 
+      // subs are on the body of the first session, flv header of a reconnect is not theirs
       in_buf_->erase(13);
       stage_ = STAGE_FLV_BODY;
+      if (retry_num_ > 0) {
+        session_head_ = true;
+        rebase_pending_ = true;
+        rebase_floor_ts_ = last_ts_;
+      }
     } else if (stage_ == STAGE_FLV_BODY) {
       flv_body_handler();
       return;
@@ -116,76 +195,38 @@ void HttpFlvPull::read_header_stuff_cb(const ErrorCode &ec, std::size_t len) {
 void HttpFlvPull::do_read_flv_body() {
   std::size_t len = BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ - in_buf_->readable_size();
   in_buf_->reserve(len);
-  socket_.async_read_some(asio::buffer(in_buf_->write_pos(), len), std::bind(&HttpFlvPull::read_flv_body_cb, shared_from_this(), _1, _2));
+  socket_.async_read_some(asio::buffer(in_buf_->write_pos(), len),
+                          make_pooled_handler(std::bind(&HttpFlvPull::read_flv_body_cb, shared_from_this(), _1, _2)));
 }
 
 void HttpFlvPull::read_flv_body_cb(const ErrorCode &ec, std::size_t len) {
   SNIPPET_HANDLE_CB_ERROR;
   //YET_LOG_DEBUG("{}", len);
   in_buf_->seek_write_pos(len);
+  Metrics::add(METRIC_HTTP_FLV_BYTES_IN, len);
   flv_body_handler();
 }
 
 void HttpFlvPull::flv_body_handler() {
-  static constexpr std::size_t ENSURE_PREFIX_OF_AUDIO_DATA = 3;
-  static constexpr std::size_t ENSURE_PREFIX_OF_VIDEO_DATA = 5;
-
-  std::vector<FlvTagInfo> tis;
-
-  std::size_t rs = in_buf_->readable_size();
-  uint8_t *p = in_buf_->read_pos();
-  for (; rs; ) {
-    if (substage_ == SUBSTAGE_TAG_HEADER) {
-      if (rs < FLV_TAG_HEADER_LEN) { break; }
-
-      uint8_t tag_type = *p;
-
-      if (tag_type == FLVTAGTYPE_VIDEO && (rs < FLV_TAG_HEADER_LEN + ENSURE_PREFIX_OF_VIDEO_DATA)) {
-        YET_LOG_INFO("CHEFNOTICEME.");
-        break;
-      }
-      if (tag_type == FLVTAGTYPE_AUDIO && (rs < FLV_TAG_HEADER_LEN + ENSURE_PREFIX_OF_AUDIO_DATA)) {
-        YET_LOG_INFO("CHEFNOTICEME.");
-        break;
-      }
-
-      FlvTagInfo ti;
-      ti.tag_pos = p;
-      ti.tag_type = static_cast<FlvTagType>(tag_type);
-      tag_data_size_ = chef::stuff_op::read_be_int(p+1, 3);
-      ti.tag_whole_size = tag_data_size_ + FLV_TAG_HEADER_LEN + 4;
-
-      tis.push_back(ti);
-      rs -= FLV_TAG_HEADER_LEN;
-      p += FLV_TAG_HEADER_LEN;
-      substage_ = SUBSTAGE_TAG_DATA;
-    } else if (substage_ == SUBSTAGE_TAG_DATA) {
-      if (rs < (tag_data_size_ + 4)) {
-        tag_data_size_ -= rs;
-        rs = 0;
-        p += rs;
-        break;
-      }
-
-      rs -= (tag_data_size_ + 4);
-      p += tag_data_size_ + 4;
-      substage_ = SUBSTAGE_TAG_HEADER;
-    }
-  }
+  // reused, not to allocate per read
+  std::vector<FlvTagInfo> &tis = tis_;
+  std::size_t rs = scanner_.scan(in_buf_->read_pos(), in_buf_->readable_size(), tis);
 
   BufferPtr ref_buffer = in_buf_;
-  in_buf_ = std::make_shared<Buffer>(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ);
+  in_buf_ = BufferPool::acquire(BUF_INIT_LEN_HTTP_FLV_PULL_EACH_READ);
 
-  if (substage_ == SUBSTAGE_TAG_HEADER && rs > 0) {
-    YET_LOG_ASSERT(rs < FLV_TAG_HEADER_LEN + ENSURE_PREFIX_OF_VIDEO_DATA, "{}", rs);
+  if (rs > 0) {
     in_buf_->append(ref_buffer->write_pos()-rs, rs);
     ref_buffer->seek_write_pos_rollback(rs);
   }
 
+  continue_stream(ref_buffer, tis);
+
   //YET_LOG_DEBUG("on_http_flv_data {} {}", chef::stringify_stl(tis), ref_buffer->readable_size());
   if (ref_buffer->readable_size()) {
     tcmd_.on_buffer(ref_buffer, tis);
     tcvsh_.on_buffer(ref_buffer, tis);
+    tcash_.on_buffer(ref_buffer, tis);
 
     if (auto group = group_.lock()) {
       group->on_http_flv_data(ref_buffer, tis);
@@ -195,6 +236,73 @@ void HttpFlvPull::flv_body_handler() {
   do_read_flv_body();
 }
 
+static uint32_t read_tag_timestamp(const uint8_t *tag) {
+  return static_cast<uint32_t>(chef::stuff_op::read_be_int(tag+4, 3)) | (static_cast<uint32_t>(tag[7]) << 24);
+}
+
+static void write_tag_timestamp(uint8_t *tag, uint32_t ts) {
+  // lower 24 bits in big endian, then the extended upper 8 bits
+  tag[4] = static_cast<uint8_t>(ts >> 16);
+  tag[5] = static_cast<uint8_t>(ts >> 8);
+  tag[6] = static_cast<uint8_t>(ts);
+  tag[7] = static_cast<uint8_t>(ts >> 24);
+}
+
+void HttpFlvPull::continue_stream(BufferPtr buf, std::vector<FlvTagInfo> &tis) {
+  for (auto iter = tis.begin(); iter != tis.end(); ) {
+    bool is_header = iter->tag_type == FLVTAGTYPE_METADATA || tcvsh_.is_target_tag(*iter) || tcash_.is_target_tag(*iter);
+    if (!is_header) {
+      // the upstream is back with av data, next failure starts over from min delay
+      session_head_ = false;
+      retry_num_ = 0;
+    }
+
+    // a header the subs have got is cut out of the buffer, which is not handed out yet
+    if (is_header && session_head_ && is_cached_header(buf, *iter)) {
+      uint8_t *end = iter->tag_pos + iter->tag_whole_size;
+      memmove(iter->tag_pos, end, buf->write_pos() - end);
+      buf->seek_write_pos_rollback(iter->tag_whole_size);
+      for (auto next = iter+1; next != tis.end(); ++next) { next->tag_pos -= iter->tag_whole_size; }
+      iter = tis.erase(iter);
+      continue;
+    }
+
+    // the first av tag after a reconnect goes on right after the last one before it, the others follow it,
+    // a tag a bit earlier than it is held at the floor
+    uint32_t ts = read_tag_timestamp(iter->tag_pos);
+    if (rebase_pending_ && !is_header) {
+      ts_offset_ = static_cast<int64_t>(rebase_floor_ts_) - ts;
+      rebase_pending_ = false;
+    }
+    int64_t rebased = rebase_pending_ ? rebase_floor_ts_ : std::max<int64_t>(ts + ts_offset_, rebase_floor_ts_);
+    if (rebased != ts) { write_tag_timestamp(iter->tag_pos, static_cast<uint32_t>(rebased)); }
+
+    last_ts_ = std::max(last_ts_, static_cast<uint32_t>(rebased));
+    ++iter;
+  }
+}
+
+bool HttpFlvPull::is_cached_header(BufferPtr buf, const FlvTagInfo &ti) {
+  if (check_tag_complete(buf, ti) != 0) { return false; }
+
+  BufferPtr cached = ti.tag_type == FLVTAGTYPE_METADATA ? tcmd_.buf() :
+                     ti.tag_type == FLVTAGTYPE_VIDEO    ? tcvsh_.buf() : tcash_.buf();
+
+  // timestamp aside
+  const uint8_t *p = cached->read_pos();
+  return cached->readable_size() == ti.tag_whole_size &&
+         memcmp(p, ti.tag_pos, 4) == 0 &&
+         memcmp(p+8, ti.tag_pos+8, ti.tag_whole_size-8) == 0;
+}
+
+std::size_t HttpFlvPull::cache_bytes() {
+  std::size_t bytes = 0;
+  for (auto &buf : { get_metadata(), get_video_seq_header(), get_audio_seq_header() }) {
+    if (buf) { bytes += buf->readable_size(); }
+  }
+  return bytes;
+}
+
 BufferPtr HttpFlvPull::get_metadata() {
   return tcmd_.buf();
 }
@@ -203,6 +311,10 @@ BufferPtr HttpFlvPull::get_video_seq_header() {
   return tcvsh_.buf();
 }
 
+BufferPtr HttpFlvPull::get_audio_seq_header() {
+  return tcash_.buf();
+}
+
 void HttpFlvPull::set_group(std::weak_ptr<Group> group) {
   group_ = group;
 }
@@ -10,9 +10,17 @@
 #include <asio.hpp>
 #include "yet.hpp"
 #include "yet_http_flv/yet_http_flv_buffer_t.hpp"
+#include "yet_http_flv/yet_http_flv_tag_scanner.h"
+#include "yet_http_flv/yet_http_parser.h"
 
 namespace yet {
 
+/// pulls a flv stream over http from upstream, and hands the body to the group as is, see <Group::on_http_flv_data>.
+///
+/// if the upstream fails, it reconnects with backoff, see <Config::pull_retry_min_ms>,
+/// and the new body goes on the same stream for subs:
+/// timestamps are rebased to go on from the last tag, metadata and seq headers equal to the cached ones are dropped,
+/// and a tag torn by the failure is completed with zeros, so the stream stays parseable.
 class HttpFlvPull : public std::enable_shared_from_this<HttpFlvPull> {
   public:
     HttpFlvPull(asio::io_context& io_context, const std::string& server, const std::string& path);
@@ -20,12 +28,20 @@ class HttpFlvPull : public std::enable_shared_from_this<HttpFlvPull> {
 
     void set_group(std::weak_ptr<Group> group);
 
-    void dispose() {}
+    void start();
+
+    /// stops resolving, connecting, reading and retrying, the pull is released when pending handlers are done
+    void dispose();
+
+    /// bytes of cached metadata and seq headers
+    std::size_t cache_bytes();
 
     BufferPtr get_metadata();
     BufferPtr get_video_seq_header();
+    BufferPtr get_audio_seq_header();
 
   private:
+    void do_connect();
     void resolve_cb(const ErrorCode &ec, const asio::ip::tcp::resolver::results_type &endpoints);
     void connect_cb(const ErrorCode &ec);
     void write_request_cb(const ErrorCode &ec);
@@ -37,35 +53,46 @@ class HttpFlvPull : public std::enable_shared_from_this<HttpFlvPull> {
   private:
     void flv_body_handler();
 
+    /// closes the connection of a failed upstream, and connects again after a backoff
+    void retry();
+    void complete_torn_tag();
+
+    /// rebase timestamps of <tis>, and drop the ones which repeat cached metadata or seq headers after a reconnect
+    void continue_stream(BufferPtr buf, std::vector<FlvTagInfo> &tis);
+    bool is_cached_header(BufferPtr buf, const FlvTagInfo &ti);
+
   private:
     HttpFlvPull(const HttpFlvPull &) = delete;
     HttpFlvPull &operator=(const HttpFlvPull &) = delete;
 
   private:
     enum Stage {
-      STAGE_HTTP_STATUS_LINE = 0,
-      STAGE_HTTP_HEADERS = 1,
-      STAGE_FLV_HEADER = 2,
-      STAGE_FLV_BODY = 3
-    };
-
-    enum Substage {
-      SUBSTAGE_TAG_HEADER = 0,
-      SUBSTAGE_ENSURE_PREFIX_OF_DATA = 1,
-      SUBSTAGE_TAG_DATA = 2
+      STAGE_HTTP_HEAD = 0,
+      STAGE_FLV_HEADER = 1,
+      STAGE_FLV_BODY = 2
     };
 
+    std::string             server_;
+    std::string             request_;
     asio::ip::tcp::resolver resolver_;
     asio::ip::tcp::socket   socket_;
+    asio::steady_timer      retry_timer_;
     std::weak_ptr<Group>    group_;
     BufferPtr               in_buf_;
+    FlvTagScanner           scanner_;
+    std::vector<FlvTagInfo> tis_;
     TagCacheMetadata        tcmd_;
     TagCacheVideoSeqHeader  tcvsh_;
-    asio::streambuf         request_;
-    asio::streambuf         response_;
-    enum Stage              stage_ = STAGE_HTTP_STATUS_LINE;
-    enum Substage           substage_ = SUBSTAGE_TAG_HEADER;
-    std::size_t             tag_data_size_ = 0;
+    TagCacheAudioSeqHeader  tcash_;
+    HttpParser              response_parser_;
+    enum Stage              stage_ = STAGE_HTTP_HEAD;
+    bool                    disposed_ = false;
+    uint32_t                retry_num_ = 0;           // failures in a row
+    bool                    session_head_ = false;    // no av tag of the body yet after a reconnect
+    bool                    rebase_pending_ = false;  // offset is taken at the first av tag after a reconnect
+    uint32_t                rebase_floor_ts_ = 0;     // last timestamp before the reconnect
+    int64_t                 ts_offset_ = 0;
+    uint32_t                last_ts_ = 0;
 };
 
 }
@@ -1,5 +1,7 @@
 #include "yet_http_flv_server.h"
 #include <asio.hpp>
+#include "yet_common/yet_acceptor.hpp"
+#include "yet_common/yet_metrics.h"
 #include "yet_config.h"
 #include "yet_server.h"
 #include "yet_group.h"
@@ -9,13 +11,35 @@
 
 namespace yet {
 
-HttpFlvServer::HttpFlvServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server)
+namespace {
+
+/// prometheus label value, backslash, double quote and line feed are escaped
+static std::string escape_label_value(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (c == '\n') {
+      escaped.append("\\n");
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+}
+
+HttpFlvServer::HttpFlvServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server,
+                             bool reuse_port)
   : io_ctx_(io_ctx)
   , listen_ip_(listen_ip)
   , listen_port_(listen_port)
   , server_(server)
-  , acceptor_(io_ctx_, asio::ip::tcp::endpoint(asio::ip::address_v4::from_string(listen_ip_), listen_port_))
+  , acceptor_(io_ctx_)
 {
+  open_acceptor(acceptor_, listen_ip_, listen_port_, reuse_port);
   YET_LOG_DEBUG("HttpFlvServer() {}.", (void *)this);
 }
 
@@ -33,8 +57,9 @@ void HttpFlvServer::accept_cb(const ErrorCode &ec, asio::ip::tcp::socket socket)
     return;
   }
 
-  auto pull = std::make_shared<HttpFlvSub>(std::move(socket), shared_from_this());
-  pull->start();
+  Metrics::add(METRIC_HTTP_FLV_CONN_ACCEPTED);
+  auto sub = std::make_shared<HttpFlvSub>(std::move(socket), shared_from_this());
+  sub->start();
 
   do_accept();
 }
@@ -49,21 +74,67 @@ void HttpFlvServer::dispose() {
   acceptor_.close();
 }
 
+asio::io_context *HttpFlvServer::get_http_flv_io_ctx(const std::string &live_name) {
+  return &server_->get_sub_io_ctx(live_name);
+}
+
 void HttpFlvServer::on_http_flv_request(HttpFlvSubPtr sub, const std::string &uri, const std::string &app_name,
                                         const std::string &live_name, const std::string &host)
 {
-  auto group = server_->get_or_create_group(live_name);
-
-  auto in = group->get_http_flv_pull();
-  if (in) {
-    YET_LOG_DEBUG("on_http_flv_request. {} in exist.", live_name);
-  } else {
-    YET_LOG_DEBUG("on_http_flv_request. {} create in.", live_name);
-    in = std::make_shared<HttpFlvPull>(io_ctx_, Config::instance()->http_flv_pull_host(), uri);
-    group->set_http_flv_pull(in);
-  }
-
+  auto group = server_->get_or_create_sub_group(live_name, app_name, uri);
   group->add_http_flv_sub(sub);
 }
 
+void HttpFlvServer::on_http_stats_request(HttpFlvSubPtr sub, bool with_groups) {
+  server_->async_collect_group_stats(io_ctx_, [sub, with_groups](const std::vector<GroupStat> &stats) {
+    fmt::memory_buffer out;
+    Metrics::dump(out);
+
+    std::size_t idle_num = 0;
+    uint64_t cache_bytes = 0;
+    for (auto &s : stats) {
+      if (s.idle_ms) { idle_num++; }
+      cache_bytes += s.cache_bytes;
+    }
+    fmt::format_to(out, "# TYPE yet_groups gauge\nyet_groups {}\n", stats.size());
+    fmt::format_to(out, "# TYPE yet_groups_idle gauge\nyet_groups_idle {}\n", idle_num);
+    fmt::format_to(out, "# TYPE yet_groups_cache_bytes gauge\nyet_groups_cache_bytes {}\n", cache_bytes);
+    if (!with_groups) {
+      sub->send_response("text/plain; version=0.0.4", std::string(out.data(), out.size()));
+      return;
+    }
+
+    // one gauge per group field, labeled by live name and io thread, as a live name has a group in each thread with its subs
+    struct Field {
+      const char *name;
+      uint64_t   (*get)(const GroupStat &s);
+    };
+    static const Field fields[] = {
+      { "yet_group_rtmp_pub",              [](const GroupStat &s) -> uint64_t { return s.has_rtmp_pub; } },
+      { "yet_group_http_flv_pull",         [](const GroupStat &s) -> uint64_t { return s.has_http_flv_pull; } },
+      { "yet_group_rtmp_pull",             [](const GroupStat &s) -> uint64_t { return s.has_rtmp_pull; } },
+      { "yet_group_rtmp_pushes",           [](const GroupStat &s) -> uint64_t { return s.rtmp_push_num; } },
+      { "yet_group_rtmp_subs",             [](const GroupStat &s) -> uint64_t { return s.rtmp_sub_num; } },
+      { "yet_group_http_flv_subs",         [](const GroupStat &s) -> uint64_t { return s.http_flv_sub_num; } },
+      { "yet_group_sub_queue_bytes",       [](const GroupStat &s) -> uint64_t { return s.sub_queue_bytes; } },
+      { "yet_group_sub_queue_max_bytes",   [](const GroupStat &s) -> uint64_t { return s.sub_queue_max_bytes; } },
+      { "yet_group_sub_dropped_frames",    [](const GroupStat &s) -> uint64_t { return s.sub_dropped_frame_num; } },
+      { "yet_group_gop_cache_bytes",       [](const GroupStat &s) -> uint64_t { return s.gop_cache_bytes; } },
+      { "yet_group_cache_bytes",           [](const GroupStat &s) -> uint64_t { return s.cache_bytes; } },
+      { "yet_group_idle_ms",               [](const GroupStat &s) -> uint64_t { return s.idle_ms; } },
+      { "yet_group_replica",               [](const GroupStat &s) -> uint64_t { return s.is_replica; } },
+      { "yet_group_replicas",              [](const GroupStat &s) -> uint64_t { return s.replica_num; } },
+    };
+    for (auto &field : fields) {
+      fmt::format_to(out, "# TYPE {} gauge\n", field.name);
+      for (auto &s : stats) {
+        fmt::format_to(out, "{}{{live=\"{}\",shard=\"{}\"}} {}\n", field.name, escape_label_value(s.live_name), s.shard,
+                       field.get(s));
+      }
+    }
+
+    sub->send_response("text/plain; version=0.0.4", std::string(out.data(), out.size()));
+  });
+}
+
 }
@@ -19,7 +19,8 @@ class HttpFlvServer : public std::enable_shared_from_this<HttpFlvServer>
                     , public HttpFlvSubObserver
 {
   public:
-    HttpFlvServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server);
+    HttpFlvServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server,
+                  bool reuse_port=false);
     virtual ~HttpFlvServer();
 
     void start();
@@ -31,9 +32,13 @@ class HttpFlvServer : public std::enable_shared_from_this<HttpFlvServer>
     void accept_cb(const ErrorCode &ec, asio::ip::tcp::socket socket);
 
   private:
+    virtual asio::io_context *get_http_flv_io_ctx(const std::string &live_name);
+
     virtual void on_http_flv_request(HttpFlvSubPtr sub, const std::string &uri, const std::string &app_name,
                                      const std::string &live_name, const std::string &host);
 
+    virtual void on_http_stats_request(HttpFlvSubPtr sub, bool with_groups);
+
   private:
     HttpFlvServer(const HttpFlvServer &) = delete;
     HttpFlvServer &operator=(const HttpFlvServer &) = delete;
@@ -1,20 +1,44 @@
 #include "yet_http_flv_sub.h"
+#include <unistd.h>
+#include <array>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <asio.hpp>
 #include "yet_http_flv_pull.h"
 #include "yet_group.h"
 #include "yet.hpp"
-#include "chef_base/chef_strings_op.hpp"
+#include "yet_config.h"
+#include "yet_common/yet_av_op.hpp"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_common/yet_metrics.h"
+#include "yet_http_flv/yet_http_flv.hpp"
 #include "chef_base/chef_stuff_op.hpp"
 
-#define SNIPPET_HANDLE_CB_ERROR if (ec) { YET_LOG_ERROR("ec:{}", ec.message()); return; }
+#define SNIPPET_HANDLE_CB_ERROR if (ec) { YET_LOG_ERROR("ec:{}", ec.message()); close(); return; }
 
 namespace yet {
 
+static constexpr char CRLF[] = "\r\n";
+
+static const char *http_reason_phrase(int status_code) {
+  switch (status_code) {
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  }
+  return "Unknown";
+}
+
 HttpFlvSub::HttpFlvSub(asio::ip::tcp::socket socket, std::weak_ptr<HttpFlvSubObserver> obs)
   : socket_(std::move(socket))
   , obs_(obs)
-  , request_buf_(1024)
+  , request_buf_(BufferPool::acquire(HTTP_HEAD_MAX_LEN))
+  , request_parser_(HTTP_PARSER_TYPE_REQUEST)
+  , request_timer_(socket_.get_executor().context())
+  , send_buffers_(SEND_BATCH_MAX_BUF_NUM, SEND_BATCH_MAX_BYTES,
+                  Config::instance()->sub_queue_max_bytes(), Config::instance()->sub_queue_max_delay_ms())
 {
   YET_LOG_DEBUG("HttpFlvSub() {}.", static_cast<void *>(this));
 }
@@ -25,130 +49,267 @@ HttpFlvSub::~HttpFlvSub() {
 
 
 void HttpFlvSub::start() {
-  asio::async_read_until(socket_, request_buf_, "\r\n\r\n", std::bind(&HttpFlvSub::request_handler, shared_from_this(), _1, _2));
+  start_time_ = std::chrono::steady_clock::now();
+  start_request_timer();
+  do_read_request();
 }
 
-void HttpFlvSub::request_handler(const ErrorCode &ec, std::size_t len) {
-  YET_LOG_DEBUG("ec:{} len:{}", ec.message(), len);
+void HttpFlvSub::start_request_timer() {
+  // armed once for each head, not on each read, so a head trickling in byte by byte is cut off all the same
+  request_timer_.expires_after(std::chrono::milliseconds(Config::instance()->http_request_timeout_ms()));
+  request_timer_.async_wait(std::bind(&HttpFlvSub::request_timeout_cb, shared_from_this(), _1));
+}
 
-  using namespace chef;
+void HttpFlvSub::do_read_request() {
+  std::size_t len = HTTP_HEAD_MAX_LEN - request_buf_->readable_size();
+  request_buf_->reserve(len);
+  socket_.async_read_some(asio::buffer(request_buf_->write_pos(), len),
+                          std::bind(&HttpFlvSub::request_handler, shared_from_this(), _1, _2));
+}
 
-  std::string status_line;
-  std::string uri;
-  std::string app_name;
-  std::string live_name;
-  std::string host;
+void HttpFlvSub::request_timeout_cb(const ErrorCode &ec) {
+  if (ec) { return; }
 
-  std::istream request_stream(&request_buf_);
-  if (!std::getline(request_stream, status_line) || status_line.empty() || status_line.back() != '\r') {
-    YET_LOG_ERROR("request status line failed. {}", status_line);
+  YET_LOG_DEBUG("Http request timeout. {}", static_cast<void *>(this));
+  close();
+}
+
+void HttpFlvSub::request_handler(const ErrorCode &ec, std::size_t len) {
+  if (ec) {
+    // a kept alive connection is closed by the client normally
+    if (ec != asio::error::eof && ec != asio::error::operation_aborted) { YET_LOG_ERROR("ec:{}", ec.message()); }
+    close();
     return;
   }
-  YET_LOG_DEBUG("status line:{}", status_line);
-  auto sls = strings_op::split(status_line, ' ');
-  if (sls.size() != 3 || strings_op::to_upper(sls[0]) != "GET") {
-    YET_LOG_ERROR("request status line failed. {}", status_line);
+
+  request_buf_->seek_write_pos(len);
+  handle_request_buf();
+}
+
+void HttpFlvSub::handle_request_buf() {
+  switch (request_parser_.parse(reinterpret_cast<const char *>(request_buf_->read_pos()), request_buf_->readable_size())) {
+  case HTTP_PARSE_AGAIN:
+    do_read_request();
+    return;
+  case HTTP_PARSE_ERROR: {
+    request_timer_.cancel();
+    std::size_t dump_len = std::min<std::size_t>(request_buf_->readable_size(), 32);
+    YET_LOG_ERROR("Invalid http request. {}", chef::stuff_op::bytes_to_hex(request_buf_->read_pos(), dump_len, 16));
+    keep_alive_ = false;
+    send_error(400);
     return;
   }
-  uri = sls[1];
-  auto ukv = strings_op::split(uri, '/', false);
-  if (ukv.empty() || ukv.size() < 2 || !chef::strings_op::has_suffix(ukv[ukv.size()-1], ".flv")) {
-    YET_LOG_ERROR("request status line failed. {}", status_line);
+  case HTTP_PARSE_DONE:
+    request_timer_.cancel();
+    handle_request();
     return;
   }
-  app_name = ukv[ukv.size()-2];
-  live_name = chef::strings_op::trim_suffix(ukv[ukv.size()-1], ".flv");
+}
+
+void HttpFlvSub::handle_request() {
+  const HttpParser &req = request_parser_;
+  HttpSlice path = req.path();
+  YET_LOG_DEBUG("{} {}", req.method().str(), req.target().str());
 
-  std::string header;
-  while (std::getline(request_stream, header) && !header.empty() && header != "\r") {
-    header.erase(header.length()-1); // erase '\r'
-    YET_LOG_DEBUG("{}", header);
+  // a request with body is not expected, the connection is not kept, not to take the body as next request
+  keep_alive_ = req.keep_alive() && req.content_length() <= 0 && !req.chunked();
+
+  if (!req.method().equals("GET")) {
+    keep_alive_ = false;
+    send_error(405);
+    return;
+  }
 
-    auto hkv = strings_op::split(header, ':', false, true);
-    if (hkv.size() != 2) { continue; }
+  if (path.equals("/stats")) {
+    HttpSlice groups;
+    bool with_groups = !HttpParser::find_query_param(req.query(), "groups", groups) || !groups.equals("0");
+    request_buf_->erase(req.head_len());
+    request_parser_.reset();
+    if (auto obs = obs_.lock()) { obs->on_http_stats_request(shared_from_this(), with_groups); }
+    return;
+  }
 
-    auto k = strings_op::to_lower(strings_op::trim_right(strings_op::trim_left(hkv[0])));
-    auto v = strings_op::to_lower(strings_op::trim_right(strings_op::trim_left(hkv[1])));
-    if (k == "host") {
-      host = v;
-      break;
+  // .../<app>/<live>.flv, query string is kept in uri, which goes upstream with a pull
+  const char *slash = nullptr;
+  const char *prev_slash = nullptr;
+  for (const char *p = path.data; p < path.data + path.len; p++) {
+    if (*p == '/') {
+      prev_slash = slash;
+      slash = p;
     }
   }
-  YET_LOG_INFO("uri:{}, app:{}, live:{}, host:{}", uri, app_name, live_name, host);
+  const char *path_end = path.data + path.len;
+  if (!prev_slash || slash - prev_slash < 2 || !path.has_suffix(".flv") ||
+      path_end - slash - 1 <= static_cast<std::ptrdiff_t>(strlen(".flv")))
+  {
+    YET_LOG_WARN("Http request not found. {}", path.str());
+    request_buf_->erase(req.head_len());
+    request_parser_.reset();
+    send_error(404);
+    return;
+  }
+
+  std::string uri = req.target().str();
+  std::string app_name(prev_slash + 1, slash);
+  std::string live_name(slash + 1, path_end - strlen(".flv"));
+  std::string host = req.header("Host").str();
+  chunked_ = Config::instance()->http_flv_chunked() && req.version_minor() >= 1;
+  YET_LOG_INFO("uri:{}, app:{}, live:{}, host:{}, chunked:{}", uri, app_name, live_name, host, chunked_);
+
+  // the connection is the stream from now on, anything more the client sent is ignored
+  request_buf_.reset();
+  request_parser_.reset();
+
+  auto obs = obs_.lock();
+  asio::io_context *io_ctx = obs ? obs->get_http_flv_io_ctx(live_name) : nullptr;
+  if (io_ctx && io_ctx != &socket_.get_executor().context()) {
+    do_handover(*io_ctx, std::bind(&HttpFlvSub::on_request, shared_from_this(), uri, app_name, live_name, host));
+    return;
+  }
 
+  on_request(uri, app_name, live_name, host);
+}
+
+void HttpFlvSub::on_request(const std::string &uri, const std::string &app_name, const std::string &live_name,
+                            const std::string &host)
+{
   if (auto obs = obs_.lock()) {
     obs->on_http_flv_request(shared_from_this(), uri, app_name, live_name, host);
   }
 
   do_send_http_headers();
+  do_read_until_closed();
+}
+
+void HttpFlvSub::do_read_until_closed() {
+  // nothing is expected from the client any more, the read only tells that it is gone while no data flows
+  asio::async_read(socket_, asio::buffer(&read_probe_, 1),
+                   std::bind(&HttpFlvSub::read_until_closed_cb, shared_from_this(), _1, _2));
+}
+
+void HttpFlvSub::read_until_closed_cb(const ErrorCode &ec, std::size_t) {
+  if (!ec) {
+    do_read_until_closed();
+    return;
+  }
+
+  if (ec != asio::error::eof && ec != asio::error::operation_aborted) { YET_LOG_ERROR("ec:{}", ec.message()); }
+  close();
+}
+
+void HttpFlvSub::do_handover(asio::io_context &io_ctx, std::function<void()> next) {
+  YET_LOG_DEBUG("Handover http flv sub. {}", static_cast<void *>(this));
+
+  ErrorCode ec;
+  auto protocol = socket_.local_endpoint(ec).protocol();
+  auto fd = socket_.release(ec);
+  if (ec) {
+    YET_LOG_ERROR("Release socket failed, http flv sub closed. {} ec:{}", static_cast<void *>(this), ec.message());
+    Metrics::add(METRIC_HANDOVER_FAILED);
+    close();
+    return;
+  }
+  auto self = shared_from_this();
+  asio::post(io_ctx, [this, self, &io_ctx, protocol, fd, next] {
+    ErrorCode assign_ec;
+    socket_ = asio::ip::tcp::socket(io_ctx);
+    socket_.assign(protocol, fd, assign_ec);
+    if (assign_ec) {
+      YET_LOG_ERROR("Assign socket failed, http flv sub closed. {} ec:{}", static_cast<void *>(this), assign_ec.message());
+      Metrics::add(METRIC_HANDOVER_FAILED);
+      ::close(fd);
+      close();
+      return;
+    }
+
+    next();
+  });
 }
 
 void HttpFlvSub::do_send_http_headers() {
-  asio::async_write(socket_, asio::buffer(FLV_HTTP_HEADERS, FLV_HTTP_HEADERS_LEN),
-                    std::bind(&HttpFlvSub::send_http_headers_cb, shared_from_this(), _1));
+  asio::const_buffer headers = chunked_ ? asio::buffer(FLV_HTTP_HEADERS_CHUNKED, FLV_HTTP_HEADERS_CHUNKED_LEN)
+                                        : asio::buffer(FLV_HTTP_HEADERS, FLV_HTTP_HEADERS_LEN);
+  asio::async_write(socket_, headers, std::bind(&HttpFlvSub::send_http_headers_cb, shared_from_this(), _1, _2));
 }
 
-void HttpFlvSub::send_http_headers_cb(const ErrorCode &ec) {
+void HttpFlvSub::send_http_headers_cb(const ErrorCode &ec, std::size_t len) {
   SNIPPET_HANDLE_CB_ERROR;
+  Metrics::add(METRIC_HTTP_FLV_BYTES_OUT, len);
   do_send_flv_header();
 }
 
 
 void HttpFlvSub::do_send_flv_header() {
-  asio::async_write(socket_, asio::buffer(FLV_HEADER_BUF_13, 13),
-                    std::bind(&HttpFlvSub::send_flv_header_cb, shared_from_this(), _1));
+  static constexpr char FLV_HEADER_CHUNK_HEAD[] = "d\r\n";
+  std::array<asio::const_buffer, 3> bufs = {{
+    asio::buffer(FLV_HEADER_CHUNK_HEAD, chunked_ ? 3 : 0),
+    asio::buffer(FLV_HEADER_BUF_13, 13),
+    asio::buffer(CRLF, chunked_ ? 2 : 0)
+  }};
+  asio::async_write(socket_, bufs, std::bind(&HttpFlvSub::send_flv_header_cb, shared_from_this(), _1, _2));
 }
 
-void HttpFlvSub::send_flv_header_cb(const ErrorCode &ec) {
+void HttpFlvSub::send_flv_header_cb(const ErrorCode &ec, std::size_t len) {
   SNIPPET_HANDLE_CB_ERROR;
+  Metrics::add(METRIC_HTTP_FLV_BYTES_OUT, len);
 
-  if (auto group = group_.lock()) {
-    auto metadata = group->get_metadata();
-    if (!metadata) {
-      is_bc_ready_ = true;
-    } else {
-      asio::async_write(socket_, asio::buffer(metadata->read_pos(), metadata->readable_size()),
-                        std::bind(&HttpFlvSub::send_metadata_cb, shared_from_this(), _1));
-    }
-  }
+  on_bc_ready();
 }
 
-void HttpFlvSub::send_metadata_cb(const ErrorCode &ec) {
-  SNIPPET_HANDLE_CB_ERROR;
+void HttpFlvSub::on_bc_ready() {
+  is_bc_ready_ = true;
+  if (ending_) {
+    do_end_stream();
+    return;
+  }
 
-  YET_LOG_INFO("Sent cached metadata.");
+  auto group = group_.lock();
+  if (!group) { return; }
 
-  if (auto group = group_.lock()) {
-    auto seq_header = group->get_video_seq_header();
-    if (!seq_header) {
-      is_bc_ready_ = true;
-    } else {
-      asio::async_write(socket_, asio::buffer(seq_header->read_pos(), seq_header->readable_size()),
-                        std::bind(&HttpFlvSub::send_video_seq_header_cb, shared_from_this(), _1));
-    }
+  // cached tags are queued ahead, sent with gop cache or with the first key frame
+  BufferPtr cached_tags[] = { group->get_metadata(), group->get_video_seq_header(), group->get_audio_seq_header() };
+  for (auto &tag : cached_tags) {
+    if (tag && tag->readable_size()) { send_buffers_.push(tag); }
   }
-}
-
-void HttpFlvSub::send_video_seq_header_cb(const ErrorCode &ec) {
-  SNIPPET_HANDLE_CB_ERROR;
 
-  YET_LOG_INFO("Sent cached video seq header.");
+  // replay cached gop, so playing starts without waiting for next key frame
+  const GopCache &gop_cache = group->get_http_flv_gop_cache();
+  if (gop_cache.empty()) { return; }
 
-  is_bc_ready_ = true;
+  gop_cache.for_each([this](BufferPtr buf) { send_buffers_.push(buf); });
+  sent_first_key_frame_ = true;
+  keep_tail_ = true;
+  YET_LOG_DEBUG("Replay gop cache. num:{}, bytes:{}", gop_cache.gop_num(), gop_cache.bytes());
+  do_send();
 }
 
 void HttpFlvSub::async_send(BufferPtr buf, const std::vector<FlvTagInfo> &tis) {
-  if (!is_bc_ready_) { return; }
+  if (!is_bc_ready_ || ending_) { return; }
 
   if (!sent_first_key_frame_) {
     if (tis.empty()) { return; }
 
     for (auto &ti : tis) {
+      // metadata and seq headers which come before first key frame are queued ahead of it
+      uint8_t *data = ti.tag_pos + FLV_TAG_HEADER_LEN;
+      std::size_t data_len = buf->write_pos() - data;
+      if ((ti.tag_type == FLVTAGTYPE_METADATA ||
+           (ti.tag_type == FLVTAGTYPE_VIDEO && AvOp::is_avc_seq_header(data, data_len)) ||
+           (ti.tag_type == FLVTAGTYPE_AUDIO && AvOp::is_aac_seq_header(data, data_len))) &&
+          check_tag_complete(buf, ti) == 0)
+      {
+        send_buffers_.push(ti.tag_whole_size == buf->readable_size() ? buf
+                                                                     : BufferPool::acquire(ti.tag_pos, ti.tag_whole_size));
+        continue;
+      }
+
       if (ti.tag_type == FLVTAGTYPE_VIDEO) {
-        if (*(ti.tag_pos + 11) == 0x17) {
-          send_buffers_.push(std::make_shared<Buffer>(ti.tag_pos, buf->write_pos()-ti.tag_pos));
+        if (AvOp::is_video_key_frame(ti.tag_pos + FLV_TAG_HEADER_LEN, buf->write_pos() - ti.tag_pos - FLV_TAG_HEADER_LEN)) {
+          send_buffers_.push(ti.tag_pos == buf->read_pos() ? buf
+                                                           : BufferPool::acquire(ti.tag_pos, buf->write_pos()-ti.tag_pos));
           do_send();
           sent_first_key_frame_ = true;
+          keep_tail_ = true;
           YET_LOG_DEBUG("key");
           break;
         }
@@ -157,41 +318,236 @@ void HttpFlvSub::async_send(BufferPtr buf, const std::vector<FlvTagInfo> &tis) {
     return;
   }
 
+  bool droppable = false;
+  buf = filter_tags(buf, tis, droppable);
+  if (!buf) { return; }
+
   bool is_empty = send_buffers_.empty();
-  send_buffers_.push(buf);
+  send_buffers_.push(buf, droppable);
   if (is_empty && is_bc_ready_) {
     do_send();
   }
 }
 
+BufferPtr HttpFlvSub::filter_tags(BufferPtr buf, const std::vector<FlvTagInfo> &tis, bool &droppable) {
+  // bytes before first tag belong to the last tag of previous buffer
+  if (!keep_tail_ && tis.empty()) { return nullptr; }
+
+  uint8_t *end = buf->write_pos();
+  BufferPtr out;
+  bool dropped = !keep_tail_ && tis[0].tag_pos != buf->read_pos();
+  bool begins_in_tag = keep_tail_ && (tis.empty() || tis[0].tag_pos != buf->read_pos());
+  bool has_header = false;
+  uint8_t *kept_begin = keep_tail_ ? buf->read_pos() : nullptr;
+  for (auto &ti : tis) {
+    bool resync = false;
+    bool keep = admit_tag(ti, end, resync);
+    has_header = has_header || resync || (keep && is_header_tag(ti, end));
+    if ((!keep || resync) && kept_begin) {
+      if (!out) { out = BufferPool::acquire(end - buf->read_pos()); }
+      out->append(kept_begin, ti.tag_pos - kept_begin);
+      kept_begin = nullptr;
+    }
+    if (resync) {
+      if (!out) { out = BufferPool::acquire(end - buf->read_pos()); }
+      append_seq_headers(out);
+    }
+    if (keep && !kept_begin) { kept_begin = ti.tag_pos; }
+
+    dropped = dropped || !keep || resync;
+    keep_tail_ = keep;
+  }
+
+  // only whole av tags may be purged later, a torn tag or a lost header would break the stream
+  bool ends_in_tag = keep_tail_ && !tis.empty() && check_tag_complete(buf, tis.back()) != 0;
+  droppable = !begins_in_tag && !ends_in_tag && !has_header;
+
+  if (!dropped) { return buf; }
+
+  if (kept_begin) {
+    if (!out) { out = BufferPool::acquire(end - kept_begin); }
+    out->append(kept_begin, end - kept_begin);
+  }
+  return (out && out->readable_size()) ? out : nullptr;
+}
+
+bool HttpFlvSub::is_header_tag(const FlvTagInfo &ti, uint8_t *end) {
+  uint8_t *data = ti.tag_pos + FLV_TAG_HEADER_LEN;
+  std::size_t len = end - data;
+  return ti.tag_type == FLVTAGTYPE_METADATA ||
+         (ti.tag_type == FLVTAGTYPE_AUDIO && AvOp::is_aac_seq_header(data, len)) ||
+         (ti.tag_type == FLVTAGTYPE_VIDEO && AvOp::is_avc_seq_header(data, len));
+}
+
+bool HttpFlvSub::admit_tag(const FlvTagInfo &ti, uint8_t *end, bool &resync) {
+  uint8_t *data = ti.tag_pos + FLV_TAG_HEADER_LEN;
+  std::size_t len = end - data;
+
+  if (ti.tag_type == FLVTAGTYPE_METADATA) { return true; }
+
+  bool is_audio = ti.tag_type == FLVTAGTYPE_AUDIO;
+  if (is_header_tag(ti, end)) {
+    if (!send_buffers_.is_skipping()) { return true; }
+
+    // dropped seq header is sent again before the key frame which ends the skipping
+    if (is_audio) {
+      resend_aac_header_ = true;
+    } else {
+      resend_avc_header_ = true;
+    }
+    return false;
+  }
+
+  bool is_key_frame = !is_audio && AvOp::is_video_key_frame(data, len);
+  bool is_non_ref_frame = !is_audio && AvOp::is_video_non_ref_frame(data, len);
+  switch (send_buffers_.admit_frame(is_key_frame, is_non_ref_frame, ti.tag_whole_size)) {
+  case SENDQUEUEVERDICT_PASS:
+    return true;
+  case SENDQUEUEVERDICT_DROP:
+    return false;
+  case SENDQUEUEVERDICT_SKIP:
+    // the stale backlog goes too, or the queue stays over budget and the sub never catches up
+    send_buffers_.purge_unsent();
+    return false;
+  case SENDQUEUEVERDICT_RESYNC:
+    send_buffers_.purge_unsent();
+    resync = true;
+    return true;
+  }
+  return true;
+}
+
+void HttpFlvSub::append_seq_headers(BufferPtr out) {
+  auto group = group_.lock();
+  if (!group) { return; }
+
+  BufferPtr avc_header = resend_avc_header_ ? group->get_video_seq_header() : nullptr;
+  if (avc_header && avc_header->readable_size()) { out->append(avc_header->read_pos(), avc_header->readable_size()); }
+
+  BufferPtr aac_header = resend_aac_header_ ? group->get_audio_seq_header() : nullptr;
+  if (aac_header && aac_header->readable_size()) { out->append(aac_header->read_pos(), aac_header->readable_size()); }
+
+  resend_avc_header_ = false;
+  resend_aac_header_ = false;
+}
+
 void HttpFlvSub::do_send() {
-  BufferPtr buf = send_buffers_.front();
-  asio::async_write(socket_, asio::buffer(buf->read_pos(), buf->readable_size()),
-                    std::bind(&HttpFlvSub::send_cb, shared_from_this(), _1, _2));
+  // the first send always carries the first key frame, after seq headers if any
+  if (!first_frame_sent_) {
+    first_frame_sent_ = true;
+    Metrics::observe(METRIC_HTTP_FLV_FIRST_FRAME_US, std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start_time_).count());
+  }
+
+  auto handler = make_pooled_handler(std::bind(&HttpFlvSub::send_cb, shared_from_this(), _1, _2));
+  if (!chunked_) {
+    asio::async_write(socket_, send_buffers_.gather(), std::move(handler));
+    return;
+  }
+
+  // one chunk per gather, the framing costs two more iovecs of the same writev
+  SendQueue::Gathered gathered = send_buffers_.gather();
+  chunked_bufs_.clear();
+  chunked_bufs_.push_back(asio::const_buffer());
+  chunked_bufs_.insert(chunked_bufs_.end(), gathered.begin(), gathered.end());
+  int head_len = snprintf(chunk_head_, sizeof(chunk_head_), "%zx\r\n", asio::buffer_size(gathered));
+  chunked_bufs_[0] = asio::buffer(chunk_head_, head_len);
+  chunked_bufs_.push_back(asio::buffer(CRLF, 2));
+  asio::async_write(socket_, SendQueue::Gathered(&chunked_bufs_), std::move(handler));
 }
 
 void HttpFlvSub::send_cb(const ErrorCode &ec, std::size_t len) {
-  //SNIPPET_HANDLE_CB_ERROR;
   if (ec) {
-    YET_LOG_ERROR("ec:{}", ec.message());
-    if (ec.value() == asio::error::broken_pipe) {
-      close();
-    }
+    if (ec != asio::error::operation_aborted) { YET_LOG_ERROR("ec:{}", ec.message()); }
+    close();
     return;
   }
 
-  send_buffers_.pop();
+  Metrics::add(METRIC_HTTP_FLV_BYTES_OUT, len);
+  send_buffers_.pop_gathered();
   if (!send_buffers_.empty()) {
     do_send();
+  } else if (ending_) {
+    do_end_stream();
   }
 }
 
+void HttpFlvSub::dispose() {
+  if (ending_) { return; }
+
+  // queued tags are sent first, the stream ends once the queue is drained
+  ending_ = true;
+  if (is_bc_ready_ && !send_buffers_.is_sending()) { do_end_stream(); }
+}
+
+void HttpFlvSub::do_end_stream() {
+  static constexpr char LAST_CHUNK[] = "0\r\n\r\n";
+  auto self = shared_from_this();
+  asio::async_write(socket_, asio::buffer(LAST_CHUNK, chunked_ ? sizeof(LAST_CHUNK)-1 : 0),
+                    [this, self](const ErrorCode &, std::size_t) {
+    ErrorCode ec;
+    socket_.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+    close();
+  });
+}
+
+void HttpFlvSub::send_response(const std::string &content_type, const std::string &body) {
+  do_send_response(200, content_type.c_str(), body.data(), body.length());
+}
+
+void HttpFlvSub::send_error(int status_code) {
+  const char *reason = http_reason_phrase(status_code);
+  fmt::memory_buffer body;
+  fmt::format_to(body, "{} {}\n", status_code, reason);
+  do_send_response(status_code, "text/plain", body.data(), body.size());
+}
+
+void HttpFlvSub::do_send_response(int status_code, const char *content_type, const char *body, std::size_t body_len) {
+  fmt::memory_buffer headers;
+  fmt::format_to(headers, "HTTP/1.1 {} {}\r\nServer: yet\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+                          "Connection: {}\r\n{}\r\n", status_code, http_reason_phrase(status_code), content_type, body_len,
+                 keep_alive_ ? "keep-alive" : "close", status_code == 405 ? "Allow: GET\r\n" : "");
+  BufferPtr response = BufferPool::acquire(headers.size() + body_len);
+  response->append(reinterpret_cast<const uint8_t *>(headers.data()), headers.size());
+  response->append(reinterpret_cast<const uint8_t *>(body), body_len);
+  asio::async_write(socket_, asio::buffer(response->read_pos(), response->readable_size()),
+                    std::bind(&HttpFlvSub::send_response_cb, shared_from_this(), response, _1));
+}
+
+void HttpFlvSub::send_response_cb(BufferPtr response, const ErrorCode &ec) {
+  SNIPPET_HANDLE_CB_ERROR;
+  Metrics::add(METRIC_HTTP_FLV_BYTES_OUT, response->readable_size());
+
+  if (keep_alive_) {
+    // next request may be in the buffer already, pipelined
+    start_request_timer();
+    handle_request_buf();
+    return;
+  }
+
+  ErrorCode shutdown_ec;
+  socket_.shutdown(asio::ip::tcp::socket::shutdown_send, shutdown_ec);
+  close();
+}
+
 void HttpFlvSub::set_group(std::weak_ptr<Group> group) {
   group_ = group;
 }
 
 void HttpFlvSub::close() {
-  socket_.close();
+  // called by every failed or finished io, the sub leaves its group once
+  if (closed_) { return; }
+  closed_ = true;
+
+  const SendQueueStat &stat = send_buffers_.stat();
+  if (stat.dropped_frame_num) {
+    YET_LOG_INFO("Http flv sub dropped. frame num:{}, bytes:{}, skip num:{}",
+                 stat.dropped_frame_num, stat.dropped_bytes, stat.skip_num);
+  }
+
+  request_timer_.cancel();
+  ErrorCode ec;
+  socket_.close(ec);
   if (auto group = group_.lock()) {
     group->del_http_flv_sub(shared_from_this());
   }
@@ -7,10 +7,13 @@
 
 #pragma once
 
-#include <queue>
+#include <chrono>
+#include <functional>
 #include <asio.hpp>
 #include "yet.hpp"
+#include "yet_common/yet_send_queue.hpp"
 #include "yet_http_flv/yet_http_flv_buffer_t.hpp"
+#include "yet_http_flv/yet_http_parser.h"
 
 namespace yet {
 
@@ -18,10 +21,22 @@ class HttpFlvSubObserver {
   public:
     virtual ~HttpFlvSubObserver() {}
 
+    /// @return io context which the sub should move to before <on_http_flv_request>, nullptr if no need to move
+    virtual asio::io_context *get_http_flv_io_ctx(const std::string &live_name) = 0;
+
     virtual void on_http_flv_request(HttpFlvSubPtr sub, const std::string &uri, const std::string &app_name,
                                      const std::string &live_name, const std::string &host) = 0;
+
+    /// `GET /stats`, answer it by <send_response>
+    /// @param with_groups false for `GET /stats?groups=0`, only totals are wanted
+    virtual void on_http_stats_request(HttpFlvSubPtr sub, bool with_groups) = 0;
 };
 
+/// http connection accepted by HttpFlvServer, which becomes a sub once it requests a flv stream.
+///
+/// requests are parsed by HttpParser in a pooled buffer. short requests such as stats are answered with
+/// keep alive as the client asks, so one connection serves many of them, pipelined ones included.
+/// a flv request takes over the connection until either side closes it.
 class HttpFlvSub : public std::enable_shared_from_this<HttpFlvSub> {
   public:
     explicit HttpFlvSub(asio::ip::tcp::socket socket, std::weak_ptr<HttpFlvSubObserver> obs);
@@ -33,22 +48,61 @@ class HttpFlvSub : public std::enable_shared_from_this<HttpFlvSub> {
 
     void async_send(BufferPtr buf, const std::vector<FlvTagInfo> &tis);
 
+    /// send a whole http response other than flv stream,
+    /// then wait for next request on the connection if it is kept alive, or close it
+    void send_response(const std::string &content_type, const std::string &body);
+
+    const SendQueueStat &send_queue_stat() const { return send_buffers_.stat(); }
+    std::size_t send_queue_bytes() const { return send_buffers_.bytes(); }
+
     void set_group(std::weak_ptr<Group> group);
 
-    void dispose() {}
+    /// ends the stream once queued tags are sent, with the last chunk if it is chunked, then closes the connection
+    void dispose();
 
   private:
     void close();
 
+  private:
+    void start_request_timer();
+    void do_read_request();
+    void request_timeout_cb(const ErrorCode &ec);
+
+    /// parse the buffered request and handle it once its head is complete
+    void handle_request_buf();
+    void handle_request();
+
+    void send_error(int status_code);
+    void do_send_response(int status_code, const char *content_type, const char *body, std::size_t body_len);
+
+  private:
+    void on_request(const std::string &uri, const std::string &app_name, const std::string &live_name,
+                    const std::string &host);
+    void do_handover(asio::io_context &io_ctx, std::function<void()> next);
+
+    /// keeps a read armed while streaming, so a client gone is noticed even if nothing is being written
+    void do_read_until_closed();
+    void read_until_closed_cb(const ErrorCode &ec, std::size_t len);
+
   private:
     void do_send_http_headers();
-    void send_http_headers_cb(const ErrorCode &ec);
+    void send_http_headers_cb(const ErrorCode &ec, std::size_t len);
     void do_send_flv_header();
-    void send_flv_header_cb(const ErrorCode &ec);
-    void send_metadata_cb(const ErrorCode &ec);
-    void send_video_seq_header_cb(const ErrorCode &ec);
+    void send_flv_header_cb(const ErrorCode &ec, std::size_t len);
+    void on_bc_ready();
+
+    /// apply budget of the send queue to each tag of <buf>.
+    /// @param droppable set true if the result is whole av tags only, which may be purged from the queue on skipping
+    /// @return <buf> itself if all tags are kept, a copy of kept tags if some are dropped, nullptr if none is kept
+    BufferPtr filter_tags(BufferPtr buf, const std::vector<FlvTagInfo> &tis, bool &droppable);
+    bool admit_tag(const FlvTagInfo &ti, uint8_t *end, bool &resync);
+    bool is_header_tag(const FlvTagInfo &ti, uint8_t *end);
+    void append_seq_headers(BufferPtr out);
+
     void do_send();
     void send_cb(const ErrorCode &ec, std::size_t len);
+    void do_end_stream();
+    void send_response_cb(BufferPtr response, const ErrorCode &ec);
 
   private:
     HttpFlvSub(const HttpFlvSub &) = delete;
@@ -58,10 +112,24 @@ class HttpFlvSub : public std::enable_shared_from_this<HttpFlvSub> {
     asio::ip::tcp::socket             socket_;
     std::weak_ptr<HttpFlvSubObserver> obs_;
     std::weak_ptr<Group>              group_;
-    asio::streambuf                   request_buf_;
-    std::queue<BufferPtr>             send_buffers_;
+    BufferPtr                         request_buf_; // released once it becomes a sub
+    HttpParser                        request_parser_;
+    asio::steady_timer                request_timer_;
+    bool                              keep_alive_ = false;
+    bool                              chunked_ = false;
+    bool                              ending_ = false;
+    bool                              closed_ = false;
+    uint8_t                           read_probe_ = 0;
+    std::vector<asio::const_buffer>   chunked_bufs_; // gathered buffers framed as one chunk
+    char                              chunk_head_[16];
+    SendQueue                         send_buffers_;
     bool                              is_bc_ready_ = false;
     bool                              sent_first_key_frame_ = false;
+    bool                              keep_tail_ = false; // whether last tag of last buffer is sent
+    bool                              resend_avc_header_ = false;
+    bool                              resend_aac_header_ = false;
+    std::chrono::steady_clock::time_point start_time_;
+    bool                              first_frame_sent_ = false;
 };
 
 }
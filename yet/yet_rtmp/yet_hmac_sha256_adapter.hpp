@@ -8,13 +8,19 @@
 #pragma once
 
 //#define YET_HMAC_SHA256_OPENSSL
-#define YET_HMAC_SHA256_CHEF
+//#define YET_HMAC_SHA256_CHEF
+#define YET_HMAC_SHA256_YET // on yet::Sha256, which uses sha extensions of cpu if any
 
 #if defined(YET_HMAC_SHA256_OPENSSL)
+  #include <string>
   #include <openssl/hmac.h>
   #include <openssl/sha.h>
 #elif defined(YET_HMAC_SHA256_CHEF)
+  #include <string>
   #include "chef_base/chef_crypto_hmac_sha256.hpp"
+#elif defined(YET_HMAC_SHA256_YET)
+  #include <cstring>
+  #include "yet_common/yet_sha256.h"
 #endif
 
 namespace yet {
@@ -34,6 +40,9 @@ HMAC_CTX *HMACSHA256_static<Dummy>::hmac_ = nullptr;
 class HMACSHA256 : public HMACSHA256_static<void> {
   public:
     void init(const uint8_t *key, std::size_t key_len) {
+#if !defined(YET_HMAC_SHA256_YET)
+      key_.assign((const char *)key, key_len);
+#endif
 #if defined(YET_HMAC_SHA256_OPENSSL)
       if (!hmac_) {
   #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -48,6 +57,39 @@ class HMACSHA256 : public HMACSHA256_static<void> {
       HMAC_Init_ex(hmac_, key, key_len, EVP_sha256(), NULL);
 #elif defined(YET_HMAC_SHA256_CHEF)
       ctx_ = std::make_shared<chef::crypto_hmac_sha256>(key, key_len);
+#elif defined(YET_HMAC_SHA256_YET)
+      uint8_t hashed_key[Sha256::DIGEST_LEN];
+      if (key_len > Sha256::BLOCK_LEN) {
+        Sha256 h;
+        h.update(key, key_len);
+        h.final(hashed_key);
+        key = hashed_key;
+        key_len = Sha256::DIGEST_LEN;
+      }
+
+      uint8_t ipad[Sha256::BLOCK_LEN];
+      uint8_t opad[Sha256::BLOCK_LEN];
+      memset(ipad, 0x36, Sha256::BLOCK_LEN);
+      memset(opad, 0x5c, Sha256::BLOCK_LEN);
+      for (std::size_t i = 0; i < key_len; i++) {
+        ipad[i] ^= key[i];
+        opad[i] ^= key[i];
+      }
+      inner_.init();
+      inner_.update(ipad, Sha256::BLOCK_LEN);
+      outer_.init();
+      outer_.update(opad, Sha256::BLOCK_LEN);
+#endif
+    }
+
+    /// starts from the state of <keyed>, which has been init with a key and not updated yet.
+    /// for a fixed key, padded key blocks are hashed once for all
+    void init(const HMACSHA256 &keyed) {
+#if defined(YET_HMAC_SHA256_YET)
+      inner_ = keyed.inner_;
+      outer_ = keyed.outer_;
+#else
+      init((const uint8_t *)keyed.key_.data(), keyed.key_.length());
 #endif
     }
 
@@ -56,6 +98,8 @@ class HMACSHA256 : public HMACSHA256_static<void> {
       HMAC_Update(hmac_, buf, buf_len);
 #elif defined(YET_HMAC_SHA256_CHEF)
       ctx_->update(buf, buf_len);
+#elif defined(YET_HMAC_SHA256_YET)
+      inner_.update(buf, buf_len);
 #endif
     }
 
@@ -65,6 +109,11 @@ class HMACSHA256 : public HMACSHA256_static<void> {
       HMAC_Final(hmac_, dst, &len);
 #elif defined(YET_HMAC_SHA256_CHEF)
     ctx_->final(dst);
+#elif defined(YET_HMAC_SHA256_YET)
+      uint8_t inner_digest[Sha256::DIGEST_LEN];
+      inner_.final(inner_digest);
+      outer_.update(inner_digest, Sha256::DIGEST_LEN);
+      outer_.final(dst);
 #endif
     }
 
@@ -75,9 +124,15 @@ class HMACSHA256 : public HMACSHA256_static<void> {
     HMACSHA256 &operator=(const HMACSHA256 &) = delete;
 
   private:
+#if !defined(YET_HMAC_SHA256_YET)
+    std::string key_; // no state snapshot in these, keyed init again instead
+#endif
 #if defined(YET_HMAC_SHA256_OPENSSL)
 #elif defined(YET_HMAC_SHA256_CHEF)
     std::shared_ptr<chef::crypto_hmac_sha256> ctx_;
+#elif defined(YET_HMAC_SHA256_YET)
+    Sha256 inner_; // keyed with ipad
+    Sha256 outer_; // keyed with opad
 #endif
 };
 
@@ -32,6 +32,7 @@ static constexpr std::size_t RTMP_C0C1_LEN = 1537;
 static constexpr std::size_t RTMP_S0S1_LEN = 1537;
 static constexpr std::size_t RTMP_C2_LEN   = 1536;
 static constexpr std::size_t RTMP_S2_LEN   = 1536;
+static constexpr std::size_t RTMP_S0S1S2_LEN = RTMP_S0S1_LEN + RTMP_S2_LEN;
 
 static constexpr char RTMP_VERSION = '\x03';
 
@@ -75,6 +76,8 @@ static constexpr std::size_t RTMP_TRANSACTION_ID_CREATE_STREAM  = 4; // send not
 static constexpr std::size_t RTMP_TRANSACTION_ID_PLAY           = 4; // play handler
 static constexpr std::size_t RTMP_TRANSACTION_ID_PUBLISH        = 5;
 
+static constexpr const char *RTMP_PUBLISH_TYPE_LIVE = "live";
+
 static constexpr std::size_t RTMP_PEER_BANDWITH_LIMIT_TYPE_HARD    = 0;
 static constexpr std::size_t RTMP_PEER_BANDWITH_LIMIT_TYPE_SOFT    = 1;
 static constexpr std::size_t RTMP_PEER_BANDWITH_LIMIT_TYPE_DYNAMIC = 2;
@@ -96,10 +99,11 @@ struct RtmpHeader {
 };
 
 struct RtmpStream {
-  RtmpHeader  header;
-  std::size_t msg_len;
-  BufferPtr   msg;
-  uint32_t    timestamp_base;
+  RtmpHeader  header = RtmpHeader(); // timestamp is absolute timestamp of current msg
+  uint32_t    timestamp_delta = 0;
+  bool        has_ext_ts = false;
+  BufferPtr   msg;                   // assembles msg over more chunks
+  std::size_t msg_recvd = 0;         // bytes of current msg received
 };
 
 }
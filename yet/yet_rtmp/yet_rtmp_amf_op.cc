@@ -1,7 +1,6 @@
 #include "yet_rtmp_amf_op.h"
 #include <string.h>
 #include <stdlib.h>
-#include <sstream>
 
 /// NOTICE all use 2 bytes name len
 #define ENCODE_OBJECT_NAME(out, name, name_len) \
@@ -216,140 +215,159 @@ uint8_t *AmfOp::decode_string_with_type(const uint8_t *in, int valid_len, char *
   return ret;
 }
 
-uint8_t *AmfOp::decode_object(const uint8_t *in, int valid_len, AmfObjectItemMap *objs, std::size_t *used_len) {
-  if (!in) { return NULL; }
-
-  uint8_t *p = (uint8_t *)in;
-  uint8_t *q;
-  int str_len;
-  double number;
-  bool b;
-  std::string k;
-  std::size_t ul;
-  if (*p++ != Amf0DataType_OBJECT) { goto failed; }
-
-  valid_len--;
-
-  for (; ; ) {
-
-    if (valid_len >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 9) {
-      ul = p + 3 - in;
-
-      if (used_len) { *used_len = ul; }
-      return (p+3);
-    }
-
-    p = decode_string(p, valid_len, (char **)&q, &str_len, &ul);
-    if (!p) { goto failed; }
-
-    k.assign((const char *)q, str_len);
-    valid_len -= ul;
-
-    if (*p == Amf0ObjectValueType_NUMBER) {
-      p = decode_number_with_type(p, valid_len, &number, &ul);
-      if (!p) { goto failed; }
-
-      objs->put(k, number);
-      valid_len -= ul;
-    } else if (*p == Amf0ObjectValueType_BOOLEAN) {
-      p = decode_boolean_with_type(p, valid_len, &b, &ul);
-      if (!p) { goto failed; }
-
-      valid_len -= ul;
-      objs->put(k, b);
-    } else if (*p == Amf0ObjectValueType_STRING) {
-      //p++;
-      //valid_len--;
-      p = decode_string_with_type(p, valid_len, (char **)&q, &str_len, &ul);
-      if (!p) { goto failed; }
-
-      objs->put(k, (const char *)q, str_len);
-      valid_len = valid_len - ul;
-    }
-  }
-
-  assert(0);
-  return NULL;
-
-failed:
-  return NULL;
+static inline uint32_t read_be(const uint8_t *p, int n) {
+  uint32_t v = 0;
+  for (int i = 0; i < n; i++) { v = (v << 8) | p[i]; }
+  return v;
 }
 
-AmfObjectItemMap::AmfObjectItemMap() {}
-
-AmfObjectItemMap::~AmfObjectItemMap() {
-  clear();
+static inline double read_be_double(const uint8_t *p) {
+  double v;
+  uint8_t *q = (uint8_t *)&v;
+  for (int i = 0; i < 8; i++) { q[i] = p[7-i]; }
+  return v;
 }
 
-bool AmfObjectItemMap::put(const std::string &name, bool v) {
-  bool not_exist = true;
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.find(name);
-  if (iter != objs_.end()) {
-    objs_.erase(iter);
-    not_exist = false;
-  }
-  objs_.insert(std::make_pair(name, new AmfObjectItemBoolean(v)));
-  return not_exist;
+static inline bool is_object_end(const uint8_t *p, const uint8_t *end) {
+  return end - p >= 3 && p[0] == 0 && p[1] == 0 && p[2] == Amf0DataType_OBJECT_END;
 }
 
-bool AmfObjectItemMap::put(const std::string &name, double v) {
-  bool not_exist = true;
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.find(name);
-  if (iter != objs_.end()) {
-    objs_.erase(iter);
-    not_exist = false;
-  }
-  objs_.insert(std::make_pair(name, new AmfObjectItemNumber(v)));
-  return not_exist;
-}
+int AmfReader::decode(const uint8_t *in, std::size_t valid_len, std::size_t *used_len) {
+  if (!in) { return -1; }
 
-bool AmfObjectItemMap::put(const std::string &name, const std::string &v) {
-  bool not_exist = true;
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.find(name);
-  if (iter != objs_.end()) {
-    objs_.erase(iter);
-    not_exist = false;
+  std::size_t index = num_;
+  const uint8_t *p = decode_value(in, in + valid_len, nullptr, 0, 0);
+  if (!p) {
+    num_ = index;
+    return -1;
   }
-  objs_.insert(std::make_pair(name, new AmfObjectItemString(v)));
-  return not_exist;
-}
 
-bool AmfObjectItemMap::put(const std::string &name, const char *v, int len) {
-  bool not_exist = true;
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.find(name);
-  if (iter != objs_.end()) {
-    objs_.erase(iter);
-    not_exist = false;
+  if (used_len) { *used_len = p - in; }
+  return static_cast<int>(index);
+}
+
+const uint8_t *AmfReader::decode_value(const uint8_t *p, const uint8_t *end, const char *name, std::size_t name_len, int depth) {
+  if (p >= end || depth > AMF_READER_MAX_DEPTH || *p > Amf0DataType_TYPED_OBJECT) { return nullptr; }
+
+  std::size_t index = num_++;
+  if (index >= AMF_READER_INLINE_FIELD_NUM) { more_fields_.resize(index - AMF_READER_INLINE_FIELD_NUM + 1); }
+  AmfField &f = mutable_at(index);
+  f.name = name;
+  f.name_len = name_len;
+  f.value.type = static_cast<Amf0DataType>(*p++);
+  f.value.number = 0;
+  f.value.str = nullptr;
+  f.value.str_len = 0;
+
+  // <f> may be moved by members decoded later, set <end> by index at last
+  switch (f.value.type) {
+  case Amf0DataType_NUMBER:
+    if (end - p < 8) { return nullptr; }
+    f.value.number = read_be_double(p);
+    p += 8;
+    break;
+  case Amf0DataType_BOOLEAN:
+    if (end - p < 1) { return nullptr; }
+    f.value.number = (*p++ != 0) ? 1 : 0;
+    break;
+  case Amf0DataType_STRING:
+  case Amf0DataType_LONG_STRING:
+  case Amf0DataType_XML_DOCUMENT: {
+    std::size_t len_bytes = (f.value.type == Amf0DataType_STRING) ? 2 : 4;
+    if (std::size_t(end - p) < len_bytes) { return nullptr; }
+    std::size_t len = read_be(p, len_bytes);
+    p += len_bytes;
+    if (std::size_t(end - p) < len) { return nullptr; }
+    f.value.str = (const char *)p;
+    f.value.str_len = len;
+    p += len;
+    break;
+  }
+  case Amf0DataType_NULL:
+  case Amf0DataType_UNDEFINED:
+  case Amf0DataType_UNSUPPORTED:
+    break;
+  case Amf0DataType_REFERENCE:
+    if (end - p < 2) { return nullptr; }
+    f.value.number = read_be(p, 2);
+    p += 2;
+    break;
+  case Amf0DataType_DATE:
+    // ms since epoch, then time zone which should be 0 and is ignored
+    if (end - p < 10) { return nullptr; }
+    f.value.number = read_be_double(p);
+    p += 10;
+    break;
+  case Amf0DataType_OBJECT:
+    p = decode_named_members(p, end, 0, depth);
+    break;
+  case Amf0DataType_TYPED_OBJECT: {
+    if (end - p < 2) { return nullptr; }
+    std::size_t len = read_be(p, 2);
+    p += 2;
+    if (std::size_t(end - p) < len) { return nullptr; }
+    f.value.str = (const char *)p;
+    f.value.str_len = len;
+    p = decode_named_members(p + len, end, 0, depth);
+    break;
+  }
+  case Amf0DataType_ECMA_ARRAY: {
+    if (end - p < 4) { return nullptr; }
+    uint32_t count = read_be(p, 4);
+    f.value.number = count;
+    p = decode_named_members(p + 4, end, count, depth);
+    break;
+  }
+  case Amf0DataType_STRICT_ARRAY: {
+    if (end - p < 4) { return nullptr; }
+    uint32_t count = read_be(p, 4);
+    p += 4;
+    // each element takes at least its type byte
+    if (std::size_t(end - p) < count) { return nullptr; }
+    f.value.number = count;
+    for (uint32_t i = 0; i < count && p; i++) { p = decode_value(p, end, nullptr, 0, depth+1); }
+    break;
   }
-  objs_.insert(std::make_pair(name, new AmfObjectItemString(std::string(v, len))));
-  return not_exist;
+  default:
+    // movieclip and recordset are reserved, object end out of place
+    return nullptr;
+  }
+
+  if (p) { mutable_at(index).value.end = num_; }
+  return p;
 }
 
-AmfObjectItem *AmfObjectItemMap::get(const std::string &name) {
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.find(name);
-  if (iter == objs_.end()) {
-    return NULL;
+const uint8_t *AmfReader::decode_named_members(const uint8_t *p, const uint8_t *end, uint32_t count, int depth) {
+  for (uint32_t decoded = 0; ; decoded++) {
+    if (is_object_end(p, end)) { return p + 3; }
+
+    // some encoders leave out the end of ecma array, which then ends with the buffer
+    if (p == end && count && decoded >= count) { return p; }
+
+    if (end - p < 2) { return nullptr; }
+    std::size_t name_len = read_be(p, 2);
+    p += 2;
+    if (std::size_t(end - p) < name_len) { return nullptr; }
+    const char *name = (const char *)p;
+    p = decode_value(p + name_len, end, name, name_len, depth+1);
+    if (!p) { return nullptr; }
   }
-  return iter->second;
 }
 
-std::string AmfObjectItemMap::stringify() {
-  std::ostringstream oss;
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.begin();
-  for (; iter != objs_.end(); iter++) {
-    oss << "{<" << iter->first << ">:"
-        << "<" << iter->second->stringify() << ">}";
-  }
-  return oss.str();
+const AmfValue *AmfReader::get(std::size_t index, const char *name) const {
+  if (index >= num_ || !at(index).value.has_named_members()) { return nullptr; }
 
+  std::size_t name_len = strlen(name);
+  for (std::size_t i = index + 1; i < at(index).value.end; i = at(i).value.end) {
+    const AmfField &f = at(i);
+    if (f.name_len == name_len && memcmp(f.name, name, name_len) == 0) { return &f.value; }
+  }
+  return nullptr;
 }
 
-void AmfObjectItemMap::clear() {
-  std::map<std::string, AmfObjectItem *>::iterator iter = objs_.begin();
-  for (; iter != objs_.end(); iter++) {
-    delete iter->second;
-  }
-  objs_.clear();
+void AmfReader::clear() {
+  num_ = 0;
+  more_fields_.clear();
 }
 
 } // namespace yet
@@ -8,10 +8,8 @@
 #pragma once
 
 #include <inttypes.h>
-#include <assert.h>
-#include <map>
-#include <string>
-#include <sstream>
+#include <cstddef>
+#include <vector>
 
 namespace yet {
 
@@ -35,85 +33,75 @@ namespace yet {
     Amf0DataType_TYPED_OBJECT = 0x10,
   }; // enum Amf0DataType
 
-  enum Amf0ObjectValueType {
-    Amf0ObjectValueType_NUMBER  = Amf0DataType_NUMBER,
-    Amf0ObjectValueType_BOOLEAN = Amf0DataType_BOOLEAN,
-    Amf0ObjectValueType_STRING  = Amf0DataType_STRING,
-  }; // enum Amf0ObjectValueType
-
-  class AmfObjectItem {
+  /// a decoded value, strings point into the decoded buffer
+  struct AmfValue {
+    Amf0DataType  type;
+    double        number;  // number, boolean as 0 or 1, ms of date, index of reference
+    const char   *str;     // string, long string, xml document, class name of typed object
+    std::size_t   str_len;
+    std::size_t   end;     // index in <AmfReader> after the members of this value
+
+    bool is_number() const { return type == Amf0DataType_NUMBER; }
+    bool is_boolean() const { return type == Amf0DataType_BOOLEAN; }
+    bool is_string() const { return type == Amf0DataType_STRING || type == Amf0DataType_LONG_STRING; }
+    bool is_null() const { return type == Amf0DataType_NULL || type == Amf0DataType_UNDEFINED; }
+    bool has_named_members() const {
+      return type == Amf0DataType_OBJECT || type == Amf0DataType_TYPED_OBJECT || type == Amf0DataType_ECMA_ARRAY;
+    }
+  }; // struct AmfValue
+
+  struct AmfField {
+    const char  *name; // nullptr for top values and elements of strict arrays
+    std::size_t  name_len;
+    AmfValue     value;
+  }; // struct AmfField
+
+  /// zero-copy amf0 decoder, no map and no per-field allocation.
+  ///
+  /// values are kept flat in decode order, members of a container follow it, up to its <end>,
+  /// so the first member of the value at index i is at i+1, and the next sibling of the value at j is at its <end>.
+  /// the first AMF_READER_INLINE_FIELD_NUM values live in the reader itself, enough for any connect command.
+  /// the decoded buffer must outlive the reader.
+  class AmfReader {
     public:
-      AmfObjectItem(Amf0ObjectValueType type) : type_(type) {}
-      virtual ~AmfObjectItem() {}
-      bool is_boolean() { return type_ == Amf0ObjectValueType_BOOLEAN; }
-      bool is_number() { return type_ == Amf0ObjectValueType_NUMBER; }
-      bool is_string() { return type_ == Amf0ObjectValueType_STRING; }
-      virtual bool get_boolean() { assert(0);return false; }
-      virtual double get_number() { assert(0);return 0; }
-      virtual std::string get_string() { assert(0);return std::string(); }
-      virtual void set_boolean(bool) { assert(0); }
-      virtual void set_number(double) { assert(0); }
-      virtual void set_string(const std::string &) { assert(0); }
-      virtual std::string stringify() { assert(0);return std::string(); }
-
-    private:
-      Amf0ObjectValueType type_;
-  }; // class AmfObjectItem
+      static constexpr std::size_t AMF_READER_INLINE_FIELD_NUM = 32;
+      static constexpr int         AMF_READER_MAX_DEPTH        = 16;
 
-  class AmfObjectItemBoolean : public AmfObjectItem {
     public:
-      AmfObjectItemBoolean(bool v) : AmfObjectItem(Amf0ObjectValueType_BOOLEAN), v_(v) {}
-      virtual bool get_boolean() { return v_; }
-      virtual void set_boolean(bool v) { v_ = v; }
-      virtual std::string stringify() { std::ostringstream oss; oss << v_; return oss.str(); }
-    private:
-      bool v_;
-  }; // class AmfObjectItemBoolean
+      /// decodes one value at <in> with all its members, appended after values decoded before
+      /// @param used_len if caller don't care about it just set it nullptr
+      /// @return index of the value, -1 if invalid or not complete
+      int decode(const uint8_t *in, std::size_t valid_len, std::size_t *used_len);
+
+      std::size_t size() const { return num_; }
+      const AmfField &at(std::size_t index) const {
+        return index < AMF_READER_INLINE_FIELD_NUM ? inline_fields_[index] : more_fields_[index - AMF_READER_INLINE_FIELD_NUM];
+      }
 
-  class AmfObjectItemNumber: public AmfObjectItem {
-    public:
-      AmfObjectItemNumber(double v) : AmfObjectItem(Amf0ObjectValueType_NUMBER), v_(v) {}
-      virtual double get_number() { return v_; }
-      virtual void set_number(double v) { v_ = v; }
-      virtual std::string stringify() { std::ostringstream oss; oss << v_; return oss.str(); }
-    private:
-      double v_;
-  }; // class AmfObjectItemNumber
+      /// @return member named <name> of the object, typed object or ecma array at <index>, nullptr if not exist
+      const AmfValue *get(std::size_t index, const char *name) const;
 
-  class AmfObjectItemString: public AmfObjectItem {
-    public:
-      AmfObjectItemString(const std::string &v) : AmfObjectItem(Amf0ObjectValueType_STRING), v_(v) {}
-      AmfObjectItemString(const char *data, int len) : AmfObjectItem(Amf0ObjectValueType_STRING), v_(data, len) {}
-      virtual std::string get_string() { return v_; }
-      virtual void set_string(const std::string &v) { v_ = v; }
-      virtual std::string stringify() { std::ostringstream oss; oss << v_; return oss.str(); }
-    private:
-      std::string v_;
-  }; // class AmfObjectItemNumber
+      void clear();
 
-  class AmfObjectItemMap {
     public:
-      AmfObjectItemMap();
-      ~AmfObjectItemMap();
-
-      /// @return true if <name> not exist before put op, otherwise false
-      /// @NOTICE if exist before put op, will overwrite
-      bool put(const std::string &name, bool v);
-      bool put(const std::string &name, double v);
-      bool put(const std::string &name, const std::string &v);
-      bool put(const std::string &name, const char *v, int len);
+      AmfReader() {}
 
-      /// @return true if exist, otherwise false
-      AmfObjectItem *get(const std::string &name);
-
-      std::size_t size() const { return objs_.size(); }
-      std::string stringify();
+    private:
+      AmfReader(const AmfReader &) = delete;
+      const AmfReader &operator=(const AmfReader &) = delete;
 
-      void clear();
+    private:
+      const uint8_t *decode_value(const uint8_t *p, const uint8_t *end, const char *name, std::size_t name_len, int depth);
+      const uint8_t *decode_named_members(const uint8_t *p, const uint8_t *end, uint32_t count, int depth);
+      AmfField &mutable_at(std::size_t index) {
+        return index < AMF_READER_INLINE_FIELD_NUM ? inline_fields_[index] : more_fields_[index - AMF_READER_INLINE_FIELD_NUM];
+      }
 
     private:
-      std::map<std::string, AmfObjectItem *> objs_;
-  }; // class AmfObjectItemMap
+      AmfField              inline_fields_[AMF_READER_INLINE_FIELD_NUM];
+      std::vector<AmfField> more_fields_;
+      std::size_t           num_ = 0;
+  }; // class AmfReader
 
   class AmfOp {
     public:
@@ -192,8 +180,6 @@ namespace yet {
       static uint8_t *decode_string(const uint8_t *in, int valid_len, char **out, int *str_len, std::size_t *used_len);
       static uint8_t *decode_string_with_type(const uint8_t *in, int valid_len, char **out, int *str_len, std::size_t *used_len);
 
-      static uint8_t *decode_object(const uint8_t *in, int valid_len, AmfObjectItemMap *objs, std::size_t *used_len);
-
     private:
       AmfOp() = delete;
       AmfOp(const AmfOp &) = delete;
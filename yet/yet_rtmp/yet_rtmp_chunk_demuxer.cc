@@ -0,0 +1,152 @@
+#include "yet_rtmp_chunk_demuxer.h"
+#include <algorithm>
+#include "yet.hpp"
+#include "chef_base/chef_stuff_op.hpp"
+
+namespace yet {
+
+RtmpChunkDemuxer::RtmpChunkDemuxer(RtmpMsgCb cb)
+  : msg_cb_(cb)
+  , read_buf_(BUF_INIT_LEN_RTMP_READ, BUF_SHRINK_LEN_RTMP_READ)
+{
+}
+
+uint8_t *RtmpChunkDemuxer::prepare_read(std::size_t len) {
+  // moves bytes left to the front only when the free tail is less than <len>
+  read_buf_.reserve(len);
+  return read_buf_.write_pos();
+}
+
+bool RtmpChunkDemuxer::feed(std::size_t len) {
+  read_buf_.seek_write_pos(len);
+  if (skip_left_) {
+    std::size_t n = std::min(skip_left_, read_buf_.readable_size());
+    read_buf_.erase(n);
+    skip_left_ -= n;
+  }
+  return resume();
+}
+
+bool RtmpChunkDemuxer::resume() {
+  for (;;) {
+    uint8_t *p = read_buf_.read_pos();
+    std::size_t readable_size = read_buf_.readable_size();
+
+    if (!header_done_) {
+      std::size_t header_len = parse_chunk_header(p, readable_size);
+      if (header_len == 0) { return true; }
+
+      read_buf_.erase(header_len);
+      header_done_ = true;
+      continue;
+    }
+
+    RtmpStream &stream = *curr_stream_;
+    if (stream.msg_recvd == 0 && chunk_left_ == stream.header.msg_len) {
+      // whole msg in this chunk, hand it out in place
+      if (readable_size < chunk_left_) { return true; }
+
+      read_buf_.erase(chunk_left_);
+      chunk_left_ = 0;
+      header_done_ = false;
+      if (!msg_cb_(stream.header, p)) { return false; }
+      continue;
+    }
+
+    std::size_t len = std::min(readable_size, chunk_left_);
+    if (len == 0) { return true; }
+
+    if (stream.msg_recvd == 0) { stream.msg->reserve(stream.header.msg_len); }
+    stream.msg->append(p, len);
+    read_buf_.erase(len);
+    stream.msg_recvd += len;
+    chunk_left_ -= len;
+    if (chunk_left_ != 0) { return true; }
+
+    header_done_ = false;
+    if (stream.msg_recvd == stream.header.msg_len) {
+      stream.msg_recvd = 0;
+      bool go_on = msg_cb_(stream.header, stream.msg->read_pos());
+      stream.msg->clear();
+      if (!go_on) { return false; }
+    }
+  }
+}
+
+std::size_t RtmpChunkDemuxer::parse_chunk_header(const uint8_t *p, std::size_t len) {
+  if (len < 1) { return 0; }
+
+  // 5.3.1.1. Chunk Basic Header 1,2,3bytes
+  uint8_t fmt = (p[0] >> 6) & 0x03;
+  uint32_t csid = p[0] & 0x3F;
+  std::size_t basic_header_len = 1;
+  if (csid == 0) {
+    basic_header_len = 2;
+    if (len < basic_header_len) { return 0; }
+
+    csid = 64 + p[1];
+  } else if (csid == 1) {
+    basic_header_len = 3;
+    if (len < basic_header_len) { return 0; }
+
+    csid = 64 + p[1] + (p[2] * 256);
+  }
+
+  // 5.3.1.2. Chunk Message Header 11,7,3,0bytes
+  std::size_t header_len = basic_header_len + RTMP_FMT_2_MSG_HEADER_LEN[fmt];
+  if (len < header_len) { return 0; }
+
+  RtmpStream &stream = get_or_create_stream(csid);
+  const uint8_t *mh = p + basic_header_len;
+
+  // 5.3.1.3 Extended Timestamp, fmt 3 follows the last header of the stream
+  bool has_ext_ts = (fmt == 3) ? stream.has_ext_ts
+                               : (chef::stuff_op::read_be_int(mh, 3) == RTMP_MAX_TIMESTAMP_IN_MSG_HEADER);
+  if (has_ext_ts) {
+    header_len += 4;
+    if (len < header_len) { return 0; }
+  }
+
+  // fields of chunks in the middle of a msg are ignored, the msg goes on with its first header
+  if (stream.msg_recvd == 0) {
+    uint32_t timestamp = 0;
+    if (fmt != 3) {
+      timestamp = has_ext_ts ? static_cast<uint32_t>(chef::stuff_op::read_be_int(p + header_len - 4, 4))
+                             : static_cast<uint32_t>(chef::stuff_op::read_be_int(mh, 3));
+      stream.has_ext_ts = has_ext_ts;
+    }
+    if (fmt <= 1) {
+      stream.header.msg_len = chef::stuff_op::read_be_int(mh + 3, 3);
+      stream.header.msg_type_id = mh[6];
+    }
+    if (fmt == 0) {
+      stream.header.msg_stream_id = mh[7] | (mh[8] << 8) | (mh[9] << 16) | (static_cast<uint32_t>(mh[10]) << 24);
+    }
+
+    // timestamp of fmt 0 is absolute, of fmt 1 and 2 is delta, fmt 3 repeats the last delta
+    if (fmt == 0) {
+      stream.header.timestamp = timestamp;
+      stream.timestamp_delta = 0;
+    } else {
+      if (fmt != 3) { stream.timestamp_delta = timestamp; }
+      stream.header.timestamp += stream.timestamp_delta;
+    }
+  }
+
+  curr_stream_ = &stream;
+  chunk_left_ = std::min<std::size_t>(stream.header.msg_len - stream.msg_recvd, peer_chunk_size_);
+  return header_len;
+}
+
+RtmpStream &RtmpChunkDemuxer::get_or_create_stream(uint32_t csid) {
+  auto iter = csid2stream_.find(csid);
+  if (iter != csid2stream_.end()) { return iter->second; }
+
+  YET_LOG_DEBUG("Create stream. {}", csid);
+  RtmpStream &stream = csid2stream_[csid];
+  stream.header.csid = csid;
+  stream.msg = std::make_shared<Buffer>(BUF_INIT_LEN_RTMP_COMPLETE_MESSAGE, BUF_SHRINK_LEN_RTMP_COMPLETE_MESSAGE);
+  return stream;
+}
+
+}
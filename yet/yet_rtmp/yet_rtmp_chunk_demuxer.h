@@ -0,0 +1,74 @@
+/**
+ * @file   yet_rtmp_chunk_demuxer.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include "yet_common/yet_common.hpp"
+#include "yet_rtmp/yet_rtmp.hpp"
+
+namespace yet {
+
+/// demux rtmp chunk stream into messages.
+///
+/// chunks are parsed in place in the read buffer, which is never erased or moved per chunk,
+/// bytes left are moved to the front only when the free tail is too small for next read.
+/// a message which fits in one chunk is handed out right from the read buffer without copy,
+/// a message over more chunks is copied once into a buffer of the stream, reserved by msg len of the header.
+class RtmpChunkDemuxer {
+  public:
+    /// @param msg payload of <header.msg_len> bytes, only valid during the call
+    /// @return false to pause demuxing, <resume> goes on with bytes left later
+    typedef std::function<bool(const RtmpHeader &header, uint8_t *msg)> RtmpMsgCb;
+
+    explicit RtmpChunkDemuxer(RtmpMsgCb cb);
+
+    /// @return where to read next, at least <len> bytes writable
+    uint8_t *prepare_read(std::size_t len);
+
+    /// demux <len> bytes just read to the pos of <prepare_read>
+    /// @return false if paused by callback
+    bool feed(std::size_t len);
+
+    /// go on demuxing bytes left after a pause
+    /// @return false if paused by callback again
+    bool resume();
+
+    /// drops <len> bytes fed ahead of the chunk stream,
+    /// e.g. c2 of handshake read together with the first chunks
+    void skip(std::size_t len) { skip_left_ = len; }
+    std::size_t skip_left() const { return skip_left_; }
+
+    /// chunk size of peer, takes effect from next chunk
+    void set_peer_chunk_size(std::size_t chunk_size) { peer_chunk_size_ = chunk_size; }
+    std::size_t peer_chunk_size() const { return peer_chunk_size_; }
+
+  private:
+    /// @return len of chunk header, 0 if not complete yet
+    std::size_t parse_chunk_header(const uint8_t *p, std::size_t len);
+
+    RtmpStream &get_or_create_stream(uint32_t csid);
+
+  private:
+    RtmpChunkDemuxer(const RtmpChunkDemuxer &) = delete;
+    RtmpChunkDemuxer &operator=(const RtmpChunkDemuxer &) = delete;
+
+  private:
+    typedef std::unordered_map<uint32_t, RtmpStream> Csid2Stream;
+
+  private:
+    RtmpMsgCb   msg_cb_;
+    Buffer      read_buf_;
+    Csid2Stream csid2stream_;
+    RtmpStream  *curr_stream_ = nullptr;
+    bool        header_done_ = false;
+    std::size_t chunk_left_ = 0; // payload of current chunk not consumed yet
+    std::size_t skip_left_ = 0;
+    std::size_t peer_chunk_size_ = RTMP_DEFAULT_CHUNK_SIZE;
+};
+
+}
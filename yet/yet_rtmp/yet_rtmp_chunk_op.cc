@@ -1,84 +1,76 @@
 #include "yet_rtmp_chunk_op.h"
 #include "yet_rtmp/yet_rtmp.hpp"
 #include "yet_rtmp/yet_rtmp_amf_op.h"
+#include "yet_common/yet_buffer_pool.h"
 #include "chef_base/chef_stuff_op.hpp"
 
 namespace yet {
 
-BufferPtr RtmpChunkOp::msg2chunks(BufferPtr msg, const RtmpHeader &rtmp_header, const RtmpHeader *prev, std::size_t chunk_size) {
+BufferPtr RtmpChunkOp::msg2chunks(const uint8_t *msg, const RtmpHeader &rtmp_header, const RtmpHeader *prev, std::size_t chunk_size) {
   YET_LOG_ASSERT(rtmp_header.csid <= 65599, "Invalid csid when serialize chunk. {}", rtmp_header.csid);
 
-  BufferPtr ret;
+  std::size_t total = rtmp_header.msg_len;
+  std::size_t num_of_chunk = (total + chunk_size - 1) / chunk_size;
+  if (num_of_chunk == 0) { num_of_chunk = 1; }
 
-  std::size_t total = msg->readable_size();
-
-  std::size_t suffix_chunk_len = chunk_size;
-  std::size_t num_of_chunk = total / chunk_size;
-  if (total % chunk_size != 0) {
-    num_of_chunk++;
-    suffix_chunk_len = total % chunk_size;
+  // fmt 3 is never used for the first chunk, it requires the same delta as last msg which is unknown here
+  std::size_t fmt = 0;
+  uint32_t timestamp = rtmp_header.timestamp;
+  if (prev && rtmp_header.msg_stream_id == prev->msg_stream_id) {
+    fmt = (rtmp_header.msg_len == prev->msg_len && rtmp_header.msg_type_id == prev->msg_type_id) ? 2 : 1;
+    timestamp = rtmp_header.timestamp - prev->timestamp;
   }
-
-  std::size_t max_needed_len = (chunk_size + RTMP_MAX_HEADER_LEN) * num_of_chunk;
-  ret = std::make_shared<Buffer>(max_needed_len, max_needed_len);
+  bool has_ext_ts = timestamp >= RTMP_MAX_TIMESTAMP_IN_MSG_HEADER;
 
   uint8_t header[RTMP_MAX_HEADER_LEN];
-  uint8_t *p = header;
-  std::size_t fmt = 0;
-
-  uint32_t timestamp;
-  if (!prev) {
-    timestamp = rtmp_header.timestamp;
-  } else {
-    if (rtmp_header.msg_stream_id == prev->msg_stream_id) {
-      fmt++;
-      if (rtmp_header.msg_len == prev->msg_len && rtmp_header.msg_type_id == prev->msg_type_id) {
-        fmt++;
-        if (rtmp_header.timestamp == prev->timestamp) {
-          fmt++;
-        }
-      }
-      timestamp = rtmp_header.timestamp - prev->timestamp;
-    }
+  uint8_t *p = encode_basic_header(header, fmt, rtmp_header.csid);
+  p = AmfOp::encode_int24(p, has_ext_ts ? RTMP_MAX_TIMESTAMP_IN_MSG_HEADER : timestamp);
+  if (fmt <= 1) {
+    p = AmfOp::encode_int24(p, rtmp_header.msg_len);
+    *p++ = rtmp_header.msg_type_id;
   }
-
-  *p = (fmt << 6);
-
-  if (rtmp_header.csid >= 2 && rtmp_header.csid <= 63) {
-    *p++ |= rtmp_header.csid;
-  } else if (rtmp_header.csid >= 64 && rtmp_header.csid <= 319) {
-    ++p;
-    *p++ |= (rtmp_header.csid - 64);
-  } else {
-    ++p;
-    *p++ |= 1;
-    *p++ = (rtmp_header.csid - 64);
-    *p++ = ((rtmp_header.csid - 64) >> 8);
+  if (fmt == 0) {
+    p = AmfOp::encode_int32_le(p, rtmp_header.msg_stream_id);
   }
-
-  if (fmt <= 2) {
-    p = AmfOp::encode_int24(p, std::min(timestamp, (uint32_t)RTMP_MAX_TIMESTAMP_IN_MSG_HEADER));
-    if (fmt <= 1) {
-      p = AmfOp::encode_int24(p, rtmp_header.msg_len);
-      *p++ = rtmp_header.msg_type_id;
-    }
-    if (fmt == 0) {
-      p = AmfOp::encode_int32_le(p, rtmp_header.msg_stream_id);
-    }
+  if (has_ext_ts) {
+    p = AmfOp::encode_int32(p, timestamp);
   }
+  std::size_t header_len = p - header;
 
-  if (timestamp > RTMP_MAX_TIMESTAMP_IN_MSG_HEADER) {
+  // continuation chunks use fmt 3, with extended timestamp repeated if there is one
+  uint8_t cont_header[RTMP_MAX_HEADER_LEN];
+  p = encode_basic_header(cont_header, 3, rtmp_header.csid);
+  if (has_ext_ts) {
     p = AmfOp::encode_int32(p, timestamp);
   }
+  std::size_t cont_header_len = p - cont_header;
 
-  std::size_t rtmp_header_len = p-header;
-  uint8_t *pos = msg->read_pos();
+  BufferPtr ret = BufferPool::acquire(header_len + total + cont_header_len * (num_of_chunk - 1));
   for (std::size_t i = 0; i < num_of_chunk; i++) {
-    ret->append(header, rtmp_header_len);
-    ret->append(pos + i*chunk_size, (i == num_of_chunk - 1) ? suffix_chunk_len : chunk_size);
+    if (i == 0) {
+      ret->append(header, header_len);
+    } else {
+      ret->append(cont_header, cont_header_len);
+    }
+    std::size_t len = std::min(chunk_size, total - i * chunk_size);
+    ret->append(msg + i * chunk_size, len);
   }
 
   return ret;
 }
 
+uint8_t *RtmpChunkOp::encode_basic_header(uint8_t *out, std::size_t fmt, uint32_t csid) {
+  if (csid >= 2 && csid <= 63) {
+    *out++ = (fmt << 6) | csid;
+  } else if (csid >= 64 && csid <= 319) {
+    *out++ = (fmt << 6);
+    *out++ = csid - 64;
+  } else {
+    *out++ = (fmt << 6) | 1;
+    *out++ = (csid - 64);
+    *out++ = (csid - 64) >> 8;
+  }
+  return out;
+}
+
 }
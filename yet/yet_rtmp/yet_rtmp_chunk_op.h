@@ -15,9 +15,13 @@ struct RtmpHeader;
 
 class RtmpChunkOp {
   public:
-    static BufferPtr msg2chunks(BufferPtr msg, const RtmpHeader &rtmp_header, const RtmpHeader *prev, std::size_t chunk_size);
+    /// @param msg payload of <rtmp_header.msg_len> bytes
+    static BufferPtr msg2chunks(const uint8_t *msg, const RtmpHeader &rtmp_header, const RtmpHeader *prev, std::size_t chunk_size);
 
     // deserialize
+  private:
+    static uint8_t *encode_basic_header(uint8_t *out, std::size_t fmt, uint32_t csid);
+
   private:
     RtmpChunkOp() = delete;
     RtmpChunkOp(const RtmpChunkOp &) = delete;
@@ -1,12 +1,11 @@
 #include "yet_rtmp_handshake.h"
+#include <atomic>
 #include "yet_rtmp/yet_hmac_sha256_adapter.hpp"
 #include "yet_rtmp/yet_rtmp_amf_op.h"
 #include "chef_base/chef_stuff_op.hpp"
 
 namespace yet {
 
-// TODO refactor me after use HS as client
-
 // old style: obs rtmpdump
 // new style: ffmpeg
 
@@ -46,56 +45,63 @@ static constexpr std::size_t RTMP_SERVER_PART_KEYLEN = 36;
 static constexpr std::size_t RTMP_CLIENT_FULL_KEYLEN = sizeof(RTMP_CLIENT_KEY);
 static constexpr std::size_t RTMP_CLIENT_PART_KEYLEN = 30;
 
-static bool rtmp_make_digest(const uint8_t *buf, std::size_t buf_len, const uint8_t *skip,
-                             const uint8_t *key, std::size_t key_len,
-                             uint8_t *dst)
-{
-  //YET_LOG_DEBUG("SHA256 key:{} len:{}", chef::stuff_op::bytes_to_hex(key, key_len, 16), key_len);
+/// contexts keyed with the fixed keys, each digest starts from a copy of one
+struct RtmpHandshakeKeyedHmacs {
+  HMACSHA256 client_part;
+  HMACSHA256 client_full;
+  HMACSHA256 server_part;
+  HMACSHA256 server_full;
+
+  RtmpHandshakeKeyedHmacs() {
+    client_part.init(RTMP_CLIENT_KEY, RTMP_CLIENT_PART_KEYLEN);
+    client_full.init(RTMP_CLIENT_KEY, RTMP_CLIENT_FULL_KEYLEN);
+    server_part.init(RTMP_SERVER_KEY, RTMP_SERVER_PART_KEYLEN);
+    server_full.init(RTMP_SERVER_KEY, RTMP_SERVER_FULL_KEYLEN);
+  }
+};
 
-  HMACSHA256 crypto;
-  crypto.init(key, key_len);
+static const RtmpHandshakeKeyedHmacs &keyed_hmacs() {
+  static const RtmpHandshakeKeyedHmacs hmacs;
+  return hmacs;
+}
 
+/// base of the digest which matched last time, clients of one deployment mostly use the same scheme.
+/// racy between threads by design, a stale value only costs one more digest
+static std::atomic<std::size_t> last_digest_base{764+8};
+
+/// @param crypto keyed, not updated yet
+static bool rtmp_make_digest(const uint8_t *buf, std::size_t buf_len, const uint8_t *skip,
+                             HMACSHA256 &crypto, uint8_t *dst)
+{
   if (skip) {
     // left
     if (skip != buf) {
-      //YET_LOG_INFO("SHA256 left:{} len:{}", chef::stuff_op::bytes_to_hex(buf, skip-buf, 16), skip-buf);
-      //HMAC_Update(hmac, buf, skip-buf);
       crypto.update(buf, skip-buf);
     }
     // right
     std::size_t right_len = buf + buf_len - skip - RTMP_HANDSHAKE_KEYLEN;
     if (right_len > 0) {
-      //YET_LOG_INFO("SHA256 right:{} len:{}", chef::stuff_op::bytes_to_hex(skip+RTMP_HANDSHAKE_KEYLEN, right_len, 16), right_len);
-      //HMAC_Update(hmac, skip + RTMP_HANDSHAKE_KEYLEN, right_len);
-      //uint8_t digest2[32];
       crypto.update(skip + RTMP_HANDSHAKE_KEYLEN, right_len);
     }
-    //YET_LOG_INFO("SHA256 dst:{} len:{}", chef::stuff_op::bytes_to_hex(dst, 32, 16), 32);
-
   } else {
-    //YET_LOG_INFO("SHA256 full:{} len:{}", chef::stuff_op::bytes_to_hex(buf, buf_len, 16), buf_len);
-    //HMAC_Update(hmac, buf, buf_len);
     crypto.update(buf, buf_len);
-    //uint8_t digest2[32];
-    //cryptlite::hmac<cryptlite::sha256>::calc(buf, buf_len, key, key_len, dst);
-    //YET_LOG_INFO("SHA256 dst:{} len:{}", chef::stuff_op::bytes_to_hex(dst, 32, 16), 32);
   }
 
-  //HMAC_Final(hmac, dst, &len);
-  //std::size_t dst_len;
   crypto.final(dst);
   //YET_LOG_INFO("SHA256 dst:{}", chef::stuff_op::bytes_to_hex(dst, 32, 16));
   return true;
 }
 
-static int rtmp_find_digest(const uint8_t *buf, std::size_t buf_len, std::size_t base, const uint8_t *key, std::size_t key_len) {
+static int rtmp_find_digest(const uint8_t *buf, std::size_t buf_len, std::size_t base, const HMACSHA256 &keyed) {
   std::size_t offs = buf[base] + buf[base+1] + buf[base+2] + buf[base+3];
   offs = (offs % 728) + base + 4;
   //YET_LOG_INFO("CHEFGREPME offs:{}", offs);
   const uint8_t *skip = buf + offs;
 
+  HMACSHA256 crypto;
+  crypto.init(keyed);
   uint8_t digest[RTMP_HANDSHAKE_KEYLEN];
-  if (!rtmp_make_digest(buf, buf_len, skip, key, key_len, digest)) {
+  if (!rtmp_make_digest(buf, buf_len, skip, crypto, digest)) {
     return -1;
   }
 
@@ -107,7 +113,7 @@ static int rtmp_find_digest(const uint8_t *buf, std::size_t buf_len, std::size_t
 }
 
 bool RtmpHandshake::rtmp_handshake_create_challenge(uint8_t *buf, std::size_t buf_len, const uint8_t *version,
-                                                    const uint8_t *key, std::size_t key_len)
+                                                    const HMACSHA256 &keyed)
 {
   *buf++ = RTMP_VERSION;
   timestamp_sent_s1_ = static_cast<int>(chef::stuff_op::unix_timestamp_msec() / 1000);
@@ -120,15 +126,16 @@ bool RtmpHandshake::rtmp_handshake_create_challenge(uint8_t *buf, std::size_t bu
   uint8_t *skip = (uint8_t *)buf + offs;
   //YET_LOG_INFO("offs:{}", offs);
 
-  if (!rtmp_make_digest((const uint8_t *)buf, buf_len-1, skip, key, key_len, skip)) {
+  HMACSHA256 crypto;
+  crypto.init(keyed);
+  if (!rtmp_make_digest((const uint8_t *)buf, buf_len-1, skip, crypto, skip)) {
     return false;
   }
   return true;
 }
 
 bool RtmpHandshake::rtmp_handshake_parse_challenge(const uint8_t *buf, std::size_t buf_len,
-                                                   const uint8_t *peer_key, std::size_t peer_key_len,
-                                                   const uint8_t *key, std::size_t key_len)
+                                                   const HMACSHA256 &peer_keyed, const HMACSHA256 &keyed)
 {
   if (buf[0] != RTMP_VERSION) {
     YET_LOG_ERROR("Handle c0c1 failed since version invalid. ver:{}", buf[0]);
@@ -141,34 +148,40 @@ bool RtmpHandshake::rtmp_handshake_parse_challenge(const uint8_t *buf, std::size
   int ver;
   AmfOp::decode_int32(buf+4, 4, &ver, nullptr);
   if (ver == 0) {
-    YET_LOG_INFO("Rtmp handshake old style.");
+    YET_LOG_DEBUG("Rtmp handshake old style.");
     is_old_ = true;
     return true;
   }
-  // key before digest
-  int offs = rtmp_find_digest((const uint8_t *)buf, buf_len-1, 764+8, peer_key, peer_key_len);
+  // key before digest at 764+8, or digest before key at 8
+  std::size_t base = last_digest_base.load(std::memory_order_relaxed);
+  int offs = rtmp_find_digest((const uint8_t *)buf, buf_len-1, base, peer_keyed);
   if (offs == -1) {
-    // digest before key
-    offs = rtmp_find_digest((const uint8_t *)buf, buf_len-1, 8, peer_key, peer_key_len);
+    base = (base == 8) ? 764+8 : 8;
+    offs = rtmp_find_digest((const uint8_t *)buf, buf_len-1, base, peer_keyed);
+    if (offs != -1) { last_digest_base.store(base, std::memory_order_relaxed); }
   }
   if (offs == -1) {
-    YET_LOG_INFO("Rtmp handshake old style.");
+    YET_LOG_DEBUG("Rtmp handshake old style.");
     is_old_ = true;
     return true;
   }
 
-  YET_LOG_INFO("Rtmp handshake new style. offs:{}", offs);
+  YET_LOG_DEBUG("Rtmp handshake new style. offs:{}", offs);
   is_old_ = false;
   // TODO random
 
+  HMACSHA256 crypto;
+  crypto.init(keyed);
   uint8_t digest[RTMP_HANDSHAKE_KEYLEN];
-  if (!rtmp_make_digest((const uint8_t *)buf+offs, RTMP_HANDSHAKE_KEYLEN, nullptr, key, key_len, digest)) {
+  if (!rtmp_make_digest((const uint8_t *)buf+offs, RTMP_HANDSHAKE_KEYLEN, nullptr, crypto, digest)) {
     YET_LOG_ERROR("CHEFGREPME Make s2 digest failed.");
     return false;
   }
 
+  // keyed with the digest just made, so no snapshot to start from
   static constexpr std::size_t digest_pos = RTMP_S2_LEN - RTMP_HANDSHAKE_KEYLEN;
-  if (!rtmp_make_digest((const uint8_t *)s2_, RTMP_S2_LEN, (const uint8_t *)s2_+digest_pos, digest, RTMP_HANDSHAKE_KEYLEN, (uint8_t *)s2_+ digest_pos)) {
+  crypto.init(digest, RTMP_HANDSHAKE_KEYLEN);
+  if (!rtmp_make_digest((const uint8_t *)s2_, RTMP_S2_LEN, (const uint8_t *)s2_+digest_pos, crypto, (uint8_t *)s2_+ digest_pos)) {
     YET_LOG_ERROR("CHEFGREPME Make s2 final digest failed.");
     return false;
   }
@@ -184,7 +197,7 @@ bool RtmpHandshake::handle_c0c1(const uint8_t *c0c1, std::size_t len) {
 
   //YET_LOG_DEBUG("CHEFGREPME {}", chef::stuff_op::bytes_to_hex((const uint8_t *)c0c1, 13, 32));
 
-  rtmp_handshake_parse_challenge(c0c1, len, RTMP_CLIENT_KEY, RTMP_CLIENT_PART_KEYLEN, RTMP_SERVER_KEY, RTMP_SERVER_FULL_KEYLEN);
+  rtmp_handshake_parse_challenge(c0c1, len, keyed_hmacs().client_part, keyed_hmacs().server_full);
 
   if (is_old_) {
     AmfOp::decode_int32(c0c1+1, len-1, &timestamp_recvd_c1_, nullptr);
@@ -196,18 +209,18 @@ bool RtmpHandshake::handle_c0c1(const uint8_t *c0c1, std::size_t len) {
 
 uint8_t *RtmpHandshake::create_s0s1() {
   if (is_old_) {
-    s0s1_[0] = RTMP_VERSION;
+    s0s1s2_[0] = RTMP_VERSION;
     timestamp_sent_s1_ = static_cast<int>(chef::stuff_op::unix_timestamp_msec() / 1000);
-    AmfOp::encode_int32(s0s1_+1, timestamp_sent_s1_);
-    memset(s0s1_+5, 0, 4);
+    AmfOp::encode_int32(s0s1s2_+1, timestamp_sent_s1_);
+    memset(s0s1s2_+5, 0, 4);
 
     // TODO random 1528
 
-    return s0s1_;
+    return s0s1s2_;
   }
 
-  rtmp_handshake_create_challenge(s0s1_, RTMP_S0S1_LEN, RTMP_SERVER_VERSION, RTMP_SERVER_KEY, RTMP_SERVER_PART_KEYLEN);
-  return s0s1_;
+  rtmp_handshake_create_challenge(s0s1s2_, RTMP_S0S1_LEN, RTMP_SERVER_VERSION, keyed_hmacs().server_part);
+  return s0s1s2_;
 }
 
 uint8_t *RtmpHandshake::create_s2() {
@@ -221,4 +234,53 @@ uint8_t *RtmpHandshake::create_s2() {
   return s2_;
 }
 
+uint8_t *RtmpHandshake::create_s0s1s2() {
+  create_s0s1();
+  create_s2();
+  return s0s1s2_;
+}
+
+uint8_t *RtmpHandshake::create_c0c1() {
+  // no secret in the filler, the digest position is derived from it
+  memset(s0s1s2_+1, 0, RTMP_C0C1_LEN-1);
+  rtmp_handshake_create_challenge(s0s1s2_, RTMP_C0C1_LEN, RTMP_CLIENT_VERSION, keyed_hmacs().client_part);
+  return s0s1s2_;
+}
+
+bool RtmpHandshake::handle_s0s1s2(const uint8_t *s0s1s2, std::size_t len) {
+  if (len < RTMP_S0S1S2_LEN) {
+    YET_LOG_ERROR("Handle s0s1s2 failed since len too short. len:{}", len);
+    return false;
+  }
+  if (s0s1s2[0] != RTMP_VERSION) {
+    YET_LOG_ERROR("Handle s0s1s2 failed since version invalid. ver:{}", s0s1s2[0]);
+    return false;
+  }
+
+  const uint8_t *s1 = s0s1s2 + 1;
+  int offs = rtmp_find_digest(s1, RTMP_S0S1_LEN-1, 8, keyed_hmacs().server_part);
+  if (offs == -1) { offs = rtmp_find_digest(s1, RTMP_S0S1_LEN-1, 764+8, keyed_hmacs().server_part); }
+  if (offs == -1) {
+    YET_LOG_DEBUG("Rtmp handshake old style server.");
+    is_old_ = true;
+    memcpy(s2_, s1, RTMP_C2_LEN);
+    return true;
+  }
+
+  YET_LOG_DEBUG("Rtmp handshake new style server. offs:{}", offs);
+  is_old_ = false;
+
+  // the same as s2 of <rtmp_handshake_parse_challenge>, keyed with the full client key instead
+  HMACSHA256 crypto;
+  crypto.init(keyed_hmacs().client_full);
+  uint8_t digest[RTMP_HANDSHAKE_KEYLEN];
+  rtmp_make_digest(s1+offs, RTMP_HANDSHAKE_KEYLEN, nullptr, crypto, digest);
+
+  static constexpr std::size_t digest_pos = RTMP_C2_LEN - RTMP_HANDSHAKE_KEYLEN;
+  memset(s2_, 0, digest_pos);
+  crypto.init(digest, RTMP_HANDSHAKE_KEYLEN);
+  rtmp_make_digest(s2_, RTMP_C2_LEN, s2_+digest_pos, crypto, s2_+digest_pos);
+  return true;
+}
+
 }
@@ -12,22 +12,39 @@
 
 namespace yet {
 
+class HMACSHA256;
+
 class RtmpHandshake {
   public:
     bool handle_c0c1(const uint8_t *c0c1, std::size_t len);
     uint8_t *create_s0s1();
     uint8_t *create_s2();
 
-    //uint8_t *create_s0s1s2();
+    /// s0s1 and s2 back to back, which the server may send at once after c0c1
+    /// @return <RTMP_S0S1S2_LEN> bytes
+    uint8_t *create_s0s1s2();
+
     bool handle_c2(const uint8_t *, std::size_t) { return true; }
 
+  public:
+    /// client side, c1 carries a digest, which servers of either style accept
+    /// @return <RTMP_C0C1_LEN> bytes
+    uint8_t *create_c0c1();
+
+    /// client side, c2 answers the digest of s1 if any, otherwise echoes s1
+    bool handle_s0s1s2(const uint8_t *s0s1s2, std::size_t len);
+
+    /// @return <RTMP_C2_LEN> bytes
+    uint8_t *create_c2() { return s2_; }
+
   private:
+    /// @param peer_keyed keyed with part of the client key, for the c1 digest
+    /// @param keyed      keyed with the full server key, for the s2 digest key
     bool rtmp_handshake_parse_challenge(const uint8_t *buf, std::size_t buf_len,
-                                        const uint8_t *peer_key, std::size_t peer_key_len,
-                                        const uint8_t *key, std::size_t key_len);
+                                        const HMACSHA256 &peer_keyed, const HMACSHA256 &keyed);
 
     bool rtmp_handshake_create_challenge(uint8_t *buf, std::size_t buf_len, const uint8_t *version,
-                                         const uint8_t *key, std::size_t key_len);
+                                         const HMACSHA256 &keyed);
 
   public:
     RtmpHandshake() {}
@@ -37,8 +54,8 @@ class RtmpHandshake {
     const RtmpHandshake &operator=(const RtmpHandshake &) = delete;
 
   private:
-    uint8_t s0s1_[RTMP_S0S1_LEN];
-    uint8_t s2_[RTMP_S2_LEN];
+    uint8_t s0s1s2_[RTMP_S0S1S2_LEN]; // c0c1 and c2 at the same places as client
+    uint8_t *const s2_ = s0s1s2_ + RTMP_S0S1_LEN;
     int timestamp_recvd_c1_;
     int timestamp_sent_s1_;
     bool is_old_;
@@ -31,12 +31,17 @@ int RtmpPackOp::encode_rtmp_msg_fc_publish_reserve(const char *stream_name) {
   return CHUNK_HEADER_SIZE_TYPE0 + 12 + 9 + 1 + AmfOp::encode_string_reserve(STRLEN(stream_name));
 }
 
-int RtmpPackOp::encode_rtmp_msg_publish_reserve(const char *app, const char *stream_name) {
+int RtmpPackOp::encode_rtmp_msg_publish_reserve(const char *publishing_type, const char *stream_name) {
   // 10 -> "publish", 9 -> Number, 1 -> Null
-  return CHUNK_HEADER_SIZE_TYPE0 + 10 + 9 + 1 + AmfOp::encode_string_reserve(STRLEN(app)) +
+  return CHUNK_HEADER_SIZE_TYPE0 + 10 + 9 + 1 + AmfOp::encode_string_reserve(STRLEN(publishing_type)) +
          AmfOp::encode_string_reserve(STRLEN(stream_name));
 }
 
+int RtmpPackOp::encode_rtmp_msg_play_reserve(const char *stream_name) {
+  // 7 -> "play", 9 -> Number, 1 -> Null
+  return CHUNK_HEADER_SIZE_TYPE0 + 7 + 9 + 1 + AmfOp::encode_string_reserve(STRLEN(stream_name));
+}
+
 static inline uint8_t *ENCODE_MESSAGE_HEADER(uint8_t *out, int csid, int len, int type_id, int stream_id) {
   // chunk basic header
   *out++ = (0x0 << 6) | csid; // fmt and chunk stream id
@@ -54,6 +59,12 @@ uint8_t *RtmpPackOp::encode_chunk_size(uint8_t *out, uint32_t cs) {
   return out;
 }
 
+uint8_t *RtmpPackOp::encode_ack(uint8_t *out, uint32_t seq_num) {
+  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_PROTOCOL_CONTROL, 4, RTMP_MSG_TYPE_ID_ACK, 0);
+  out = AmfOp::encode_int32(out, seq_num);
+  return out;
+}
+
 uint8_t *RtmpPackOp::encode_win_ack_size(uint8_t *out, int val) {
   out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_PROTOCOL_CONTROL, 4, RTMP_MSG_TYPE_ID_WIN_ACK_SIZE, 0);
   out = AmfOp::encode_int32(out, val);
@@ -101,27 +112,6 @@ uint8_t *RtmpPackOp::encode_connect(uint8_t *out, int len, const char *app, cons
   return out;
 }
 
-uint8_t *RtmpPackOp::encode_connect_result(uint8_t *out) {
-  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_CONNECTION, 190, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, 0);
-
-  out = AmfOp::encode_string(out, "_result", 7);
-  out = AmfOp::encode_number(out, RTMP_TRANSACTION_ID_CONNECT);
-  out = AmfOp::encode_object_begin(out);
-  // TODO cache me
-  out = AmfOp::encode_object_named_string(out, "fmsVer", 6, "FMS/3,0,1,123", 13);
-  out = AmfOp::encode_object_named_number(out, "capabilities", 12, 31);
-  out = AmfOp::encode_object_end(out);
-
-  out = AmfOp::encode_object_begin(out);
-  out = AmfOp::encode_object_named_string(out, "level", 5, "status", 6);
-  out = AmfOp::encode_object_named_string(out, "code", 4, "NetConnection.Connect.Success", 29);
-  out = AmfOp::encode_object_named_string(out, "description", 11, "Connection succeeded.", 21);
-  out = AmfOp::encode_object_named_number(out, "objectEncoding", 14, 0);
-  out = AmfOp::encode_object_end(out);
-
-  return out;
-}
-
 uint8_t *RtmpPackOp::encode_release_stream(uint8_t *out, int len, const char *stream_name) {
   out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_CONNECTION, len-CHUNK_HEADER_SIZE_TYPE0, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, 0);
 
@@ -157,17 +147,37 @@ uint8_t *RtmpPackOp::encode_create_stream(uint8_t *out) {
   return out;
 }
 
-uint8_t *RtmpPackOp::encode_create_stream_result(uint8_t *out, int transaction_id) {
+static uint8_t *build_connect_result(uint8_t *out) {
+  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_CONNECTION, 190, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, 0);
+
+  out = AmfOp::encode_string(out, "_result", 7);
+  out = AmfOp::encode_number(out, RTMP_TRANSACTION_ID_CONNECT);
+  out = AmfOp::encode_object_begin(out);
+  out = AmfOp::encode_object_named_string(out, "fmsVer", 6, "FMS/3,0,1,123", 13);
+  out = AmfOp::encode_object_named_number(out, "capabilities", 12, 31);
+  out = AmfOp::encode_object_end(out);
+
+  out = AmfOp::encode_object_begin(out);
+  out = AmfOp::encode_object_named_string(out, "level", 5, "status", 6);
+  out = AmfOp::encode_object_named_string(out, "code", 4, "NetConnection.Connect.Success", 29);
+  out = AmfOp::encode_object_named_string(out, "description", 11, "Connection succeeded.", 21);
+  out = AmfOp::encode_object_named_number(out, "objectEncoding", 14, 0);
+  out = AmfOp::encode_object_end(out);
+
+  return out;
+}
+
+static uint8_t *build_create_stream_result(uint8_t *out) {
   out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_CONNECTION, 29, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, 0);
   out = AmfOp::encode_string(out, "_result", 7);
-  out = AmfOp::encode_number(out, transaction_id);
+  out = AmfOp::encode_number(out, 0); // patched
   out = AmfOp::encode_null(out);
   out = AmfOp::encode_number(out, RTMP_MSID);
   return out;
 }
 
-uint8_t *RtmpPackOp::encode_on_status_publish(uint8_t *out, int stream_id) {
-  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, 105, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, stream_id);
+static uint8_t *build_on_status_publish(uint8_t *out) {
+  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, 105, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, RTMP_MSID); // patched
   out = AmfOp::encode_string(out, "onStatus", 8);
   out = AmfOp::encode_number(out, 0);
   out = AmfOp::encode_null(out);
@@ -180,8 +190,8 @@ uint8_t *RtmpPackOp::encode_on_status_publish(uint8_t *out, int stream_id) {
   return out;
 }
 
-uint8_t *RtmpPackOp::encode_on_status_play(uint8_t *out, int stream_id) {
-  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, 96, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, stream_id);
+static uint8_t *build_on_status_play(uint8_t *out) {
+  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, 96, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, RTMP_MSID); // patched
   out = AmfOp::encode_string(out, "onStatus", 8);
   out = AmfOp::encode_number(out, 0);
   out = AmfOp::encode_null(out);
@@ -194,14 +204,78 @@ uint8_t *RtmpPackOp::encode_on_status_play(uint8_t *out, int stream_id) {
   return out;
 }
 
-uint8_t *RtmpPackOp::encode_publish(uint8_t *out, int len, const char *app, const char *stream_name, int stream_id) {
+// offsets of the patched fields
+static constexpr int MSG_STREAM_ID_OFFSET = 8; // in chunk header of fmt 0
+static constexpr int CREATE_STREAM_RESULT_TRANSACTION_ID_OFFSET = CHUNK_HEADER_SIZE_TYPE0 + 10; // after "_result"
+
+struct RtmpPreEncodedMsgs {
+  uint8_t connect_response[RtmpPackOp::ENCODE_RTMP_MSG_CONNECT_RESPONSE_RESERVE];
+  uint8_t create_stream_result[RtmpPackOp::ENCODE_RTMP_MSG_CREATE_STREAM_RESULT_RESERVE];
+  uint8_t on_status_publish[RtmpPackOp::ENCODE_RTMP_MSG_ON_STATUS_PUBLISH_RESERVE];
+  uint8_t on_status_play[RtmpPackOp::ENCODE_RTMP_MSG_ON_STATUS_PLAY_RESERVE];
+
+  RtmpPreEncodedMsgs() {
+    // chunk size goes before _result, which is longer than the default chunk size
+    uint8_t *out = connect_response;
+    out = RtmpPackOp::encode_win_ack_size(out, RTMP_WINDOW_ACKNOWLEDGEMENT_SIZE);
+    out = RtmpPackOp::encode_peer_bandwidth(out, RTMP_PEER_BANDWIDTH);
+    out = RtmpPackOp::encode_chunk_size(out, RTMP_LOCAL_CHUNK_SIZE);
+    build_connect_result(out);
+
+    build_create_stream_result(create_stream_result);
+    build_on_status_publish(on_status_publish);
+    build_on_status_play(on_status_play);
+  }
+};
+
+static const RtmpPreEncodedMsgs &pre_encoded_msgs() {
+  static const RtmpPreEncodedMsgs msgs;
+  return msgs;
+}
+
+uint8_t *RtmpPackOp::encode_create_stream_result(uint8_t *out, int transaction_id) {
+  memcpy(out, pre_encoded_msgs().create_stream_result, ENCODE_RTMP_MSG_CREATE_STREAM_RESULT_RESERVE);
+  AmfOp::encode_number(out + CREATE_STREAM_RESULT_TRANSACTION_ID_OFFSET, transaction_id);
+  return out + ENCODE_RTMP_MSG_CREATE_STREAM_RESULT_RESERVE;
+}
+
+uint8_t *RtmpPackOp::encode_on_status_publish(uint8_t *out, int stream_id) {
+  memcpy(out, pre_encoded_msgs().on_status_publish, ENCODE_RTMP_MSG_ON_STATUS_PUBLISH_RESERVE);
+  AmfOp::encode_int32_le(out + MSG_STREAM_ID_OFFSET, stream_id);
+  return out + ENCODE_RTMP_MSG_ON_STATUS_PUBLISH_RESERVE;
+}
+
+uint8_t *RtmpPackOp::encode_on_status_play(uint8_t *out, int stream_id) {
+  memcpy(out, pre_encoded_msgs().on_status_play, ENCODE_RTMP_MSG_ON_STATUS_PLAY_RESERVE);
+  AmfOp::encode_int32_le(out + MSG_STREAM_ID_OFFSET, stream_id);
+  return out + ENCODE_RTMP_MSG_ON_STATUS_PLAY_RESERVE;
+}
+
+const uint8_t *RtmpPackOp::connect_response() {
+  return pre_encoded_msgs().connect_response;
+}
+
+uint8_t *RtmpPackOp::encode_publish(uint8_t *out, int len, const char *publishing_type, const char *stream_name,
+                                    int stream_id)
+{
   out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, len-CHUNK_HEADER_SIZE_TYPE0, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, stream_id);
 
   out = AmfOp::encode_string(out, "publish", STRLEN("publish"));
   out = AmfOp::encode_number(out, RTMP_TRANSACTION_ID_PUBLISH);
   out = AmfOp::encode_null(out);
   out = AmfOp::encode_string(out, stream_name, STRLEN(stream_name));
-  out = AmfOp::encode_string(out, app, STRLEN(app));
+  out = AmfOp::encode_string(out, publishing_type, STRLEN(publishing_type));
+
+  return out;
+}
+
+uint8_t *RtmpPackOp::encode_play(uint8_t *out, int len, const char *stream_name, int stream_id) {
+  out = ENCODE_MESSAGE_HEADER(out, RTMP_CSID_OVER_STREAM, len-CHUNK_HEADER_SIZE_TYPE0, RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0, stream_id);
+
+  out = AmfOp::encode_string(out, "play", STRLEN("play"));
+  out = AmfOp::encode_number(out, RTMP_TRANSACTION_ID_PLAY);
+  out = AmfOp::encode_null(out);
+  out = AmfOp::encode_string(out, stream_name, STRLEN(stream_name));
 
   return out;
 }
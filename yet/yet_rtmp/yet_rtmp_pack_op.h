@@ -15,6 +15,7 @@ namespace yet {
     public:
       static constexpr int ENCODE_RTMP_MSG_WIN_ACK_SIZE_RESERVE               = 16;  // 12 + 4
       static constexpr int ENCODE_RTMP_MSG_CHUNK_SIZE_RESERVE                 = 16;  // 12 + 4
+      static constexpr int ENCODE_RTMP_MSG_ACK_RESERVE                        = 16;  // 12 + 4
       static constexpr int ENCODE_RTMP_MSG_CREATE_STREAM_RESERVE              = 37;  // 12 + 15 + 9 + 1
       static constexpr int ENCODE_RTMP_MSG_USER_CONTROL_PING_RESPONSE_RESERVE = 18;  // 12 + 2 + 4
       static constexpr int ENCODE_RTMP_MSG_USER_CONTROL_PONG_RESPONSE_RESERVE = 18;  // 12 + 2 + 4
@@ -25,13 +26,16 @@ namespace yet {
       static constexpr int ENCODE_RTMP_MSG_CREATE_STREAM_RESULT_RESERVE       = 41;  // 12 + 10 + 9 + 1 + 9
       static constexpr int ENCODE_RTMP_MSG_ON_STATUS_PUBLISH_RESERVE          = 117; // 12 + 105
       static constexpr int ENCODE_RTMP_MSG_ON_STATUS_PLAY_RESERVE             = 108; // 12 + 96
+      static constexpr int ENCODE_RTMP_MSG_CONNECT_RESPONSE_RESERVE           = 251; // 16 + 17 + 16 + 202
 
       static int encode_rtmp_msg_connect_reserve(const char *app, const char *swf_url, const char *tc_url);
       static int encode_rtmp_msg_release_stream_reserve(const char *stream_name);
       static int encode_rtmp_msg_fc_publish_reserve(const char *stream_name);
-      static int encode_rtmp_msg_publish_reserve(const char *app, const char *stream_name);
+      static int encode_rtmp_msg_publish_reserve(const char *publishing_type, const char *stream_name);
+      static int encode_rtmp_msg_play_reserve(const char *stream_name);
       static int encode_rtmp_msg_win_ack_size_reserve() { return ENCODE_RTMP_MSG_WIN_ACK_SIZE_RESERVE; }
       static int encode_rtmp_msg_chunk_size_reserve() { return ENCODE_RTMP_MSG_CHUNK_SIZE_RESERVE; }
+      static int encode_rtmp_msg_ack_reserve() { return ENCODE_RTMP_MSG_ACK_RESERVE; }
       static int encode_rtmp_msg_create_stream_reserve() { return ENCODE_RTMP_MSG_CREATE_STREAM_RESERVE; }
       static int encode_rtmp_msg_connect_result_reserve() { return ENCODE_RTMP_MSG_CONNECT_RESULT_RESERVE; }
       static int encode_rtmp_msg_peer_bandwidth_reserve() { return ENCODE_RTMP_MSG_PEER_BANDWIDTH; }
@@ -40,11 +44,13 @@ namespace yet {
       static int encode_rtmp_msg_on_status_play_reserve() { return ENCODE_RTMP_MSG_ON_STATUS_PLAY_RESERVE; }
       static int encode_rtmp_msg_user_control_stream_begin_reserve() { return ENCODE_RTMP_MSG_USER_CONTROL_STREAM_BEGIN_RESERVE; }
       static int encode_rtmp_msg_user_control_stream_eof_reserve() { return ENCODE_RTMP_MSG_USER_CONTROL_STREAM_EOF_RESERVE; }
+      static int encode_rtmp_msg_connect_response_reserve() { return ENCODE_RTMP_MSG_CONNECT_RESPONSE_RESERVE; }
 
     public:
       /// memory alloc outsize by <out>
       static uint8_t *encode_win_ack_size(uint8_t *out, int val);
       static uint8_t *encode_chunk_size(uint8_t *out, uint32_t cs);
+      static uint8_t *encode_ack(uint8_t *out, uint32_t seq_num);
       static uint8_t *encode_user_control_ping_response(uint8_t *out, int timestamp);
       static uint8_t *encode_user_control_stream_begin(uint8_t *out);
       static uint8_t *encode_user_control_stream_eof(uint8_t *out);
@@ -52,14 +58,22 @@ namespace yet {
       static uint8_t *encode_release_stream(uint8_t *out, int len, const char *stream_name);
       static uint8_t *encode_fc_publish(uint8_t *out, int len, const char *stream_name);
       static uint8_t *encode_create_stream(uint8_t *out);
-      static uint8_t *encode_publish(uint8_t *out, int len, const char *app, const char *stream_name, int stream_id);
+      static uint8_t *encode_publish(uint8_t *out, int len, const char *publishing_type, const char *stream_name, int stream_id);
+      static uint8_t *encode_play(uint8_t *out, int len, const char *stream_name, int stream_id);
 
-      static uint8_t *encode_connect_result(uint8_t *out);
       static uint8_t *encode_peer_bandwidth(uint8_t *out, int val);
+
+      /// messages below are constant except the transaction id or stream id,
+      /// encoded once at first use, then copied and patched.
       static uint8_t *encode_create_stream_result(uint8_t *out, int transaction_id);
       static uint8_t *encode_on_status_publish(uint8_t *out, int stream_id);
       static uint8_t *encode_on_status_play(uint8_t *out, int stream_id);
 
+      /// Window Acknowledgement Size, Set Peer Bandwidth, Set Chunk Size and _result of connect,
+      /// all of the reply to connect for one write, valid for the whole process.
+      /// @return <encode_rtmp_msg_connect_response_reserve> bytes
+      static const uint8_t *connect_response();
+
     private:
       RtmpPackOp() = delete;
       RtmpPackOp(const RtmpPackOp &) = delete;
@@ -0,0 +1,501 @@
+#include "yet_rtmp_client.h"
+#include <asio.hpp>
+#include "yet.hpp"
+#include "yet_group.h"
+#include "yet_av_packet.h"
+#include "yet_config.h"
+#include "yet_rtmp/yet_rtmp_amf_op.h"
+#include "yet_rtmp/yet_rtmp_pack_op.h"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_common/yet_metrics.h"
+
+#define SNIPPET_HANDLE_CB_ERROR \
+  do { \
+    if (ec) { \
+      if (ec != asio::error::operation_aborted) { YET_LOG_ERROR("{} ec:{}", __func__, ec.message()); } \
+      close(); \
+      return; \
+    } \
+  } while(0);
+
+namespace yet {
+
+static constexpr const char *RTMP_DEFAULT_PORT = "1935";
+
+static const char *type_name(RtmpClientType type) {
+  return type == RTMP_CLIENT_TYPE_PULL ? "pull" : "push";
+}
+
+static std::string parse_host(const std::string &server) {
+  std::size_t pos = server.rfind(':');
+  return pos == std::string::npos ? server : server.substr(0, pos);
+}
+
+static std::string parse_port(const std::string &server) {
+  std::size_t pos = server.rfind(':');
+  return pos == std::string::npos ? RTMP_DEFAULT_PORT : server.substr(pos+1);
+}
+
+RtmpClient::RtmpClient(asio::io_context &io_ctx, RtmpClientType type, const std::string &server, const std::string &app,
+                       const std::string &live_name)
+  : io_ctx_(io_ctx)
+  , type_(type)
+  , server_(server)
+  , host_(parse_host(server))
+  , port_(parse_port(server))
+  , app_(app)
+  , live_name_(live_name)
+  , resolver_(io_ctx)
+  , socket_(io_ctx)
+  , chunk_demuxer_(std::bind(&RtmpClient::complete_message_handler, this, _1, _2))
+  , send_queue_(SEND_BATCH_MAX_BUF_NUM, SEND_BATCH_MAX_BYTES,
+                Config::instance()->sub_queue_max_bytes(), Config::instance()->sub_queue_max_delay_ms())
+  , retry_timer_(io_ctx)
+{
+  YET_LOG_DEBUG("RtmpClient() {}.", (void *)this);
+}
+
+RtmpClient::~RtmpClient() {
+  YET_LOG_DEBUG("~RtmpClient() {}.", (void *)this);
+}
+
+void RtmpClient::set_group(std::weak_ptr<Group> group) {
+  group_ = group;
+}
+
+void RtmpClient::start() {
+  YET_LOG_INFO("Start rtmp {}. server:{}:{}, app:{}, live name:{}", type_name(type_), host_, port_, app_, live_name_);
+  resolver_.async_resolve(host_, port_, std::bind(&RtmpClient::resolve_cb, shared_from_this(), _1, _2));
+}
+
+void RtmpClient::dispose() {
+  YET_LOG_DEBUG("Dispose rtmp {}. {}", type_name(type_), (void *)this);
+  disposed_ = true;
+  retry_timer_.cancel();
+  close();
+}
+
+void RtmpClient::close() {
+  if (closed_) { return; }
+
+  closed_ = true;
+
+  const SendQueueStat &stat = send_queue_.stat();
+  if (stat.dropped_frame_num) {
+    YET_LOG_INFO("Rtmp push dropped. server:{}, live name:{}, frame num:{}, bytes:{}, skip num:{}",
+                 server_, live_name_, stat.dropped_frame_num, stat.dropped_bytes, stat.skip_num);
+  }
+  resolver_.cancel();
+  ErrorCode ec;
+  socket_.close(ec);
+
+  if (type_ == RTMP_CLIENT_TYPE_PULL && !disposed_) { retry(); }
+}
+
+void RtmpClient::retry() {
+  auto group = group_.lock();
+  if (!group) { return; }
+
+  // subs are told the stream stopped, the same as when an rtmp pub stops
+  if (playing_) {
+    playing_ = false;
+    group->on_rtmp_pull_stop();
+  }
+
+  uint32_t delay_ms = Config::instance()->pull_retry_delay_ms(retry_num_);
+  retry_num_++;
+
+  YET_LOG_WARN("Rtmp pull retry. server:{}, live name:{}, retry num:{}, delay:{}ms", server_, live_name_, retry_num_, delay_ms);
+  Metrics::add(METRIC_RTMP_PULL_RETRY);
+
+  // handlers of this session may still be pending, so a new pull starts over with its own socket and demuxer
+  auto self = shared_from_this();
+  retry_timer_.expires_after(std::chrono::milliseconds(delay_ms));
+  retry_timer_.async_wait([this, self](const ErrorCode &timer_ec) {
+    if (timer_ec || disposed_) { return; }
+
+    auto g = group_.lock();
+    if (!g || g->get_rtmp_pull() != self) { return; }
+
+    auto pull = std::make_shared<RtmpClient>(io_ctx_, type_, server_, app_, live_name_);
+    pull->retry_num_ = retry_num_;
+    g->set_rtmp_pull(pull);
+    pull->start();
+  });
+}
+
+void RtmpClient::resolve_cb(const ErrorCode &ec, const asio::ip::tcp::resolver::results_type &endpoints) {
+  SNIPPET_HANDLE_CB_ERROR;
+  asio::async_connect(socket_, endpoints, std::bind(&RtmpClient::connect_cb, shared_from_this(), _1));
+}
+
+void RtmpClient::connect_cb(const ErrorCode &ec) {
+  SNIPPET_HANDLE_CB_ERROR;
+
+  YET_LOG_DEBUG("<----Handshake C0+C1");
+  BufferPtr c0c1 = BufferPool::acquire(rtmp_handshake_.create_c0c1(), RTMP_C0C1_LEN);
+  async_send(c0c1);
+
+  s0s1s2_ = BufferPool::acquire(RTMP_S0S1S2_LEN);
+  asio::async_read(socket_, asio::buffer(s0s1s2_->write_pos(), RTMP_S0S1S2_LEN),
+                   std::bind(&RtmpClient::read_s0s1s2_cb, shared_from_this(), _1, _2));
+}
+
+void RtmpClient::read_s0s1s2_cb(const ErrorCode &ec, std::size_t len) {
+  SNIPPET_HANDLE_CB_ERROR;
+  YET_LOG_DEBUG("---->Handshake S0+S1+S2");
+  Metrics::add(METRIC_RTMP_BYTES_IN, len);
+  bytes_recvd_ += len;
+
+  bool succ = rtmp_handshake_.handle_s0s1s2(s0s1s2_->write_pos(), len);
+  s0s1s2_.reset();
+  if (!succ) {
+    close();
+    return;
+  }
+
+  do_write_c2_connect();
+  do_read();
+}
+
+void RtmpClient::do_write_c2_connect() {
+  std::string tc_url = "rtmp://" + host_ + ":" + port_ + "/" + app_;
+  std::size_t connect_len = RtmpPackOp::encode_rtmp_msg_connect_reserve(app_.c_str(), "", tc_url.c_str());
+  std::size_t len = RTMP_C2_LEN + RtmpPackOp::encode_rtmp_msg_chunk_size_reserve() + connect_len;
+
+  // connect is a single chunk, sent after our chunk size is raised
+  BufferPtr buf = BufferPool::acquire(len);
+  uint8_t *p = buf->write_pos();
+  memcpy(p, rtmp_handshake_.create_c2(), RTMP_C2_LEN);
+  p = RtmpPackOp::encode_chunk_size(p + RTMP_C2_LEN, RTMP_LOCAL_CHUNK_SIZE);
+  RtmpPackOp::encode_connect(p, connect_len, app_.c_str(), "", tc_url.c_str());
+  buf->seek_write_pos(len);
+
+  YET_LOG_DEBUG("<----Handshake C2");
+  YET_LOG_DEBUG("<----Set Chunk Size {}", RTMP_LOCAL_CHUNK_SIZE);
+  YET_LOG_DEBUG("<----connect(\'{}\')", app_);
+  async_send(buf);
+}
+
+void RtmpClient::do_write_create_stream() {
+  std::size_t len = RtmpPackOp::encode_rtmp_msg_create_stream_reserve();
+  BufferPtr buf = BufferPool::acquire(len);
+  RtmpPackOp::encode_create_stream(buf->write_pos());
+  buf->seek_write_pos(len);
+  YET_LOG_DEBUG("<----createStream()");
+  async_send(buf);
+}
+
+void RtmpClient::do_write_play(int stream_id) {
+  std::size_t len = RtmpPackOp::encode_rtmp_msg_play_reserve(live_name_.c_str());
+  BufferPtr buf = BufferPool::acquire(len);
+  RtmpPackOp::encode_play(buf->write_pos(), len, live_name_.c_str(), stream_id);
+  buf->seek_write_pos(len);
+  YET_LOG_DEBUG("<----play(\'{}\')", live_name_);
+  async_send(buf);
+}
+
+void RtmpClient::do_write_publish(int stream_id) {
+  std::size_t len = RtmpPackOp::encode_rtmp_msg_publish_reserve(RTMP_PUBLISH_TYPE_LIVE, live_name_.c_str());
+  BufferPtr buf = BufferPool::acquire(len);
+  RtmpPackOp::encode_publish(buf->write_pos(), len, RTMP_PUBLISH_TYPE_LIVE, live_name_.c_str(), stream_id);
+  buf->seek_write_pos(len);
+  YET_LOG_DEBUG("<----publish(\'{}\')", live_name_);
+  async_send(buf);
+}
+
+void RtmpClient::maybe_write_ack(std::size_t len) {
+  bytes_recvd_ += len;
+  if (peer_win_ack_size_ == 0 || bytes_recvd_ - bytes_acked_ < peer_win_ack_size_) { return; }
+
+  // 5.4.3. sequence number is bytes received so far, wraps at 32 bits
+  bytes_acked_ = bytes_recvd_;
+  std::size_t ack_len = RtmpPackOp::encode_rtmp_msg_ack_reserve();
+  BufferPtr buf = BufferPool::acquire(ack_len);
+  RtmpPackOp::encode_ack(buf->write_pos(), static_cast<uint32_t>(bytes_recvd_));
+  buf->seek_write_pos(ack_len);
+  async_send(buf);
+}
+
+void RtmpClient::async_send(BufferPtr buf, bool droppable) {
+  bool is_empty = send_queue_.empty();
+  send_queue_.push(buf, droppable);
+  if (is_empty) { do_send(); }
+}
+
+void RtmpClient::do_send() {
+  asio::async_write(socket_, send_queue_.gather(),
+                    make_pooled_handler(std::bind(&RtmpClient::send_cb, shared_from_this(), _1, _2)));
+}
+
+void RtmpClient::send_cb(const ErrorCode &ec, std::size_t len) {
+  SNIPPET_HANDLE_CB_ERROR;
+  Metrics::add(METRIC_RTMP_BYTES_OUT, len);
+
+  send_queue_.pop_gathered();
+  if (!send_queue_.empty()) { do_send(); }
+}
+
+void RtmpClient::do_read() {
+  uint8_t *pos = chunk_demuxer_.prepare_read(BUF_INIT_LEN_RTMP_EACH_READ);
+  socket_.async_read_some(asio::buffer(pos, BUF_INIT_LEN_RTMP_EACH_READ),
+                          make_pooled_handler(std::bind(&RtmpClient::read_cb, shared_from_this(), _1, _2)));
+}
+
+void RtmpClient::read_cb(const ErrorCode &ec, std::size_t len) {
+  SNIPPET_HANDLE_CB_ERROR;
+  Metrics::add(METRIC_RTMP_BYTES_IN, len);
+
+  chunk_demuxer_.feed(len);
+  if (closed_) { return; }
+
+  maybe_write_ack(len);
+  do_read();
+}
+
+bool RtmpClient::complete_message_handler(const RtmpHeader &h, uint8_t *msg) {
+  switch (h.msg_type_id) {
+  case RTMP_MSG_TYPE_ID_SET_CHUNK_SIZE:
+  case RTMP_MSG_TYPE_ID_ABORT:
+  case RTMP_MSG_TYPE_ID_ACK:
+  case RTMP_MSG_TYPE_ID_WIN_ACK_SIZE:
+  case RTMP_MSG_TYPE_ID_BANDWIDTH:
+    protocol_control_message_handler(h, msg);
+    break;
+  case RTMP_MSG_TYPE_ID_USER_CONTROL:
+    user_control_message_handler(msg, h.msg_len);
+    break;
+  case RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0:
+    command_message_handler(msg, h.msg_len);
+    break;
+  case RTMP_MSG_TYPE_ID_DATA_MESSAGE_AMF0:
+    data_message_handler(h, msg);
+    break;
+  case RTMP_MSG_TYPE_ID_AUDIO:
+  case RTMP_MSG_TYPE_ID_VIDEO:
+    av_handler(h, msg);
+    break;
+  default:
+    YET_LOG_WARN("Recv unknown msg from server, ignore it. type:{}", h.msg_type_id);
+  }
+
+  return !closed_;
+}
+
+void RtmpClient::protocol_control_message_handler(const RtmpHeader &h, const uint8_t *msg) {
+  if (h.msg_len < 4) {
+    YET_LOG_ERROR("Invalid protocol control message. msg type id:{}, len:{}", h.msg_type_id, h.msg_len);
+    return;
+  }
+
+  int val;
+  AmfOp::decode_int32(msg, 4, &val, nullptr);
+
+  switch (h.msg_type_id) {
+  case RTMP_MSG_TYPE_ID_SET_CHUNK_SIZE:
+    // 5.4.1. first bit must be zero
+    val &= 0x7FFFFFFF;
+    if (val == 0) {
+      YET_LOG_ERROR("Invalid chunk size 0, ignore it.");
+      return;
+    }
+    chunk_demuxer_.set_peer_chunk_size(val);
+    YET_LOG_DEBUG("---->Set Chunk Size {}", val);
+    break;
+  case RTMP_MSG_TYPE_ID_WIN_ACK_SIZE:
+    peer_win_ack_size_ = static_cast<uint32_t>(val);
+    YET_LOG_DEBUG("---->Window Acknowledgement Size {}", peer_win_ack_size_);
+    break;
+  default:
+    YET_LOG_DEBUG("Recv protocol control message, ignore it. msg type id:{}, val:{}", h.msg_type_id, val);
+  }
+}
+
+void RtmpClient::user_control_message_handler(const uint8_t *msg, std::size_t len) {
+  if (len < 2) { return; }
+
+  int32_t event_type;
+  AmfOp::decode_int16(msg, len, &event_type, nullptr);
+  if (event_type != USER_CONTROL_EVENT_TYPE_PING_REQUEST || len < 6) {
+    YET_LOG_DEBUG("---->User Control {}", event_type);
+    return;
+  }
+
+  int timestamp;
+  AmfOp::decode_int32(msg+2, len-2, &timestamp, nullptr);
+  std::size_t pong_len = RtmpPackOp::ENCODE_RTMP_MSG_USER_CONTROL_PING_RESPONSE_RESERVE;
+  BufferPtr buf = BufferPool::acquire(pong_len);
+  RtmpPackOp::encode_user_control_ping_response(buf->write_pos(), timestamp);
+  buf->seek_write_pos(pong_len);
+  async_send(buf);
+}
+
+static std::string amf_string(const AmfValue *v) {
+  return (v && v->is_string()) ? std::string(v->str, v->str_len) : std::string();
+}
+
+void RtmpClient::command_message_handler(const uint8_t *msg, std::size_t len) {
+  // command name, transaction id, command object, then info of onStatus or _error, or stream id of _result
+  static constexpr std::size_t MAX_VALUE_NUM = 4;
+  AmfReader reader;
+  int values[MAX_VALUE_NUM];
+  std::size_t value_num = 0;
+  for (const uint8_t *p = msg, *end = msg+len; p < end && value_num < MAX_VALUE_NUM; ) {
+    std::size_t used_len;
+    int index = reader.decode(p, end-p, &used_len);
+    if (index == -1) { break; }
+
+    values[value_num++] = index;
+    p += used_len;
+  }
+  if (value_num < 2 || !reader.at(values[0]).value.is_string() || !reader.at(values[1]).value.is_number()) {
+    YET_LOG_ERROR("Invalid command message from server. len:{}", len);
+    return;
+  }
+
+  std::string cmd = amf_string(&reader.at(values[0]).value);
+  double transaction_id = reader.at(values[1]).value.number;
+  const AmfValue *last = value_num == MAX_VALUE_NUM ? &reader.at(values[3]).value : nullptr;
+
+  if (cmd == "_result" && transaction_id == RTMP_TRANSACTION_ID_CONNECT) {
+    YET_LOG_DEBUG("---->_result(\'NetConnection.Connect.Success\')");
+    do_write_create_stream();
+  } else if (cmd == "_result" && transaction_id == RTMP_TRANSACTION_ID_CREATE_STREAM) {
+    if (!last || !last->is_number()) {
+      YET_LOG_ERROR("Invalid createStream result from server.");
+      close();
+      return;
+    }
+    YET_LOG_DEBUG("---->_result(createStream) stream id:{}", last->number);
+    // chunks of packets shared with subs carry <RTMP_MSID>, a push can not publish on any other stream
+    if (type_ == RTMP_CLIENT_TYPE_PUSH && last->number != RTMP_MSID) {
+      YET_LOG_ERROR("Rtmp push got unexpected stream id. server:{}, live name:{}, stream id:{}, expected:{}",
+                    server_, live_name_, last->number, RTMP_MSID);
+      close();
+      return;
+    }
+    if (type_ == RTMP_CLIENT_TYPE_PULL) {
+      do_write_play(static_cast<int>(last->number));
+    } else {
+      do_write_publish(static_cast<int>(last->number));
+    }
+  } else if (cmd == "onStatus" || cmd == "_error") {
+    std::string level = last ? amf_string(reader.get(values[3], "level")) : std::string();
+    std::string code = last ? amf_string(reader.get(values[3], "code")) : std::string();
+    YET_LOG_INFO("---->{}(\'{}\') level:{}, live name:{}", cmd, code, level, live_name_);
+    if (cmd == "_error" || level == "error") {
+      YET_LOG_ERROR("Rtmp {} rejected by server. code:{}, server:{}, live name:{}", type_name(type_), code, server_, live_name_);
+      close();
+    } else if (type_ == RTMP_CLIENT_TYPE_PUSH && code == "NetStream.Publish.Start") {
+      publishing_ = true;
+    } else if (type_ == RTMP_CLIENT_TYPE_PULL && code == "NetStream.Play.Start" && !playing_) {
+      playing_ = true;
+      retry_num_ = 0;
+      if (auto group = group_.lock()) {
+        group->on_rtmp_pull_start();
+      }
+    }
+  } else {
+    YET_LOG_DEBUG("Recv command message {} from server, ignore it.", cmd);
+  }
+}
+
+void RtmpClient::data_message_handler(const RtmpHeader &h, uint8_t *msg) {
+  // only onMetaData is relayed, with leading @setDataFrame stripped if any, the same as of an rtmp pub
+  uint8_t *end = msg + h.msg_len;
+  uint8_t *p = msg;
+  char *name;
+  int name_len;
+  uint8_t *next = AmfOp::decode_string_with_type(p, end-p, &name, &name_len, nullptr);
+  if (next && std::string(name, name_len) == "@setDataFrame") {
+    p = next;
+    next = AmfOp::decode_string_with_type(p, end-p, &name, &name_len, nullptr);
+  }
+  if (!next || std::string(name, name_len) != "onMetaData") {
+    YET_LOG_DEBUG("Recv data message from server, ignore it.");
+    return;
+  }
+
+  if (type_ != RTMP_CLIENT_TYPE_PULL) { return; }
+
+  RtmpHeader out = h;
+  out.csid = RTMP_CSID_OVER_STREAM;
+  out.msg_stream_id = RTMP_MSID;
+  out.msg_len = end - p;
+  if (auto group = group_.lock()) {
+    group->on_rtmp_pull_data(p, out);
+  }
+}
+
+void RtmpClient::av_handler(const RtmpHeader &h, uint8_t *msg) {
+  if (type_ != RTMP_CLIENT_TYPE_PULL) { return; }
+
+  RtmpHeader out = h;
+  out.csid = h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO ? RTMP_CSID_AUDIO : RTMP_CSID_VIDEO;
+  out.msg_stream_id = RTMP_MSID;
+  if (auto group = group_.lock()) {
+    group->on_rtmp_pull_data(msg, out);
+  }
+}
+
+void RtmpClient::on_packet(AvPacketPtr pkt) {
+  // same as an rtmp sub in <Group::on_av_packet>, the already chunked buffers of the packet are shared,
+  // chunks carry <RTMP_MSID> which is the stream id servers give to the first createStream
+  if (pkt->is_metadata()) {
+    metadata_ = pkt;
+    if (has_sent_key_frame_) { async_send(pkt->rtmp_abs_chunks()); }
+    return;
+  }
+
+  bool is_audio = pkt->is_audio();
+  if (pkt->is_seq_header()) { (is_audio ? aac_header_ : avc_header_) = pkt; }
+
+  if (!publishing_ || closed_) { return; }
+
+  if (!admit_av_msg(is_audio, pkt->is_key_frame(), pkt->is_non_ref_frame(), pkt->payload_len())) { return; }
+
+  if (!has_sent_key_frame_) {
+    if (!pkt->is_key_frame()) { return; }
+
+    send_seq_headers();
+    has_sent_key_frame_ = true;
+  }
+
+  bool &has_sent = is_audio ? has_sent_audio_ : has_sent_video_;
+  if (has_sent) {
+    async_send(pkt->rtmp_delta_chunks(), true);
+  } else {
+    async_send(pkt->rtmp_abs_chunks(), true);
+    has_sent = true;
+  }
+}
+
+bool RtmpClient::admit_av_msg(bool is_audio, bool is_key_frame, bool is_non_ref_frame, std::size_t len) {
+  switch (send_queue_.admit_frame(is_key_frame, is_non_ref_frame, len)) {
+  case SENDQUEUEVERDICT_PASS:
+    return true;
+  case SENDQUEUEVERDICT_DROP:
+    (is_audio ? has_sent_audio_ : has_sent_video_) = false;
+    return false;
+  case SENDQUEUEVERDICT_SKIP:
+    send_queue_.purge_unsent();
+    has_sent_key_frame_ = false;
+    return false;
+  case SENDQUEUEVERDICT_RESYNC:
+    send_queue_.purge_unsent();
+    has_sent_key_frame_ = false;
+    return true;
+  }
+  return true;
+}
+
+void RtmpClient::send_seq_headers() {
+  // seq headers are abs chunks, next audio/video should be abs too
+  for (auto &pkt : { metadata_, avc_header_, aac_header_ }) {
+    if (pkt) { async_send(pkt->rtmp_abs_chunks(), true); }
+  }
+  has_sent_audio_ = false;
+  has_sent_video_ = false;
+}
+
+}
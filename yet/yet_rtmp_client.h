@@ -0,0 +1,135 @@
+/**
+ * @file   yet_rtmp_client.h
+ * @author pengrl
+ *
+ */
+
+#pragma once
+
+#include <asio.hpp>
+#include "yet.hpp"
+#include "yet_common/yet_send_queue.hpp"
+#include "yet_rtmp/yet_rtmp.hpp"
+#include "yet_rtmp/yet_rtmp_chunk_demuxer.h"
+#include "yet_rtmp/yet_rtmp_handshake.h"
+
+namespace yet {
+
+enum RtmpClientType {
+  RTMP_CLIENT_TYPE_PULL = 1, // plays from an upstream origin, feeds msgs to the group as an rtmp pub does
+  RTMP_CLIENT_TYPE_PUSH = 2  // publishes packets of the group to a downstream server, as an rtmp sub does
+};
+
+/// rtmp session with a server, which we connect to.
+///
+/// handshake, connect, createStream, then play or publish, then av msgs and metadata until closed by either side.
+/// c2 is written along with set chunk size and connect, the same as clients do to the server side.
+///
+/// a pull which fails or is refused to play is replaced by a new one on the group with backoff,
+/// see <Config::pull_retry_min_ms>, until disposed with its group. a push stops with the session.
+class RtmpClient : public std::enable_shared_from_this<RtmpClient> {
+  public:
+    /// @param server host of the server, with optional :port, 1935 if none
+    RtmpClient(asio::io_context &io_ctx, RtmpClientType type, const std::string &server, const std::string &app,
+               const std::string &live_name);
+    ~RtmpClient();
+
+    RtmpClientType type() const { return type_; }
+    const std::string &server() const { return server_; }
+
+    /// group which msgs of a pull go to
+    void set_group(std::weak_ptr<Group> group);
+
+    void start();
+
+    /// stops resolving, connecting, reading and retrying, the client is released when pending handlers are done
+    void dispose();
+
+    /// packet of the group to publish, called by a push for each packet the same as for an rtmp sub.
+    /// packets before publish started are dropped except metadata and seq headers,
+    /// and the downstream starts from next key frame.
+    /// the send queue has the budget of a sub, a slow downstream drops frames of its own only.
+    void on_packet(AvPacketPtr pkt);
+
+    const SendQueueStat &send_queue_stat() const { return send_queue_.stat(); }
+    std::size_t send_queue_bytes() const { return send_queue_.bytes(); }
+
+  private:
+    void resolve_cb(const ErrorCode &ec, const asio::ip::tcp::resolver::results_type &endpoints);
+    void connect_cb(const ErrorCode &ec);
+    void read_s0s1s2_cb(const ErrorCode &ec, std::size_t len);
+    void do_read();
+    void read_cb(const ErrorCode &ec, std::size_t len);
+
+    /// all writes go through the send queue, so commands, acks and av msgs never interleave on the socket
+    /// @param droppable true for av data, see <SendQueue::push>
+    void async_send(BufferPtr buf, bool droppable=false);
+    void do_send();
+    void send_cb(const ErrorCode &ec, std::size_t len);
+
+    void close();
+
+    /// of a pull, after <close> unless disposed
+    void retry();
+
+  private:
+    bool complete_message_handler(const RtmpHeader &h, uint8_t *msg);
+    void protocol_control_message_handler(const RtmpHeader &h, const uint8_t *msg);
+    void user_control_message_handler(const uint8_t *msg, std::size_t len);
+    void command_message_handler(const uint8_t *msg, std::size_t len);
+    void data_message_handler(const RtmpHeader &h, uint8_t *msg);
+    void av_handler(const RtmpHeader &h, uint8_t *msg);
+
+    void do_write_c2_connect();
+    void do_write_create_stream();
+    void do_write_play(int stream_id);
+    void do_write_publish(int stream_id);
+    void maybe_write_ack(std::size_t len);
+
+    /// same as <RtmpSession::admit_av_msg>
+    bool admit_av_msg(bool is_audio, bool is_key_frame, bool is_non_ref_frame, std::size_t len);
+    void send_seq_headers();
+
+  private:
+    RtmpClient(const RtmpClient &) = delete;
+    RtmpClient &operator=(const RtmpClient &) = delete;
+
+  private:
+    asio::io_context        &io_ctx_;
+    const RtmpClientType    type_;
+    const std::string       server_;
+    const std::string       host_;
+    const std::string       port_;
+    const std::string       app_;
+    const std::string       live_name_;
+    asio::ip::tcp::resolver resolver_;
+    asio::ip::tcp::socket   socket_;
+    std::weak_ptr<Group>    group_;
+    RtmpHandshake           rtmp_handshake_;
+    BufferPtr               s0s1s2_;
+    RtmpChunkDemuxer        chunk_demuxer_;
+    SendQueue               send_queue_;
+    uint32_t                peer_win_ack_size_ = 0;
+    uint64_t                bytes_recvd_ = 0;
+    uint64_t                bytes_acked_ = 0;
+    bool                    closed_ = false;
+    bool                    disposed_ = false;
+
+  private:
+    // of a pull
+    asio::steady_timer      retry_timer_;
+    uint32_t                retry_num_ = 0; // failures in a row, taken over by the next pull
+    bool                    playing_ = false;
+
+  private:
+    // of a push
+    bool                    publishing_ = false;
+    bool                    has_sent_key_frame_ = false;
+    bool                    has_sent_audio_ = false;
+    bool                    has_sent_video_ = false;
+    AvPacketPtr             metadata_;
+    AvPacketPtr             avc_header_;
+    AvPacketPtr             aac_header_;
+};
+
+}
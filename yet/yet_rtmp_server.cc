@@ -1,19 +1,25 @@
 #include "yet_rtmp_server.h"
 #include <asio.hpp>
+#include "yet_common/yet_acceptor.hpp"
+#include "yet_common/yet_metrics.h"
 #include "yet_server.h"
+#include "yet_config.h"
 #include "yet_group.h"
+#include "yet_http_flv_pull.h"
 #include "yet_rtmp_session.h"
 #include "yet.hpp"
 
 namespace yet {
 
-RtmpServer::RtmpServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server)
+RtmpServer::RtmpServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server,
+                       bool reuse_port)
   : io_ctx_(io_ctx)
   , listen_ip_(listen_ip)
   , listen_port_(listen_port)
   , server_(server)
-  , acceptor_(io_ctx_, asio::ip::tcp::endpoint(asio::ip::address_v4::from_string(listen_ip_), listen_port_))
+  , acceptor_(io_ctx_)
 {
+  open_acceptor(acceptor_, listen_ip_, listen_port_, reuse_port);
   YET_LOG_DEBUG("RtmpServer() {}.", static_cast<void *>(this));
 }
 
@@ -31,10 +37,13 @@ void RtmpServer::accept_cb(ErrorCode ec, asio::ip::tcp::socket socket) {
     return;
   }
 
+  Metrics::add(METRIC_RTMP_CONN_ACCEPTED);
   auto session = std::make_shared<RtmpSession>(std::move(socket));
   session->set_rtmp_publish_cb(std::bind(&RtmpServer::on_rtmp_publish, this, _1));
   session->set_rtmp_play_cb(std::bind(&RtmpServer::on_rtmp_play, this, _1));
   session->set_rtmp_publish_stop_cb(std::bind(&RtmpServer::on_rtmp_publish_stop, this, _1));
+  session->set_rtmp_session_close(std::bind(&RtmpServer::on_rtmp_session_close, this, _1));
+  session->set_rtmp_handover_cb(std::bind(&RtmpServer::on_rtmp_handover, this, _1));
   session->start();
 
   do_accept();
@@ -50,30 +59,44 @@ void RtmpServer::dispose() {
   acceptor_.close();
 }
 
+asio::io_context *RtmpServer::on_rtmp_handover(RtmpSessionPtr session) {
+  // type of a sub is set after play is answered, which is after handover
+  if (session->type() == RTMP_SESSION_TYPE_PUB) { return &server_->get_io_ctx(session->live_name()); }
+
+  return &server_->get_sub_io_ctx(session->live_name());
+}
+
 void RtmpServer::on_rtmp_publish(RtmpSessionPtr session) {
   auto group = server_->get_or_create_group(session->live_name());
   group->set_rtmp_pub(session);
+  group->on_rtmp_publish();
+  server_->start_rtmp_pushes(group, session->app());
 }
 
 void RtmpServer::on_rtmp_play(RtmpSessionPtr session) {
-  auto group = server_->get_or_create_group(session->live_name());
+  std::string uri = "/" + session->app() + "/" + session->live_name() + ".flv";
+  auto group = server_->get_or_create_sub_group(session->live_name(), session->app(), uri);
   group->add_rtmp_sub(session);
-  group->on_rtmp_publish();
 }
 
 void RtmpServer::on_rtmp_publish_stop(RtmpSessionPtr session) {
   auto group = server_->get_group(session->live_name());
   if (!group) {
     YET_LOG_WARN("Group not exist while publish stop. {}", session->live_name());
+    return;
   }
   group->on_rtmp_publish_stop();
 }
 
 void RtmpServer::on_rtmp_session_close(RtmpSessionPtr session) {
+  // closed before publish or play, never in a group
+  if (session->live_name().empty()) { return; }
+
+  // a session is closed in its own io thread, which is the thread of its group once handed over.
+  // closed in the accepting thread before handover, it is not in the group found there
   auto group = server_->get_group(session->live_name());
-  if (!group) {
-    YET_LOG_WARN("Group not exist while session close. {}", session->live_name());
-  }
+  if (!group) { return; }
+
   group->on_rtmp_session_close(session);
 }
 
@@ -17,7 +17,8 @@ namespace yet {
 class RtmpServer : public std::enable_shared_from_this<RtmpServer>
 {
   public:
-    RtmpServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server);
+    RtmpServer(asio::io_context &io_ctx, const std::string &listen_ip, uint16_t listen_port, Server *server,
+               bool reuse_port=false);
     ~RtmpServer();
 
     void start();
@@ -28,6 +29,7 @@ class RtmpServer : public std::enable_shared_from_this<RtmpServer>
     void on_rtmp_play(RtmpSessionPtr session);
     void on_rtmp_publish_stop(RtmpSessionPtr session);
     void on_rtmp_session_close(RtmpSessionPtr session);
+    asio::io_context *on_rtmp_handover(RtmpSessionPtr session);
 
   private:
     void do_accept();
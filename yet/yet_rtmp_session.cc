@@ -1,9 +1,13 @@
 #include "yet_rtmp_session.h"
+#include <unistd.h>
 #include <asio.hpp>
 #include "yet.hpp"
+#include "yet_config.h"
 #include "yet_rtmp/yet_rtmp.hpp"
 #include "yet_rtmp/yet_rtmp_amf_op.h"
 #include "yet_rtmp/yet_rtmp_pack_op.h"
+#include "yet_common/yet_buffer_pool.h"
+#include "yet_common/yet_metrics.h"
 #include "chef_base/chef_stuff_op.hpp"
 
 namespace yet {
@@ -19,16 +23,21 @@ namespace yet {
     } \
   } while(0);
 
-#define SNIPPET_KEEP_READ do { do_read(); return; } while(0);
-
-#define SNIPPET_ASYNC_READ(pos, len, func)      asio::async_read(socket_, asio::buffer(pos, len), std::bind(func, shared_from_this(), _1, _2));
-#define SNIPPET_ASYNC_READ_SOME(pos, len, func) socket_.async_read_some(asio::buffer(pos, len), std::bind(func, shared_from_this(), _1, _2));
-#define SNIPPET_ASYNC_WRITE(pos, len, func)     asio::async_write(socket_, asio::buffer(pos, len), std::bind(func, shared_from_this(), _1, _2));
+#define SNIPPET_ASYNC_READ(pos, len, func)      asio::async_read(socket_, asio::buffer(pos, len), make_pooled_handler(std::bind(func, shared_from_this(), _1, _2)));
+#define SNIPPET_ASYNC_READ_SOME(pos, len, func) socket_.async_read_some(asio::buffer(pos, len), make_pooled_handler(std::bind(func, shared_from_this(), _1, _2)));
+#define SNIPPET_ASYNC_WRITE(pos, len, func) \
+  do { \
+    pending_write_num_++; \
+    asio::async_write(socket_, asio::buffer(pos, len), std::bind(&RtmpSession::write_cb_wrapper, shared_from_this(), func, _1, _2)); \
+  } while(0);
 
 RtmpSession::RtmpSession(asio::ip::tcp::socket socket)
   : socket_(std::move(socket))
   , read_buf_(BUF_INIT_LEN_RTMP_EACH_READ, BUF_SHRINK_LEN_RTMP_EACH_READ)
   , write_buf_(BUF_INIT_LEN_RTMP_WRITE)
+  , chunk_demuxer_(std::bind(&RtmpSession::complete_message_handler, this, _1, _2))
+  , send_buffers_(SEND_BATCH_MAX_BUF_NUM, SEND_BATCH_MAX_BYTES,
+                  Config::instance()->sub_queue_max_bytes(), Config::instance()->sub_queue_max_delay_ms())
 {
   YET_LOG_DEBUG("RtmpSession() {}.", static_cast<void *>(this));
 }
@@ -38,6 +47,7 @@ RtmpSession::~RtmpSession() {
 }
 
 void RtmpSession::start() {
+  start_time_ = std::chrono::steady_clock::now();
   do_read_c0c1();
 }
 
@@ -47,215 +57,132 @@ void RtmpSession::do_read_c0c1() {
 
 void RtmpSession::read_c0c1_cb(ErrorCode ec, std::size_t len) {
   SNIPPET_ENTER_CB;
-  rtmp_handshake_.handle_c0c1(read_buf_.read_pos(), len);
-  YET_LOG_INFO("---->Handshake C0+C1");
-  do_write_s0s1();
-}
-
-void RtmpSession::do_write_s0s1() {
-  YET_LOG_INFO("<----Handshake S0+S1");
-  SNIPPET_ASYNC_WRITE(rtmp_handshake_.create_s0s1(), RTMP_S0S1_LEN, &RtmpSession::write_s0s1_cb);
-}
+  Metrics::add(METRIC_RTMP_BYTES_IN, len);
+  if (!rtmp_handshake_.handle_c0c1(read_buf_.read_pos(), len)) {
+    close();
+    return;
+  }
+  YET_LOG_DEBUG("---->Handshake C0+C1");
+  do_write_s0s1s2();
 
-void RtmpSession::write_s0s1_cb(ErrorCode ec, std::size_t len) {
-  SNIPPET_ENTER_CB;
-  do_write_s2();
+  // c2 is not waited for alone, clients often send connect right after it,
+  // so it is read along with the chunk stream and dropped ahead of it
+  chunk_demuxer_.skip(RTMP_C2_LEN);
+  do_read();
 }
 
-void RtmpSession::do_write_s2() {
-  YET_LOG_INFO("<----Handshake S2");
-  SNIPPET_ASYNC_WRITE(rtmp_handshake_.create_s2(), RTMP_S2_LEN, &RtmpSession::write_s2_cb);
+void RtmpSession::do_write_s0s1s2() {
+  YET_LOG_DEBUG("<----Handshake S0+S1+S2");
+  SNIPPET_ASYNC_WRITE(rtmp_handshake_.create_s0s1s2(), RTMP_S0S1S2_LEN, &RtmpSession::write_s0s1s2_cb);
 }
 
-void RtmpSession::write_s2_cb(ErrorCode ec, std::size_t len) {
+void RtmpSession::write_s0s1s2_cb(ErrorCode ec, std::size_t len) {
   SNIPPET_ENTER_CB;
-  do_read_c2();
-}
-
-void RtmpSession::do_read_c2() {
-  read_buf_.reserve(RTMP_C2_LEN);
-  SNIPPET_ASYNC_READ(read_buf_.write_pos(), RTMP_C2_LEN, &RtmpSession::read_c2_cb);
-}
-
-void RtmpSession::read_c2_cb(ErrorCode ec, std::size_t len) {
-  SNIPPET_ENTER_CB;
-  YET_LOG_INFO("---->Handshake C2");
-  do_read();
 }
 
 void RtmpSession::do_read() {
-  read_buf_.reserve(BUF_INIT_LEN_RTMP_EACH_READ);
-  SNIPPET_ASYNC_READ_SOME(read_buf_.write_pos(), BUF_INIT_LEN_RTMP_EACH_READ, &RtmpSession::read_cb);
+  uint8_t *pos = chunk_demuxer_.prepare_read(BUF_INIT_LEN_RTMP_EACH_READ);
+  SNIPPET_ASYNC_READ_SOME(pos, BUF_INIT_LEN_RTMP_EACH_READ, &RtmpSession::read_cb);
 }
 
 void RtmpSession::read_cb(ErrorCode ec, std::size_t len) {
   SNIPPET_ENTER_CB;
+  Metrics::add(METRIC_RTMP_BYTES_IN, len);
 
-  read_buf_.seek_write_pos(len);
-  //YET_LOG_DEBUG("Enter read_cb. read len:{}, readable_size:{}", len, read_buf_.readable_size());
-
-  for (; read_buf_.readable_size() > 0; ) {
-    //YET_LOG_DEBUG("Enter message parse loop. read_buf readable_size:{}", read_buf_.readable_size());
-    uint8_t *p = read_buf_.read_pos();
-
-    if (!header_done_) {
-      std::size_t readable_size = read_buf_.readable_size();
-
-      // 5.3.1.1. Chunk Basic Header 1,2,3bytes
-      int basic_header_len;
-      uint8_t fmt;
-      fmt = (*p >> 6) & 0x03;    // 2 bits
-      curr_csid_ = *p & 0x3F; // 6 bits
-      if (curr_csid_ == 0) {
-        basic_header_len = 2;
-        if (readable_size < 2) { SNIPPET_KEEP_READ; }
-
-        curr_csid_ = 64 + *(p+1);
-      } else if (curr_csid_ == 1) {
-        basic_header_len = 3;
-        if (readable_size < 3) { SNIPPET_KEEP_READ; }
-
-        curr_csid_ = 64 + *(p+1) + (*(p+2) * 256);
-      } else if (curr_csid_ == 2) {
-        basic_header_len = 1;
-      } else if (curr_csid_ < 64) {
-        basic_header_len = 1;
-      }
-
-      auto stream = get_or_create_stream(curr_csid_);
-
-      //YET_LOG_DEBUG("Parsed basic header. {} fmt:{}, csid:{}, basic_header_len:{}", (unsigned char)*p, fmt, curr_csid_, basic_header_len);
-
-      p += basic_header_len;
-      readable_size -= basic_header_len;
-
-      // 5.3.1.2. Chunk Message Header 11,7,3,0bytes
-      if (fmt == 0) {
-        if (readable_size < RTMP_FMT_2_MSG_HEADER_LEN[fmt]) { SNIPPET_KEEP_READ; }
-
-        p = AmfOp::decode_int24(p, 3, (int *)&stream->header.timestamp, nullptr);
-        p = AmfOp::decode_int24(p, 3, (int *)&stream->msg_len, nullptr);
-        stream->header.msg_type_id = *p++;
-        p = AmfOp::decode_int32_le(p, 4, (int *)&stream->header.msg_stream_id, nullptr);
-      } else if (fmt == 1) {
-        if (readable_size < RTMP_FMT_2_MSG_HEADER_LEN[fmt]) { SNIPPET_KEEP_READ; }
-
-        p = AmfOp::decode_int24(p, 3, (int *)&stream->header.timestamp, nullptr);
-        p = AmfOp::decode_int24(p, 3, (int *)&stream->msg_len, nullptr);
-        stream->header.msg_type_id = *p++;
-      } else if (fmt == 2) {
-        if (readable_size < RTMP_FMT_2_MSG_HEADER_LEN[fmt]) { SNIPPET_KEEP_READ; }
-
-        p = AmfOp::decode_int24(p, 3, (int *)&stream->header.timestamp, nullptr);
-      } else if (fmt == 3) {
-        // noop
-      }
-
-      readable_size -= RTMP_FMT_2_MSG_HEADER_LEN[fmt];
-
-      // 5.3.1.3 Extended Timestamp
-      bool has_ext_ts;
-      has_ext_ts = stream->header.timestamp == RTMP_MAX_TIMESTAMP_IN_MSG_HEADER;
-      if (has_ext_ts) {
-        if (readable_size < 4) { SNIPPET_KEEP_READ; }
-
-        p = AmfOp::decode_int32(p, 4, (int *)&stream->header.timestamp, nullptr);
-
-        readable_size -= 4;
-      }
-
-      header_done_ = true;
-      read_buf_.erase(basic_header_len + RTMP_FMT_2_MSG_HEADER_LEN[fmt] + (has_ext_ts ? 4 : 0));
-
-      //YET_LOG_DEBUG("Parsed chunk message header. msg_header_len:{}, timestamp:{}, msg_len:{}, msg_type_id:{}, msg_stream_id:{}",
-      //              RTMP_FMT_2_MSG_HEADER_LEN[fmt], stream->header.timestamp, stream->msg_len, stream->header.msg_type_id, stream->header.msg_stream_id);
-    }
-
-    curr_stream_ = get_or_create_stream(curr_csid_);
-
-    int needed_size;
-    if (curr_stream_->msg_len <= peer_chunk_size_) {
-      needed_size = curr_stream_->msg_len;
-    } else {
-      int whole_needed = curr_stream_->msg_len - (int)curr_stream_->msg->readable_size();
-      needed_size = std::min(whole_needed, peer_chunk_size_);
-    }
-
-    if ((int)read_buf_.readable_size() < needed_size) { SNIPPET_KEEP_READ; }
-
-    curr_stream_->msg->append(read_buf_.read_pos(), needed_size);
-    read_buf_.erase(needed_size);
-
-    if ((int)curr_stream_->msg->readable_size() == curr_stream_->msg_len) {
-      complete_message_handler();
-      curr_stream_->msg->clear();
-    }
-    YET_LOG_ASSERT((int)curr_stream_->msg->readable_size() <= curr_stream_->msg_len, "Invalid readable size.");
+  if (!handshake_done_ && len >= chunk_demuxer_.skip_left()) {
+    YET_LOG_DEBUG("---->Handshake C2");
+    handshake_done_ = true;
+    Metrics::observe(METRIC_RTMP_HANDSHAKE_US, elapsed_us());
+  }
 
-    header_done_ = false;
+  if (!chunk_demuxer_.feed(len)) {
+    // stop reading, handover when all pending writes done
+    if (pending_write_num_ == 0) { do_handover(); }
+    return;
   }
 
   do_read();
 }
 
-void RtmpSession::complete_message_handler() {
-  //YET_LOG_DEBUG("Enter complete message handler. type:{}", curr_stream_->header.msg_type_id);
-  switch (curr_stream_->header.msg_type_id) {
+bool RtmpSession::complete_message_handler(const RtmpHeader &h, uint8_t *msg) {
+  //YET_LOG_DEBUG("Enter complete message handler. type:{}", h.msg_type_id);
+  switch (h.msg_type_id) {
   case RTMP_MSG_TYPE_ID_SET_CHUNK_SIZE:
   case RTMP_MSG_TYPE_ID_ABORT:
   case RTMP_MSG_TYPE_ID_ACK:
   case RTMP_MSG_TYPE_ID_WIN_ACK_SIZE:
   case RTMP_MSG_TYPE_ID_BANDWIDTH:
-    protocol_control_message_handler();
+    protocol_control_message_handler(h, msg);
     break;
   case RTMP_MSG_TYPE_ID_COMMAND_MESSAGE_AMF0:
-    command_message_handler();
+    command_message_handler(msg, h.msg_len);
     break;
   case RTMP_MSG_TYPE_ID_DATA_MESSAGE_AMF0:
-    data_message_handler();
+    data_message_handler(h, msg);
     break;
   case RTMP_MSG_TYPE_ID_USER_CONTROL:
     user_control_message_handler();
     break;
   case RTMP_MSG_TYPE_ID_AUDIO:
   case RTMP_MSG_TYPE_ID_VIDEO:
-    av_handler();
+    av_handler(h, msg);
     break;
   default:
-    YET_LOG_ERROR("CHEFFUCKME. {}", curr_stream_->header.msg_type_id);
+    YET_LOG_ERROR("CHEFFUCKME. {}", h.msg_type_id);
   }
+
+  return handover_io_ctx_ == nullptr;
 }
 
-void RtmpSession::av_handler() {
-  int timestamp_abs = (curr_stream_->timestamp_base == -1) ? curr_stream_->header.timestamp : (curr_stream_->timestamp_base + curr_stream_->header.timestamp);
-  //YET_LOG_DEBUG("-----Recvd {} {}. ts:{}, delta:{}, size:{}", curr_csid_, curr_stream_->header.msg_type_id, timestamp_abs, curr_stream_->header.timestamp, curr_stream_->msg->readable_size());
-  RtmpHeader h;
-  h.csid = curr_stream_->header.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO ? RTMP_CSID_AUDIO : RTMP_CSID_VIDEO;
-  h.timestamp = timestamp_abs;
-  h.msg_len = curr_stream_->msg->readable_size();
-  h.msg_type_id = curr_stream_->header.msg_type_id;
-  h.msg_stream_id = RTMP_MSID;
+void RtmpSession::av_handler(const RtmpHeader &h, uint8_t *msg) {
+  //YET_LOG_DEBUG("-----Recvd {} {}. ts:{}, size:{}", h.csid, h.msg_type_id, h.timestamp, h.msg_len);
+  RtmpHeader out = h;
+  out.csid = h.msg_type_id == RTMP_MSG_TYPE_ID_AUDIO ? RTMP_CSID_AUDIO : RTMP_CSID_VIDEO;
+  out.msg_stream_id = RTMP_MSID;
   if (rtmp_data_cb_) {
-    rtmp_data_cb_(shared_from_this(), curr_stream_->msg, h);
+    rtmp_data_cb_(shared_from_this(), msg, out);
   }
-
-  curr_stream_->timestamp_base = timestamp_abs;
 }
 
-void RtmpSession::data_message_handler() {
-  // 7.1.2.
-  YET_LOG_WARN("Recv data message, ignore it.");
+void RtmpSession::data_message_handler(const RtmpHeader &h, uint8_t *msg) {
+  // 7.1.2. only onMetaData of publisher is forwarded, with leading @setDataFrame stripped
+  uint8_t *end = msg + h.msg_len;
+  uint8_t *p = msg;
+  char *name;
+  int name_len;
+  uint8_t *next = AmfOp::decode_string_with_type(p, end-p, &name, &name_len, nullptr);
+  if (next && std::string(name, name_len) == "@setDataFrame") {
+    p = next;
+    next = AmfOp::decode_string_with_type(p, end-p, &name, &name_len, nullptr);
+  }
+  if (type() != RTMP_SESSION_TYPE_PUB || !next || std::string(name, name_len) != "onMetaData") {
+    YET_LOG_WARN("Recv data message, ignore it.");
+    return;
+  }
+
+  RtmpHeader out = h;
+  out.csid = RTMP_CSID_OVER_STREAM;
+  out.msg_stream_id = RTMP_MSID;
+  out.msg_len = end - p;
+  if (rtmp_data_cb_) {
+    rtmp_data_cb_(shared_from_this(), p, out);
+  }
 }
 
 void RtmpSession::user_control_message_handler() {
   YET_LOG_ERROR("TODO");
 }
 
-void RtmpSession::protocol_control_message_handler() {
+void RtmpSession::protocol_control_message_handler(const RtmpHeader &h, uint8_t *msg) {
+  if (h.msg_len < 4) {
+    YET_LOG_ERROR("Invalid protocol control message. msg type id:{}, len:{}", h.msg_type_id, h.msg_len);
+    return;
+  }
+
   int val;
-  AmfOp::decode_int32(curr_stream_->msg->read_pos(), 4, &val, nullptr);
+  AmfOp::decode_int32(msg, 4, &val, nullptr);
 
-  switch (curr_stream_->header.msg_type_id) {
+  switch (h.msg_type_id) {
   case RTMP_MSG_TYPE_ID_SET_CHUNK_SIZE:
     set_chunk_size_handler(val);
     break;
@@ -263,47 +190,54 @@ void RtmpSession::protocol_control_message_handler() {
     win_ack_size_handler(val);
     break;
   case RTMP_MSG_TYPE_ID_ABORT:
-    YET_LOG_INFO("Recv protocol control message abort, ignore it. csid:{}", val);
+    YET_LOG_DEBUG("Recv protocol control message abort, ignore it. csid:{}", val);
     break;
   case RTMP_MSG_TYPE_ID_ACK:
-    YET_LOG_INFO("Recv protocol control message ack, ignore it. seq num:{}", val);
+    YET_LOG_DEBUG("Recv protocol control message ack, ignore it. seq num:{}", val);
     break;
   case RTMP_MSG_TYPE_ID_BANDWIDTH:
-    YET_LOG_INFO("Recv protocol control message bandwidth, ignore it. bandwidth:{}", val);
+    YET_LOG_DEBUG("Recv protocol control message bandwidth, ignore it. bandwidth:{}", val);
     break;
   default:
-    YET_LOG_ASSERT(false, "Unknown protocol control message. msg type id:{}", curr_stream_->header.msg_type_id);
+    YET_LOG_ASSERT(false, "Unknown protocol control message. msg type id:{}", h.msg_type_id);
   }
 }
 
 void RtmpSession::set_chunk_size_handler(int val) {
-  peer_chunk_size_ = val;
-  YET_LOG_INFO("---->Set Chunk Size {}", peer_chunk_size_);
+  // 5.4.1. first bit must be zero
+  val &= 0x7FFFFFFF;
+  if (val == 0) {
+    YET_LOG_ERROR("Invalid chunk size 0, ignore it.");
+    return;
+  }
+  chunk_demuxer_.set_peer_chunk_size(val);
+  YET_LOG_DEBUG("---->Set Chunk Size {}", val);
 }
 
 void RtmpSession::win_ack_size_handler(int val) {
-  YET_LOG_INFO("---->Window Acknowledgement Size {}", peer_win_ack_size_);
+  YET_LOG_DEBUG("---->Window Acknowledgement Size {}", peer_win_ack_size_);
 }
 
 // TODO same part
-void RtmpSession::command_message_handler() {
-  uint8_t *p = curr_stream_->msg->read_pos();
+void RtmpSession::command_message_handler(uint8_t *msg, std::size_t len) {
+  uint8_t *end = msg + len;
+  uint8_t *p = msg;
   char *command_name;
   int command_name_len;
-  p = AmfOp::decode_string_with_type(p, curr_stream_->msg->readable_size(), &command_name, &command_name_len, nullptr);
+  p = AmfOp::decode_string_with_type(p, len, &command_name, &command_name_len, nullptr);
 
   double transaction_id;
-  p = AmfOp::decode_number_with_type(p, curr_stream_->msg->write_pos()-p, &transaction_id, nullptr);
+  p = AmfOp::decode_number_with_type(p, end-p, &transaction_id, nullptr);
 
   std::string cmd = std::string(command_name, command_name_len);
-  std::size_t left_size = curr_stream_->msg->write_pos()-p;
+  std::size_t left_size = end-p;
   if (cmd == "releaseStream" ||
       cmd == "FCPublish" ||
       cmd == "FCUnpublish" ||
       cmd == "FCSubscribe" ||
       cmd == "getStreamLength"
   ) {
-    YET_LOG_INFO("Read command message {},ignore it.", cmd);
+    YET_LOG_DEBUG("Read command message {},ignore it.", cmd);
   } else if (cmd == "connect") {
     connect_handler(transaction_id, p, left_size);
   } else if (cmd == "createStream") {
@@ -373,7 +307,7 @@ void RtmpSession::play_handler(double transaction_id, uint8_t *buf, std::size_t
   // TODO
   // start duration reset
 
-  do_write_on_status_play();
+  handover_then(std::bind(&RtmpSession::do_write_on_status_play, this));
 }
 
 void RtmpSession::do_write_on_status_play() {
@@ -381,7 +315,7 @@ void RtmpSession::do_write_on_status_play() {
   write_buf_.reserve(len);
   // TODO stream id
   RtmpPackOp::encode_on_status_play(write_buf_.write_pos(), 1);
-  YET_LOG_INFO("<----onStatus(\'NetStream.Play.Start\')");
+  YET_LOG_DEBUG("<----onStatus(\'NetStream.Play.Start\')");
   SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_on_status_play_cb);
 }
 
@@ -413,6 +347,11 @@ void RtmpSession::publish_handler(double transaction_id, uint8_t *buf, std::size
   live_name_ = std::string(publishing_name, publishing_name_len);
   YET_LOG_INFO("---->publish(\'{}\')", live_name_);
   type_ = RTMP_SESSION_TYPE_PUB;
+
+  handover_then(std::bind(&RtmpSession::publish_start, this));
+}
+
+void RtmpSession::publish_start() {
   if (rtmp_publish_cb_) {
     rtmp_publish_cb_(shared_from_this());
   }
@@ -425,7 +364,7 @@ void RtmpSession::do_write_on_status_publish() {
   write_buf_.reserve(len);
   // TODO stream id
   RtmpPackOp::encode_on_status_publish(write_buf_.write_pos(), 1);
-  YET_LOG_INFO("<----onStatus(\'NetStream.Publish.Start\')");
+  YET_LOG_DEBUG("<----onStatus(\'NetStream.Publish.Start\')");
   SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_on_status_publish_cb);
 }
 
@@ -441,7 +380,7 @@ void RtmpSession::create_stream_handler(double transaction_id, uint8_t *buf, std
 
   // TODO null obj
 
-  YET_LOG_INFO("---->createStream()");
+  YET_LOG_DEBUG("---->createStream()");
 
   do_write_create_stream_result();
 }
@@ -451,7 +390,7 @@ void RtmpSession::do_write_create_stream_result() {
   write_buf_.reserve(len);
   // TODO stream id
   RtmpPackOp::encode_create_stream_result(write_buf_.write_pos(), create_stream_transaction_id_);
-  YET_LOG_INFO("<----_result()");
+  YET_LOG_DEBUG("<----_result()");
   SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_create_stream_result_cb);
 }
 
@@ -459,125 +398,191 @@ void RtmpSession::write_create_stream_result_cb(ErrorCode ec, std::size_t len) {
   SNIPPET_ENTER_CB;
 }
 
+static fmt::string_view amf_string_view(const AmfValue *v) {
+  return (v && v->is_string()) ? fmt::string_view(v->str, v->str_len) : fmt::string_view();
+}
+
 void RtmpSession::connect_handler(double transaction_id, uint8_t *buf, std::size_t len) {
   YET_LOG_ASSERT(transaction_id == RTMP_TRANSACTION_ID_CONNECT, "Invalid transaction_id while rtmp connect.")
 
-  AmfObjectItemMap objs;
-  buf = AmfOp::decode_object(buf, len, &objs, nullptr);
-  YET_LOG_ASSERT(buf, "decode command connect failed.");
-  //YET_LOG_INFO("transaction_id:{}, objs:{}, decode object succ:{}", transaction_id, objs.stringify(), p != nullptr);
-
-  AmfObjectItem *app = objs.get("app");
-  YET_LOG_ASSERT(app && app->is_string(), "Invalid app field when rtmp connect.");
-  app_ = app->get_string();
+  // fields point into the msg, only app is copied
+  AmfReader reader;
+  int obj = reader.decode(buf, len, nullptr);
+  const AmfValue *app = (obj != -1) ? reader.get(obj, "app") : nullptr;
+  if (!app || !app->is_string()) {
+    YET_LOG_ERROR("Invalid app field when rtmp connect. decode succ:{}", obj != -1);
+    close();
+    return;
+  }
+  app_.assign(app->str, app->str_len);
 
   YET_LOG_INFO("---->connect(\'{}\')", app_);
 
   // type
   // obs nonprivate
 
-  AmfObjectItem *type = objs.get("type");
-  AmfObjectItem *flash_ver = objs.get("flashVer");
-  AmfObjectItem *swf_url = objs.get("swfUrl");
-  AmfObjectItem *tc_url = objs.get("tcUrl");
   YET_LOG_INFO("connect app:{}, type:{}, flashVer:{}, swfUrl:{}, tcUrl:{}",
                app_,
-               type ? type->stringify() : "",
-               flash_ver ? flash_ver->stringify() : "",
-               swf_url ? swf_url->stringify() : "",
-               tc_url ? tc_url->stringify() : ""
+               amf_string_view(reader.get(obj, "type")),
+               amf_string_view(reader.get(obj, "flashVer")),
+               amf_string_view(reader.get(obj, "swfUrl")),
+               amf_string_view(reader.get(obj, "tcUrl"))
               );
 
-  do_write_win_ack_size();
+  do_write_connect_response();
 }
 
-void RtmpSession::do_write_win_ack_size() {
-  int len = RtmpPackOp::encode_rtmp_msg_win_ack_size_reserve();
-  write_buf_.reserve(len);
-  RtmpPackOp::encode_win_ack_size(write_buf_.write_pos(), RTMP_WINDOW_ACKNOWLEDGEMENT_SIZE);
-  YET_LOG_INFO("<----Window Acknowledgement Size {}", RTMP_WINDOW_ACKNOWLEDGEMENT_SIZE);
-  SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_win_ack_size_cb);
+void RtmpSession::do_write_connect_response() {
+  YET_LOG_DEBUG("<----Window Acknowledgement Size {}", RTMP_WINDOW_ACKNOWLEDGEMENT_SIZE);
+  YET_LOG_DEBUG("<----Set Peer Bandwidth {},Dynamic", RTMP_PEER_BANDWIDTH);
+  YET_LOG_DEBUG("<----Set Chunk Size {}", RTMP_LOCAL_CHUNK_SIZE);
+  YET_LOG_DEBUG("<----_result(\'NetConnection.Connect.Success\')");
+  // constant bytes, written from where they are cached
+  SNIPPET_ASYNC_WRITE(RtmpPackOp::connect_response(), RtmpPackOp::encode_rtmp_msg_connect_response_reserve(),
+                      &RtmpSession::write_connect_response_cb);
 }
 
-void RtmpSession::write_win_ack_size_cb(ErrorCode ec, std::size_t len) {
+void RtmpSession::write_connect_response_cb(ErrorCode ec, std::size_t len) {
   SNIPPET_ENTER_CB;
-  do_write_peer_bandwidth();
 }
 
-void RtmpSession::do_write_peer_bandwidth() {
-  int len = RtmpPackOp::encode_rtmp_msg_peer_bandwidth_reserve();
-  write_buf_.reserve(len);
-  RtmpPackOp::encode_peer_bandwidth(write_buf_.write_pos(), RTMP_PEER_BANDWIDTH);
-  YET_LOG_INFO("<----Set Peer Bandwidth {},Dynamic", RTMP_PEER_BANDWIDTH);
-  SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_peer_bandwidth_cb);
-}
+void RtmpSession::async_send(BufferPtr buf, bool droppable) {
+  if (droppable && !first_frame_queued_) {
+    first_frame_queued_ = true;
+    Metrics::observe(METRIC_RTMP_FIRST_FRAME_US, elapsed_us());
+  }
 
-void RtmpSession::write_peer_bandwidth_cb(ErrorCode ec, std::size_t len) {
-  SNIPPET_ENTER_CB;
-  do_write_chunk_size();
-}
+  bool is_empty = send_buffers_.empty();
+  send_buffers_.push(buf, droppable);
 
-void RtmpSession::do_write_chunk_size() {
-  int len = RtmpPackOp::encode_rtmp_msg_chunk_size_reserve();
-  write_buf_.reserve(len);
-  RtmpPackOp::encode_chunk_size(write_buf_.write_pos(), RTMP_LOCAL_CHUNK_SIZE);
-  YET_LOG_INFO("<----Set Chunk Size {}", RTMP_LOCAL_CHUNK_SIZE);
-  SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_chunk_size_cb);
+  // queue waits for control msgs being written, a big write may be split and mixed up with them otherwise
+  if (is_empty && pending_write_num_ == 0) {
+    do_send();
+  }
 }
 
-void RtmpSession::write_chunk_size_cb(ErrorCode ec, std::size_t len) {
-  SNIPPET_ENTER_CB;
-  do_write_connect_result();
+bool RtmpSession::admit_av_msg(bool is_audio, bool is_key_frame, bool is_non_ref_frame, std::size_t len) {
+  switch (send_buffers_.admit_frame(is_key_frame, is_non_ref_frame, len)) {
+  case SENDQUEUEVERDICT_PASS:
+    return true;
+  case SENDQUEUEVERDICT_DROP:
+    if (is_audio) {
+      has_sent_audio_ = false;
+    } else {
+      has_sent_video_ = false;
+    }
+    return false;
+  case SENDQUEUEVERDICT_SKIP:
+    send_buffers_.purge_unsent();
+    has_sent_key_frame_ = false;
+    return false;
+  case SENDQUEUEVERDICT_RESYNC:
+    send_buffers_.purge_unsent();
+    has_sent_key_frame_ = false;
+    return true;
+  }
+  return true;
 }
 
-void RtmpSession::do_write_connect_result() {
-  int len = RtmpPackOp::encode_rtmp_msg_connect_result_reserve();
-  write_buf_.reserve(len);
-  RtmpPackOp::encode_connect_result(write_buf_.write_pos());
-  YET_LOG_INFO("<----_result(\'NetConnection.Connect.Success\')");
-  SNIPPET_ASYNC_WRITE(write_buf_.read_pos(), len, &RtmpSession::write_connect_result_cb);
+void RtmpSession::do_send() {
+  asio::async_write(socket_, send_buffers_.gather(),
+                    make_pooled_handler(std::bind(&RtmpSession::send_cb, shared_from_this(), _1, _2)));
 }
 
-void RtmpSession::write_connect_result_cb(ErrorCode ec, std::size_t len) {
+void RtmpSession::send_cb(const ErrorCode &ec, std::size_t len) {
   SNIPPET_ENTER_CB;
-}
+  Metrics::add(METRIC_RTMP_BYTES_OUT, len);
 
-void RtmpSession::async_send(BufferPtr buf) {
-  bool is_empty = send_buffers_.empty();
-  send_buffers_.push(buf);
-  if (is_empty) {
+  send_buffers_.pop_gathered();
+  if (!send_buffers_.empty()) {
     do_send();
   }
 }
 
-void RtmpSession::do_send() {
-  BufferPtr buf = send_buffers_.front();
-  asio::async_write(socket_, asio::buffer(buf->read_pos(), buf->readable_size()),
-                    std::bind(&RtmpSession::send_cb, shared_from_this(), _1, _2));
+void RtmpSession::close() {
+  // both a read and a write may fail on the same connection
+  if (closed_) { return; }
+  closed_ = true;
+
+  const SendQueueStat &stat = send_buffers_.stat();
+  if (socket_.is_open() && stat.dropped_frame_num) {
+    YET_LOG_INFO("Rtmp sub dropped. live name:{}, frame num:{}, bytes:{}, skip num:{}",
+                 live_name_, stat.dropped_frame_num, stat.dropped_bytes, stat.skip_num);
+  }
+  if (socket_.is_open() && !handshake_done_) {
+    Metrics::add(METRIC_RTMP_HANDSHAKE_FAILED);
+  }
+
+  socket_.close();
+  if (rtmp_session_close_cb_) {
+    rtmp_session_close_cb_(shared_from_this());
+  }
 }
 
-void RtmpSession::send_cb(const ErrorCode &ec, std::size_t len) {
-  SNIPPET_ENTER_CB;
+void RtmpSession::write_cb_wrapper(WriteCb cb, ErrorCode ec, std::size_t len) {
+  Metrics::add(METRIC_RTMP_BYTES_OUT, len);
+  (this->*cb)(ec, len);
 
-  send_buffers_.pop();
-  if (!send_buffers_.empty()) {
+  pending_write_num_--;
+  if (pending_write_num_ == 0 && handover_io_ctx_ && socket_.is_open()) {
+    do_handover();
+  } else if (pending_write_num_ == 0 && !send_buffers_.empty() && !send_buffers_.is_sending() && socket_.is_open()) {
     do_send();
   }
 }
 
-void RtmpSession::close() {
-  socket_.close();
-  rtmp_session_close_cb_(shared_from_this());
+void RtmpSession::handover_then(std::function<void()> next) {
+  asio::io_context *io_ctx = rtmp_handover_cb_ ? rtmp_handover_cb_(shared_from_this()) : nullptr;
+  if (!io_ctx || io_ctx == &socket_.get_executor().context()) {
+    next();
+    return;
+  }
+
+  // @NOTICE real handover happens after current message, when no op is pending on socket
+  handover_io_ctx_ = io_ctx;
+  handover_next_ = next;
 }
 
-RtmpStreamPtr RtmpSession::get_or_create_stream(int csid) {
-  auto &stream = csid2stream_[csid];
-  if (!stream) {
-    YET_LOG_DEBUG("Create stream. {}", csid);
-    stream = std::make_shared<RtmpStream>();
-    stream->msg = std::make_shared<Buffer>(BUF_INIT_LEN_RTMP_COMPLETE_MESSAGE, BUF_SHRINK_LEN_RTMP_COMPLETE_MESSAGE);
+void RtmpSession::do_handover() {
+  YET_LOG_DEBUG("Handover rtmp session. {} {}", live_name_, static_cast<void *>(this));
+
+  ErrorCode ec;
+  auto protocol = socket_.local_endpoint(ec).protocol();
+  auto fd = socket_.release(ec);
+  if (ec) {
+    YET_LOG_ERROR("Release socket failed, rtmp session closed. live name:{}, ec:{}", live_name_, ec.message());
+    Metrics::add(METRIC_HANDOVER_FAILED);
+    close();
+    return;
   }
-  return stream;
+  auto self = shared_from_this();
+  asio::post(*handover_io_ctx_, [this, self, protocol, fd] {
+    ErrorCode assign_ec;
+    socket_ = asio::ip::tcp::socket(*handover_io_ctx_);
+    socket_.assign(protocol, fd, assign_ec);
+    handover_io_ctx_ = nullptr;
+    if (assign_ec) {
+      YET_LOG_ERROR("Assign socket failed, rtmp session closed. live name:{}, ec:{}", live_name_, assign_ec.message());
+      Metrics::add(METRIC_HANDOVER_FAILED);
+      ::close(fd);
+      close();
+      return;
+    }
+
+    auto next = std::move(handover_next_);
+    next();
+
+    // go on with data read before handover
+    if (chunk_demuxer_.resume()) {
+      do_read();
+    } else if (pending_write_num_ == 0) {
+      do_handover();
+    }
+  });
+}
+
+uint64_t RtmpSession::elapsed_us() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_).count();
 }
 
 void RtmpSession::set_rtmp_publish_cb(RtmpEventCb cb) {
@@ -592,8 +597,16 @@ void RtmpSession::set_rtmp_publish_stop_cb(RtmpEventCb cb) {
   rtmp_publish_stop_cb_ = cb;
 }
 
+void RtmpSession::set_rtmp_session_close(RtmpEventCb cb) {
+  rtmp_session_close_cb_ = cb;
+}
+
 void RtmpSession::set_rtmp_data_cb(RtmpDataCb cb) {
   rtmp_data_cb_ = cb;
 }
 
+void RtmpSession::set_rtmp_handover_cb(RtmpHandoverCb cb) {
+  rtmp_handover_cb_ = cb;
+}
+
 } // namespace yet
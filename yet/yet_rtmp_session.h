@@ -7,12 +7,13 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
-#include <queue>
-#include <unordered_map>
 #include <asio.hpp>
 #include "yet.hpp"
+#include "yet_common/yet_send_queue.hpp"
 #include "chef_base/chef_snippet.hpp"
+#include "yet_rtmp/yet_rtmp_chunk_demuxer.h"
 #include "yet_rtmp/yet_rtmp_chunk_op.h"
 #include "yet_rtmp/yet_rtmp.hpp"
 #include "yet_rtmp/yet_rtmp_handshake.h"
@@ -32,7 +33,11 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
 
   public:
     typedef std::function<void(RtmpSessionPtr session)> RtmpEventCb;
-    typedef std::function<void(RtmpSessionPtr session, BufferPtr buf, const RtmpHeader &header)> RtmpDataCb;
+    /// audio, video or onMetaData msg of publisher
+    /// @param msg payload of <header.msg_len> bytes, only valid during the call
+    typedef std::function<void(RtmpSessionPtr session, const uint8_t *msg, const RtmpHeader &header)> RtmpDataCb;
+    // return io context which the session should move to after live name parsed, nullptr if no need to move
+    typedef std::function<asio::io_context *(RtmpSessionPtr session)> RtmpHandoverCb;
 
   public:
     void set_rtmp_publish_cb(RtmpEventCb cb);
@@ -40,13 +45,24 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
     void set_rtmp_publish_stop_cb(RtmpEventCb cb);
     void set_rtmp_session_close(RtmpEventCb cb);
     void set_rtmp_data_cb(RtmpDataCb cb);
+    void set_rtmp_handover_cb(RtmpHandoverCb cb);
 
     void start();
 
     void dispose() {}
 
   public:
-    void async_send(BufferPtr buf);
+    /// @param droppable true for av data, which may be purged if the send queue overflows
+    void async_send(BufferPtr buf, bool droppable=false);
+
+    /// apply budget of the send queue to an av msg before sending it to this sub.
+    /// on dropping, the next msg of the same type has to be sent as abs chunks,
+    /// on skipping, the sub waits for next key frame as a new one.
+    /// @return false if <msg> should not be sent
+    bool admit_av_msg(bool is_audio, bool is_key_frame, bool is_non_ref_frame, std::size_t len);
+
+    const SendQueueStat &send_queue_stat() const { return send_buffers_.stat(); }
+    std::size_t send_queue_bytes() const { return send_buffers_.bytes(); }
 
   private:
     void close();
@@ -54,26 +70,17 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
   private:
     void do_read_c0c1();
     void read_c0c1_cb(ErrorCode ec, std::size_t len);
-    void do_write_s0s1();
-    void write_s0s1_cb(ErrorCode ec, std::size_t len);
-    void do_read_c2();
-    void do_write_s2();
-    void write_s2_cb(ErrorCode ec, std::size_t len);
-    void read_c2_cb(ErrorCode ec, std::size_t len);
+    void do_write_s0s1s2();
+    void write_s0s1s2_cb(ErrorCode ec, std::size_t len);
     void do_read();
     void read_cb(ErrorCode ec, std::size_t len);
-    void do_write_win_ack_size();
-    void write_win_ack_size_cb(ErrorCode ec, std::size_t len);
-    void do_write_peer_bandwidth();
-    void write_peer_bandwidth_cb(ErrorCode ec, std::size_t len);
-    void do_write_chunk_size();
-    void write_chunk_size_cb(ErrorCode ec, std::size_t len);
-    void do_write_connect_result();
-    void write_connect_result_cb(ErrorCode ec, std::size_t len);
+    void do_write_connect_response();
+    void write_connect_response_cb(ErrorCode ec, std::size_t len);
     void do_write_create_stream_result();
     void write_create_stream_result_cb(ErrorCode ec, std::size_t len);
 
   private:
+    void publish_start();
     void do_write_on_status_publish();
     void write_on_status_publish_cb(ErrorCode ec, std::size_t len);
 
@@ -82,13 +89,14 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
     void write_on_status_play_cb(ErrorCode ec, std::size_t len);
 
   private:
-    void complete_message_handler();
+    /// @return false if demuxing should pause for handover
+    bool complete_message_handler(const RtmpHeader &h, uint8_t *msg);
 
-    void protocol_control_message_handler();
+    void protocol_control_message_handler(const RtmpHeader &h, uint8_t *msg);
     void set_chunk_size_handler(int val);
     void win_ack_size_handler(int val);
 
-    void command_message_handler();
+    void command_message_handler(uint8_t *msg, std::size_t len);
     void connect_handler(double transaction_id, uint8_t *buf, std::size_t len);
     void create_stream_handler(double transaction_id, uint8_t *buf, std::size_t len);
     void publish_handler(double transaction_id, uint8_t *buf, std::size_t len);
@@ -101,17 +109,24 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
 
     void user_control_message_handler();
 
-    void data_message_handler();
+    void data_message_handler(const RtmpHeader &h, uint8_t *msg);
 
   private:
-    void av_handler();
+    void av_handler(const RtmpHeader &h, uint8_t *msg);
 
   private:
-    void do_send();
-    void send_cb(const ErrorCode &ec, std::size_t len);
+    typedef void (RtmpSession::*WriteCb)(ErrorCode ec, std::size_t len);
+    void write_cb_wrapper(WriteCb cb, ErrorCode ec, std::size_t len);
+
+    void handover_then(std::function<void()> next);
+    void do_handover();
+
+    /// since accepted
+    uint64_t elapsed_us() const;
 
   private:
-    RtmpStreamPtr get_or_create_stream(int csid);
+    void do_send();
+    void send_cb(const ErrorCode &ec, std::size_t len);
 
   private:
     RtmpSession(const RtmpSession &) = delete;
@@ -127,27 +142,28 @@ class RtmpSession : public std::enable_shared_from_this<RtmpSession> {
     CHEF_PROPERTY_WITH_INIT_VALUE(bool, has_sent_video, false);
     CHEF_PROPERTY_WITH_INIT_VALUE(bool, has_sent_key_frame, false);
 
-  private:
-    typedef std::unordered_map<int, RtmpStreamPtr> Csid2Stream;
-
   private:
     asio::ip::tcp::socket socket_;
     RtmpHandshake         rtmp_handshake_;
     chef::buffer          read_buf_;
     chef::buffer          write_buf_;
-    Csid2Stream           csid2stream_;
-    int                   curr_csid_;
-    RtmpStreamPtr         curr_stream_;
-    bool                  header_done_ = false;
-    int                   peer_chunk_size_ = RTMP_DEFAULT_CHUNK_SIZE;
+    RtmpChunkDemuxer      chunk_demuxer_;
     int                   peer_win_ack_size_ = -1;
     double                create_stream_transaction_id_ = -1;
-    std::queue<BufferPtr> send_buffers_;
+    SendQueue             send_buffers_;
     RtmpEventCb           rtmp_publish_cb_;
     RtmpEventCb           rtmp_play_cb_;
     RtmpEventCb           rtmp_publish_stop_cb_;
     RtmpEventCb           rtmp_session_close_cb_;
     RtmpDataCb            rtmp_data_cb_;
+    RtmpHandoverCb        rtmp_handover_cb_;
+    int                   pending_write_num_ = 0;
+    asio::io_context      *handover_io_ctx_ = nullptr;
+    std::function<void()> handover_next_;
+    std::chrono::steady_clock::time_point start_time_;
+    bool                  handshake_done_ = false;
+    bool                  closed_ = false;
+    bool                  first_frame_queued_ = false;
 };
 
 }
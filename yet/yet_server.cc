@@ -1,16 +1,37 @@
 #include "yet_server.h"
+#include <atomic>
 #include <asio.hpp>
 #include "yet_rtmp_server.h"
 #include "yet_http_flv_server.h"
 #include "yet_group.h"
+#include "yet_fanout.h"
+#include "yet_http_flv_pull.h"
+#include "yet_rtmp_client.h"
+#include "yet_config.h"
+#include "yet_common/yet_metrics.h"
 
 namespace yet {
 
+static constexpr uint32_t GROUP_GC_INTERVAL_MS = 1000;
+
+thread_local Server::Shard *Server::local_shard_ = nullptr;
+
 Server::Server(const std::string &rtmp_listen_ip, uint16_t rtmp_listen_port,
-               const std::string &http_flv_listen_ip, uint16_t http_flv_listen_port)
-  : rtmp_server_(std::make_shared<RtmpServer>(io_ctx_, rtmp_listen_ip, rtmp_listen_port, this))
-  , http_flv_server_(std::make_shared<HttpFlvServer>(io_ctx_, http_flv_listen_ip, http_flv_listen_port, this))
+               const std::string &http_flv_listen_ip, uint16_t http_flv_listen_port,
+               int io_thread_num, bool reuse_port)
+  : shards_(create_shards(io_thread_num))
+  , fanout_(create_fanout(shards_))
+  , reuse_port_(reuse_port)
+  , next_sub_shard_(0)
 {
+  YET_LOG_INFO("Server io thread num:{}, reuse port:{}", shards_.size(), reuse_port);
+
+  std::size_t listen_num = reuse_port ? shards_.size() : 1;
+  for (std::size_t i = 0; i < listen_num; i++) {
+    asio::io_context &io_ctx = shards_[i]->io_ctx;
+    rtmp_servers_.push_back(std::make_shared<RtmpServer>(io_ctx, rtmp_listen_ip, rtmp_listen_port, this, reuse_port));
+    http_flv_servers_.push_back(std::make_shared<HttpFlvServer>(io_ctx, http_flv_listen_ip, http_flv_listen_port, this, reuse_port));
+  }
 }
 
 Server::~Server() {
@@ -18,39 +39,222 @@ Server::~Server() {
 }
 
 void Server::run_loop() {
-  rtmp_server_->start();
-  http_flv_server_->start();
-  io_ctx_.run();
+  for (auto &it : rtmp_servers_) { it->start(); }
+  for (auto &it : http_flv_servers_) { it->start(); }
+  for (auto &shard : shards_) { do_gc(shard.get()); }
+
+  for (std::size_t i = 1; i < shards_.size(); i++) {
+    Shard *s = shards_[i].get();
+    threads_.emplace_back([s] {
+      local_shard_ = s;
+      auto work = asio::make_work_guard(s->io_ctx);
+      s->io_ctx.run();
+    });
+  }
+
+  {
+    local_shard_ = shards_[0].get();
+    auto work = asio::make_work_guard(shards_[0]->io_ctx);
+    shards_[0]->io_ctx.run();
+  }
+
+  for (auto &thd : threads_) { thd.join(); }
+  threads_.clear();
 }
 
 void Server::dispose() {
-  rtmp_server_->dispose();
-  http_flv_server_->dispose();
+  for (std::size_t i = 0; i < rtmp_servers_.size(); i++) {
+    auto rtmp_server = rtmp_servers_[i];
+    auto http_flv_server = http_flv_servers_[i];
+    asio::post(shards_[i]->io_ctx, [rtmp_server, http_flv_server] {
+      rtmp_server->dispose();
+      http_flv_server->dispose();
+    });
+  }
 
-  for (auto &it : live_name_2_group_) {
-    it.second->dispose();
+  for (auto &shard : shards_) {
+    Shard *s = shard.get();
+    asio::post(s->io_ctx, [s] {
+      s->gc_timer.cancel();
+      for (auto &it : s->live_name_2_group) {
+        it.second->dispose();
+      }
+      s->io_ctx.stop();
+    });
   }
+}
 
-  io_ctx_.stop();
+asio::io_context &Server::get_io_ctx(const std::string &live_name) {
+  return get_shard(live_name).io_ctx;
+}
+
+asio::io_context &Server::get_sub_io_ctx(const std::string &/*live_name*/) {
+  if (shards_.size() == 1) { return shards_[0]->io_ctx; }
+
+  // with reuse port the kernel has spread connections over threads already, a sub stays where it was accepted
+  if (reuse_port_) { return local_shard().io_ctx; }
+
+  return shards_[next_sub_shard_.fetch_add(1, std::memory_order_relaxed) % shards_.size()]->io_ctx;
+}
+
+Server::Shard &Server::get_shard(const std::string &live_name) {
+  if (shards_.size() == 1) { return *shards_[0]; }
+
+  return *shards_[std::hash<std::string>()(live_name) % shards_.size()];
 }
 
 GroupPtr Server::get_or_create_group(const std::string &live_name) {
-  auto iter = live_name_2_group_.find(live_name);
-  if (iter != live_name_2_group_.end()) {
+  Shard &s = local_shard();
+  auto iter = s.live_name_2_group.find(live_name);
+  if (iter != s.live_name_2_group.end()) {
     return iter->second;
   }
 
   auto group = std::make_shared<Group>(live_name);
-  live_name_2_group_[live_name] = group;
+  group->set_fanout(fanout_.get(), s.index, &s != &get_shard(live_name));
+  s.live_name_2_group[live_name] = group;
+  Metrics::add(METRIC_GROUP_CREATED);
+  return group;
+}
+
+GroupPtr Server::get_or_create_sub_group(const std::string &live_name, const std::string &app,
+                                         const std::string &pull_uri)
+{
+  GroupPtr group = get_or_create_group(live_name);
+  if (!group->is_replica()) {
+    ensure_pull(group, app, pull_uri);
+    return group;
+  }
+
+  // registered on each sub, so a stream stopped meanwhile is pulled again, same as a sub in the home thread
+  std::size_t shard = local_shard().index;
+  std::weak_ptr<Group> replica = group;
+  asio::post(get_io_ctx(live_name), [this, live_name, app, pull_uri, shard, replica] {
+    GroupPtr home = get_or_create_group(live_name);
+    ensure_pull(home, app, pull_uri);
+    home->add_replica(shard, replica);
+  });
   return group;
 }
 
+void Server::ensure_pull(GroupPtr group, const std::string &app, const std::string &uri) {
+  if (group->has_rtmp_pub() || group->get_http_flv_pull() || group->get_rtmp_pull()) { return; }
+
+  const std::string &rtmp_pull_host = Config::instance()->rtmp_pull_host();
+  if (!rtmp_pull_host.empty()) {
+    YET_LOG_DEBUG("Create rtmp pull. live name:{}, app:{}", group->live_name(), app);
+    auto pull = std::make_shared<RtmpClient>(get_io_ctx(group->live_name()), RTMP_CLIENT_TYPE_PULL, rtmp_pull_host, app,
+                                             group->live_name());
+    group->set_rtmp_pull(pull);
+    pull->start();
+    return;
+  }
+
+  YET_LOG_DEBUG("Create http flv pull. live name:{}, uri:{}", group->live_name(), uri);
+  auto pull = std::make_shared<HttpFlvPull>(get_io_ctx(group->live_name()), Config::instance()->http_flv_pull_host(), uri);
+  group->set_http_flv_pull(pull);
+  pull->start();
+}
+
+void Server::start_rtmp_pushes(GroupPtr group, const std::string &app) {
+  for (auto &rule : Config::instance()->match_rtmp_push_rules(app, group->live_name())) {
+    const std::string &push_app = rule.app.empty() ? app : rule.app;
+    YET_LOG_DEBUG("Create rtmp push. live name:{}, server:{}, app:{}", group->live_name(), rule.server, push_app);
+    auto push = std::make_shared<RtmpClient>(get_io_ctx(group->live_name()), RTMP_CLIENT_TYPE_PUSH, rule.server, push_app,
+                                             group->live_name());
+    group->add_rtmp_push(push);
+    push->start();
+  }
+}
+
 GroupPtr Server::get_group(const std::string &live_name) {
-  auto iter = live_name_2_group_.find(live_name);
-  if (iter != live_name_2_group_.end()) {
+  LiveName2Group &live_name_2_group = local_shard().live_name_2_group;
+  auto iter = live_name_2_group.find(live_name);
+  if (iter != live_name_2_group.end()) {
     return iter->second;
   }
   return nullptr;
 }
 
+void Server::async_collect_group_stats(asio::io_context &io_ctx, GroupStatsCb cb) {
+  // each shard fills its own slot, the last one to finish hands all slots over to <io_ctx>
+  struct Collecting {
+    std::vector<std::vector<GroupStat>> shard_stats;
+    std::atomic<std::size_t>            left;
+  };
+  auto collecting = std::make_shared<Collecting>();
+  collecting->shard_stats.resize(shards_.size());
+  collecting->left = shards_.size();
+
+  for (std::size_t i = 0; i < shards_.size(); i++) {
+    Shard *s = shards_[i].get();
+    asio::post(s->io_ctx, [collecting, s, i, &io_ctx, cb] {
+      for (auto &it : s->live_name_2_group) {
+        collecting->shard_stats[i].push_back(it.second->stat());
+      }
+      if (--collecting->left != 0) { return; }
+
+      asio::post(io_ctx, [collecting, cb] {
+        std::vector<GroupStat> stats;
+        for (auto &shard_stats : collecting->shard_stats) {
+          stats.insert(stats.end(), shard_stats.begin(), shard_stats.end());
+        }
+        cb(stats);
+      });
+    });
+  }
+}
+
+void Server::do_gc(Shard *s) {
+  s->gc_timer.expires_after(std::chrono::milliseconds(GROUP_GC_INTERVAL_MS));
+  s->gc_timer.async_wait([this, s](const ErrorCode &ec) {
+    if (ec) { return; }
+
+    release_idle_groups(s);
+    do_gc(s);
+  });
+}
+
+void Server::release_idle_groups(Shard *s) {
+  uint64_t linger_ms = Config::instance()->group_idle_linger_ms();
+  for (auto iter = s->live_name_2_group.begin(); iter != s->live_name_2_group.end(); ) {
+    GroupPtr &group = iter->second;
+    if (!group->is_idle() || group->idle_ms() < linger_ms) {
+      ++iter;
+      continue;
+    }
+
+    // sessions and the pull only hold weak refs, the group goes with the last ref here
+    YET_LOG_INFO("Release idle group. live name:{}, idle ms:{}", iter->first, group->idle_ms());
+    group->dispose();
+    if (group->is_replica()) {
+      // the home group may be gone already when the server is disposing
+      std::string live_name = iter->first;
+      std::weak_ptr<Group> replica = group;
+      asio::post(get_io_ctx(live_name), [this, live_name, s, replica] {
+        GroupPtr home = get_group(live_name);
+        if (home) { home->del_replica(s->index, replica); }
+      });
+    }
+    iter = s->live_name_2_group.erase(iter);
+    Metrics::add(METRIC_GROUP_RELEASED);
+  }
+}
+
+std::vector<std::unique_ptr<Server::Shard>> Server::create_shards(int num) {
+  std::vector<std::unique_ptr<Shard>> shards;
+  for (int i = 0; i < std::max(num, 1); i++) {
+    shards.emplace_back(new Shard(i));
+  }
+  return shards;
+}
+
+std::unique_ptr<Fanout> Server::create_fanout(const std::vector<std::unique_ptr<Shard>> &shards) {
+  if (shards.size() == 1) { return nullptr; }
+
+  std::vector<asio::io_context *> io_ctxs;
+  for (auto &shard : shards) { io_ctxs.push_back(&shard->io_ctx); }
+  return std::unique_ptr<Fanout>(new Fanout(io_ctxs, Config::instance()->fanout_ring_size()));
+}
+
 }
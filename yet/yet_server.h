@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <asio.hpp>
 #include "yet.hpp"
 
@@ -14,17 +19,43 @@ namespace yet {
 
 class Server {
   public:
+    /// @param io_thread_num num of io threads, each thread runs its own io context
+    /// @param reuse_port    if true, every io thread listens the same ports with SO_REUSEPORT, otherwise only the first one listens
     Server(const std::string &rtmp_listen_ip, uint16_t rtmp_listen_port,
-           const std::string &http_flv_listen_ip, uint16_t http_flv_listen_port);
+           const std::string &http_flv_listen_ip, uint16_t http_flv_listen_port,
+           int io_thread_num=1, bool reuse_port=false);
 
     ~Server();
 
     void run_loop();
     void dispose();
 
+    /// every live name has a home io thread, its rtmp pub and pull only live in it.
+    asio::io_context &get_io_ctx(const std::string &live_name);
+
+    /// io thread for a new sub of <live_name>, subs of a live name are spread over all io threads
+    asio::io_context &get_sub_io_ctx(const std::string &live_name);
+
+    /// group of <live_name> in the calling io thread, a replica if it is not the home thread, see <Group::set_fanout>
+    /// @NOTICE must be called in an io thread
     GroupPtr get_or_create_group(const std::string &live_name);
     GroupPtr get_group(const std::string &live_name);
 
+    /// group for a new sub in the calling io thread.
+    /// the home group pulls <live_name> of <app> from origin if it is not published,
+    /// and feeds the group from now on if it is a replica.
+    /// @param pull_uri uri of http flv pull, unused if pulled over rtmp, see <Config::rtmp_pull_host>
+    GroupPtr get_or_create_sub_group(const std::string &live_name, const std::string &app, const std::string &pull_uri);
+
+    /// forwards the pub of <group> to servers of matched <Config::rtmp_push_rules>
+    /// @NOTICE must be called in the home thread of the live name, after the pub is set
+    void start_rtmp_pushes(GroupPtr group, const std::string &app);
+
+    typedef std::function<void(const std::vector<GroupStat> &stats)> GroupStatsCb;
+
+    /// stat of each group is taken in its own io thread, <cb> is called in <io_ctx> when all io threads answered
+    void async_collect_group_stats(asio::io_context &io_ctx, GroupStatsCb cb);
+
   private:
     Server(const Server &) = delete;
     Server &operator=(const Server &) = delete;
@@ -32,11 +63,39 @@ class Server {
   private:
     typedef std::unordered_map<std::string, GroupPtr> LiveName2Group;
 
+    struct Shard {
+      const std::size_t  index;
+      asio::io_context   io_ctx;
+      LiveName2Group     live_name_2_group;
+      asio::steady_timer gc_timer;
+
+      explicit Shard(std::size_t i) : index(i), gc_timer(io_ctx) {}
+    };
+
+  private:
+    static std::vector<std::unique_ptr<Shard>> create_shards(int num);
+    static std::unique_ptr<Fanout> create_fanout(const std::vector<std::unique_ptr<Shard>> &shards);
+    Shard &get_shard(const std::string &live_name);
+    Shard &local_shard() { return *local_shard_; }
+
+    /// a live name not published here is pulled from origin over rtmp or http flv, and fed to both rtmp and http flv subs
+    /// @NOTICE must be called in the home thread of the live name
+    void ensure_pull(GroupPtr group, const std::string &app, const std::string &uri);
+
+    /// groups idle over <Config::group_idle_linger_ms> are disposed and erased, checked every second
+    void do_gc(Shard *s);
+    void release_idle_groups(Shard *s);
+
   private:
-    asio::io_context io_ctx_;
-    RtmpServerPtr    rtmp_server_;
-    HttpFlvServerPtr http_flv_server_;
-    LiveName2Group   live_name_2_group_;
+    static thread_local Shard           *local_shard_; // shard of the calling io thread
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::unique_ptr<Fanout>             fanout_; // null if only one io thread
+    const bool                          reuse_port_;
+    std::atomic<std::size_t>            next_sub_shard_;
+    std::vector<std::thread>            threads_;
+    std::vector<RtmpServerPtr>          rtmp_servers_;
+    std::vector<HttpFlvServerPtr>       http_flv_servers_;
 };
 
 }